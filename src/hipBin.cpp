@@ -20,187 +20,11 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
-#include "hipBin_util.h"
-#include "hipBin_amd.h"
-#include "hipBin_nvidia.h"
-#include "hipBin_spirv.h"
-#include <vector>
-#include <string>
 
-class HipBinUtil;
-class HipBinBase;
-class HipBinAmd;
-class HipBinNvidia;
-class HipBinSpirv;
-class HipBin;
+// hipcc.bin, hipconfig.bin and hipcc-worker.bin: front ends of libhipcc
 
-
-class HipBin {
- private:
-  HipBinUtil* hipBinUtilPtr_;
-  vector<HipBinBase*> hipBinBasePtrs_;
-  vector<PlatformInfo> platformVec_;
-  HipBinBase* hipBinNVPtr_;
-  HipBinBase* hipBinAMDPtr_;
-  HipBinBase* hipBinSPIRVPtr_;
-
- public:
-  HipBin();
-  ~HipBin();
-  vector<HipBinBase*>& getHipBinPtrs();
-  vector<PlatformInfo>& getPlaformInfo();
-  void executeHipBin(string filename, int argc, char* argv[]);
-  void executeHipConfig(int argc, char* argv[]);
-  void executeHipCC(int argc, char* argv[]);
-};
-
-
-// Implementation ================================================
-//===========================================================================
-
-HipBin::HipBin() {
-  hipBinUtilPtr_ = hipBinUtilPtr_->getInstance();
-  hipBinNVPtr_ = new HipBinNvidia();
-  hipBinAMDPtr_ = new HipBinAmd();
-  hipBinSPIRVPtr_ = new HipBinSpirv();
-  bool platformDetected = false;
-
-  // Default to SPIR-V for our fork
-  if (hipBinSPIRVPtr_->detectPlatform()) {
-    // populates the struct with Intel/SPIR-V info
-    const PlatformInfo &platformInfo = hipBinSPIRVPtr_->getPlatformInfo();
-    platformVec_.push_back(platformInfo);
-    hipBinBasePtrs_.push_back(hipBinSPIRVPtr_);
-    platformDetected = true;
-  }
-
-  if (hipBinAMDPtr_->detectPlatform()) {
-    // populates the struct with AMD info
-    const PlatformInfo& platformInfo = hipBinAMDPtr_->getPlatformInfo();
-    platformVec_.push_back(platformInfo);
-    hipBinBasePtrs_.push_back(hipBinAMDPtr_);
-    platformDetected = true;
-  } 
-  
-  // if (hipBinNVPtr_->detectPlatform()) {
-  //   // populates the struct with Nvidia info
-  //   const PlatformInfo& platformInfo = hipBinNVPtr_->getPlatformInfo();
-  //   platformVec_.push_back(platformInfo);
-  //   hipBinBasePtrs_.push_back(hipBinNVPtr_);
-  //   platformDetected = true;
-  // } 
-  
-  // if no device is detected, then it is defaulted to AMD
-  if (!platformDetected) {
-    cout << "Device not supported - Defaulting to AMD" << endl;
-    // populates the struct with AMD info
-    const PlatformInfo& platformInfo = hipBinAMDPtr_->getPlatformInfo();
-    platformVec_.push_back(platformInfo);
-    hipBinBasePtrs_.push_back(hipBinAMDPtr_);
-  }
-}
-
-HipBin::~HipBin() {
-  delete hipBinNVPtr_;
-  delete hipBinAMDPtr_;
-  // clearing the vector so no one accesses the pointers
-  hipBinBasePtrs_.clear();
-  // clearing the platform vector as the pointers are deleted
-  platformVec_.clear();
-  delete hipBinUtilPtr_;
-}
-
-vector<PlatformInfo>& HipBin::getPlaformInfo() {
-  return platformVec_;  // Return the populated platform info.
-}
-
-
-vector<HipBinBase*>& HipBin::getHipBinPtrs() {
-  return hipBinBasePtrs_;  // Return the populated device pointers.
-}
-
-
-void HipBin::executeHipBin(string filename, int argc, char* argv[]) {
-  if (hipBinUtilPtr_->substringPresent(filename, "hipconfig")) {
-    executeHipConfig(argc, argv);
-  } else if (hipBinUtilPtr_->substringPresent(filename, "hipcc")) {
-    executeHipCC(argc, argv);
-  } else {
-    // A bit strange?
-    cout << "Command " << filename
-    << " not supported. Name the exe as hipconfig"
-    << " or hipcc and then try again ..." << endl;
-    exit(-1);
-  }
-}
-
-
-void HipBin::executeHipCC(int argc, char* argv[]) {
-  vector<HipBinBase*>& platformPtrs = getHipBinPtrs();
-  vector<string> argvcc;
-  for (int i = 0; i < argc; i++) {
-    argvcc.push_back(argv[i]);
-  }
-  // 0th index points to the first platform detected.
-  // In the near future this vector will contain mulitple devices
-  platformPtrs.at(0)->executeHipCCCmd(argvcc);
-}
-
-
-void HipBin::executeHipConfig(int argc, char* argv[]) {
-  vector<HipBinBase*>& platformPtrs = getHipBinPtrs();
-  for (unsigned int j = 0; j < platformPtrs.size(); j++) {
-    if (argc == 1) {
-      platformPtrs.at(j)->printFull();
-    }
-    for (int i = 1; i < argc; ++i) {
-      HipBinCommand cmd;
-      cmd = platformPtrs.at(j)->gethipconfigCmd(argv[i]);
-      switch (cmd) {
-      case help: platformPtrs.at(j)->printUsage();
-        break;
-      case path: cout << platformPtrs.at(j)->getHipPath();
-        break;
-      // ROCm is not related to either Nvidia or SPIR-V so it should be moved to hipBin_amd.h?
-      case roccmpath: cout << platformPtrs.at(j)->getRoccmPath();
-        break;
-      case cpp_config: cout << platformPtrs.at(j)->getCppConfig();
-        break;
-      case compiler: cout << CompilerTypeStr((
-                             platformPtrs.at(j)->getPlatformInfo()).compiler);
-        break;
-      case platform: cout << PlatformTypeStr((
-                             platformPtrs.at(j)->getPlatformInfo()).platform);
-        break;
-      case runtime: cout << RuntimeTypeStr((
-                            platformPtrs.at(j)->getPlatformInfo()).runtime);
-        break;
-      case hipclangpath: cout << platformPtrs.at(j)->getCompilerPath();
-        break;
-      case full: platformPtrs.at(j)->printFull();
-        break;
-      case version: cout << platformPtrs.at(j)->getHipVersion();
-        break;
-      case check: platformPtrs.at(j)->checkHipconfig();
-        break;
-      case newline:
-        cout << endl;
-        break;
-      default:
-        platformPtrs.at(j)->printUsage();
-        break;
-      }
-    }
-  }
-}
-
-//===========================================================================
-//===========================================================================
+#include "libhipcc.h"
 
 int main(int argc, char* argv[]) {
-  fs::path filename(argv[0]);
-  filename = filename.filename();
-
-  HipBin hipBin;
-  hipBin.executeHipBin(filename.string(), argc, argv);
+  return hipcc_main(argc, argv);
 }
@@ -25,10 +25,30 @@ THE SOFTWARE.
 
 #include "hipBin_base.h"
 #include "hipBin_util.h"
+#include "hipBin_manifest.h"
+#include "hipBin_lto.h"
+#include "hipBin_jobserver.h"
+#include "hipBin_timetrace.h"
+#include "hipBin_unity.h"
+#include "hipBin_hostonly.h"
+#include "hipBin_preprocess.h"
+#include "hipBin_vfs.h"
+#include "hipBin_prewarm.h"
+#include "hipBin_batch.h"
+#include "hipBin_bazel.h"
+#include "hipBin_distcc.h"
+#include "hipBin_inprocess.h"
+#include "hipBin_timereport.h"
+#include "hipBin_tiered.h"
+#include "hipBin_kernelreport.h"
+#include "hipBin_budgets.h"
+#include "hipBin_remarks.h"
+#include "hipBin_pgo.h"
 #include <vector>
 #include <string>
 #include <unordered_set>
 #include <cassert>
+#include <chrono>
 
 
 // Use (void) to silent unused warnings.
@@ -46,6 +66,13 @@ class HipBinAmd : public HipBinBase {
   string roccmPathEnv_, hipRocclrPathEnv_, hsaPathEnv_;
   PlatformInfo platformInfoAMD_;
   string hipCFlags_, hipCXXFlags_, hipLdFlags_;
+  VfsOverlay vfsOverlay_;        // --hipcc-vfs-overlay
+  string compilerVersion_;       // cached by getCompilerVersion
+  string compilerFullVersion_;   // cached by getCompilerFullVersion
+  string librarySearchDirs_;     // cached by getLibrarySearchDirs
+  string defaultTargets_;        // cached by getDefaultTargets
+  string toolchainFingerprint_;  // cached by getToolchainFingerprint
+  StatsRecord stats_;            // command of the last runHipCCCmd
   void constructRocclrHomePath();
   void constructHsaPath();
 
@@ -60,6 +87,8 @@ class HipBinAmd : public HipBinBase {
   virtual void printFull();
   virtual void printCompilerInfo() const;
   virtual string getCompilerVersion();
+  string getCompilerFullVersion();
+  vector<string> getLibrarySearchDirs();
   virtual void checkHipconfig();
   virtual string getDeviceLibPath() const;
   virtual string getHipLibPath() const;
@@ -73,9 +102,29 @@ class HipBinAmd : public HipBinBase {
   virtual const string& getHipCFlags() const;
   virtual const string& getHipLdFlags() const;
   virtual void executeHipCCCmd(vector<string> argv);
+  virtual void addConfigSnapshot(ConfigSnapshot& snapshot);
+  virtual vector<std::pair<string, string>> getCMakeVariables();
   // non virtual functions
+  void recordDeviceLinkTimes(const string& output, const string& tracePath,
+                             int partitions, double wallMs, int verbose) const;
   const string& getHsaPath() const;
   const string& getRocclrHomePath() const;
+  vector<string> getHipIncludeDirs(bool cxx);
+  string getIncludeFlags(const vector<string>& dirs) const;
+  string getDefaultTargets();
+  static string getGpuTopology();
+  string getDeviceLibFlags() const;
+  static string getInlineFlags();
+  string getRuntimeLinkFlags() const;
+  string getCompilerRtDir();
+  string getCompilerRtFlags();
+  static string getSystemLibFlags();
+  void prewarmToolchain(const vector<string>& argv, int verbose);
+  int runHipCCCmd(vector<string> argv, BatchJob* batchJob);
+  string getToolchainFingerprint();
+  bool distributeCompile(const string& cmd, const string& hosts,
+                         const string& object, int verbose, int& exitCode);
+  int runCompileWorker(const vector<string>& argv);
 };
 
 HipBinAmd::HipBinAmd() {
@@ -85,6 +134,7 @@ HipBinAmd::HipBinAmd() {
   platformInfo.runtime = rocclr;
   platformInfo.compiler = clang;
   platformInfoAMD_ = platformInfo;
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
   constructRocclrHomePath();    // constructs RocclrHomePath
   constructHsaPath();           // constructs hsa path
   constructCompilerPath();
@@ -111,6 +161,8 @@ void HipBinAmd::constructRocclrHomePath() {
 
 // construct hsa Path
 void HipBinAmd::constructHsaPath() {
+  if (getConfigSnapshot().get("amd.HSA_PATH", hsaPathEnv_))
+    return;
   fs::path hsaPathfs;
   string hsaPath = getEnvVariables().hsaPathEnv_;
   if (hsaPath.empty()) {
@@ -166,19 +218,57 @@ void HipBinAmd::initializeHipLdFlags() {
 
 void HipBinAmd::initializeHipCFlags() {
   string hipCFlags;
-  string hipclangIncludePath;
-  hipclangIncludePath = getHipInclude();
-  hipCFlags += " -isystem \"" + hipclangIncludePath + "\"";
+  hipCFlags += getIncludeFlags(getHipIncludeDirs(false));
+  hipCFlags_ = hipCFlags;
+}
+
+// Returns the include directories hipcc adds to the compile: the clang
+// resource include (C++ only), the HSA and the HIP include. Directories that
+// do not exist or repeat an earlier one are left out, as every one of them
+// is probed for every header.
+vector<string> HipBinAmd::getHipIncludeDirs(bool cxx) {
+  vector<string> candidates;
+  if (cxx) {
+    fs::path hipClangIncludeFs = getCompilerIncludePath();
+    hipClangIncludeFs /= "..";
+    candidates.push_back(hipClangIncludeFs.string());
+  }
   const OsType& os = getOSInfo();
   if (os != windows) {
-    string hsaPath;
-    hsaPath = getHsaPath();
-    hipCFlags += " -isystem " + hsaPath + "/include";
+    candidates.push_back(getHsaPath() + "/include");
   }
-  string hipIncludePath;
-  hipIncludePath = getHipInclude();
-  hipCFlags += " -isystem \"" + hipIncludePath + "\"";
-  hipCFlags_ = hipCFlags;
+  candidates.push_back(getHipInclude());
+  vector<string> dirs, canonicalDirs;
+  for (auto& dir : candidates) {
+    std::error_code ec;
+    fs::path canonicalFs = fs::canonical(dir, ec);
+    if (ec || !fs::is_directory(canonicalFs, ec))
+      continue;
+    if (std::find(canonicalDirs.begin(), canonicalDirs.end(),
+                  canonicalFs.string()) != canonicalDirs.end())
+      continue;
+    canonicalDirs.push_back(canonicalFs.string());
+    dirs.push_back(dir);
+  }
+  return dirs;
+}
+
+// -isystem flags of the directories, through the VFS overlay if it is used
+string HipBinAmd::getIncludeFlags(const vector<string>& dirs) const {
+  string flags;
+  bool overlayUsed = false;
+  for (auto& dir : dirs) {
+    string virtualDir = vfsOverlay_.getVirtualDir(dir);
+    if (virtualDir.empty()) {
+      flags += " -isystem \"" + dir + "\"";
+    } else {
+      flags += " -isystem \"" + virtualDir + "\"";
+      overlayUsed = true;
+    }
+  }
+  if (overlayUsed)
+    flags = " -ivfsoverlay \"" + vfsOverlay_.getPath() + "\"" + flags;
+  return flags;
 }
 
 const string& HipBinAmd::getHipCXXFlags() const {
@@ -202,13 +292,8 @@ string HipBinAmd::getHipInclude() const {
 
 void HipBinAmd::initializeHipCXXFlags() {
   string hipCXXFlags;
-  const OsType& os = getOSInfo();
-  string hipClangIncludePath;
-  hipClangIncludePath = getCompilerIncludePath();
-  hipCXXFlags += " -isystem \"" + hipClangIncludePath;
-  fs::path hipCXXFlagsTempFs = hipCXXFlags;
-  hipCXXFlagsTempFs /= "..\"";
-  hipCXXFlags = hipCXXFlagsTempFs.string();
+  // Add paths to the clang resource, HSA and common HIP includes:
+  hipCXXFlags += getIncludeFlags(getHipIncludeDirs(true));
   const EnvVariables& var = getEnvVariables();
   // Allow __fp16 as function parameter and return type.
   if (var.hipClangHccCompactModeEnv_.compare("1") == 0) {
@@ -216,19 +301,13 @@ void HipBinAmd::initializeHipCXXFlags() {
     " -Xclang -fallow-half-arguments-and-returns -D__HIP_HCC_COMPAT_MODE__=1";
   }
 
-  if (os != windows) {
-    const string& hsaPath = getHsaPath();
-    hipCXXFlags += " -isystem " + hsaPath + "/include";
-  }
-  // Add paths to common HIP includes:
-  string hipIncludePath;
-  hipIncludePath = getHipInclude();
-  hipCXXFlags += " -isystem \"" + hipIncludePath + "\"";
   hipCXXFlags_ = hipCXXFlags;
 }
 
 // populates clang path.
 void HipBinAmd::constructCompilerPath() {
+  if (getConfigSnapshot().get("amd.HIP_CLANG_PATH", hipClangPath_))
+    return;
   string complierPath;
   const EnvVariables& envVariables = getEnvVariables();
   if (envVariables.hipClangPathEnv_.empty()) {
@@ -290,7 +369,11 @@ void HipBinAmd::printCompilerInfo() const {
   }
 }
 
+// the version is cached as it takes a run of the compiler
 string HipBinAmd::getCompilerVersion() {
+  if (!compilerVersion_.empty() ||
+      getConfigSnapshot().get("amd.HIP_CLANG_VERSION", compilerVersion_))
+    return compilerVersion_;
   string out, complierVersion;
   const string& hipClangPath = getCompilerPath();
   fs::path cmdAmd = hipClangPath;
@@ -308,10 +391,47 @@ string HipBinAmd::getCompilerVersion() {
   } else {
     cout << "Hip Clang Compiler not found" << endl;
   }
+  compilerVersion_ = complierVersion;
   return complierVersion;
 }
 
+// the first line of clang --version, which also names the vendor and the
+// revision of the compiler
+string HipBinAmd::getCompilerFullVersion() {
+  if (!compilerFullVersion_.empty() ||
+      getConfigSnapshot().get("amd.HIP_CLANG_FULL_VERSION",
+                              compilerFullVersion_))
+    return compilerFullVersion_;
+  stringstream version(hipBinUtilPtr_->exec(
+      ("\"" + getHipCC() + "\" --version").c_str()).out);
+  getline(version, compilerFullVersion_);
+  return compilerFullVersion_;
+}
+
 
+// the directories the linker searches for -l libraries, as printed by
+// clang -print-search-dirs for the host target
+vector<string> HipBinAmd::getLibrarySearchDirs() {
+  if (librarySearchDirs_.empty() &&
+      !getConfigSnapshot().get("amd.HIP_CLANG_LIBRARY_DIRS",
+                               librarySearchDirs_)) {
+    stringstream lines(hipBinUtilPtr_->exec(
+        ("\"" + getHipCC() + "\" -print-search-dirs").c_str()).out);
+    string line;
+    while (getline(lines, line)) {
+      if (line.compare(0, 12, "libraries: =") == 0)
+        librarySearchDirs_ = hipBinUtilPtr_->trim(line.substr(12));
+    }
+  }
+  vector<string> dirs;
+  stringstream paths(librarySearchDirs_);
+  string dir;
+  while (getline(paths, dir, ':')) {
+    if (!dir.empty())
+      dirs.push_back(dir);
+  }
+  return dirs;
+}
 
 const PlatformInfo& HipBinAmd::getPlatformInfo() const {
   return platformInfoAMD_;
@@ -516,10 +636,450 @@ void HipBinAmd::printFull() {
 }
 
 
+// Writes <output>.device-link-times with the wall time of the device link
+// and the codegen time of each partition found in the lld time trace.
+void HipBinAmd::recordDeviceLinkTimes(const string& output,
+                                      const string& tracePath, int partitions,
+                                      double wallMs, int verbose) const {
+  TimeTrace trace;
+  map<long long, double> codegen;
+  if (trace.load(tracePath))
+    codegen = trace.getDurationByThread({"codegen", "CodeGenPasses"});
+  string timesPath = output + ".device-link-times";
+  ofstream out(timesPath);
+  if (!out.is_open()) {
+    cout << "Warning: unable to write " << timesPath << endl;
+    return;
+  }
+  out << "partitions=" << partitions << "\n";
+  out << "wall_ms=" << static_cast<long long>(wallMs) << "\n";
+  int partition = 0;
+  for (auto& thread : codegen) {
+    out << "partition" << partition << "_ms="
+        << static_cast<long long>(thread.second / 1000) << "\n";
+    if (verbose & 0x1) {
+      cout << "hipcc: device link partition " << partition << ": "
+           << static_cast<long long>(thread.second / 1000) << " ms" << endl;
+    }
+    partition++;
+  }
+  if (verbose & 0x1) {
+    cout << "hipcc: device link with " << partitions << " partitions: "
+         << static_cast<long long>(wallMs) << " ms" << endl;
+  }
+}
+
+// identifies the GPUs of the node by the KFD topology: its generation and
+// the gfx target version of every node. Empty without KFD.
+string HipBinAmd::getGpuTopology() {
+  string topology;
+  const fs::path topologyDir = "/sys/class/kfd/kfd/topology";
+  ifstream generation((topologyDir / "generation_id").string());
+  if (!generation.is_open() || !getline(generation, topology))
+    return "";
+  vector<fs::path> nodes;
+  std::error_code ec;
+  for (fs::directory_iterator it(topologyDir / "nodes", ec), end;
+       !ec && it != end; it.increment(ec))
+    nodes.push_back(it->path());
+  std::sort(nodes.begin(), nodes.end());
+  for (auto& node : nodes) {
+    ifstream properties((node / "properties").string());
+    string line;
+    while (getline(properties, line)) {
+      if (line.compare(0, 19, "gfx_target_version ") == 0)
+        topology += " " + line.substr(19);
+    }
+  }
+  return topology;
+}
+
+// returns the targets used when none is given on the command line:
+// HCC_AMDGPU_TARGET, else the GPUs reported by rocm_agent_enumerator (or
+// recorded in the config snapshot for the same KFD topology)
+string HipBinAmd::getDefaultTargets() {
+  if (!defaultTargets_.empty())
+    return defaultTargets_;
+  const EnvVariables& var = getEnvVariables();
+  string targetsStr, topology;
+  if (!var.hccAmdGpuTargetEnv_.empty()) {
+    targetsStr = var.hccAmdGpuTargetEnv_;
+  } else if (getConfigSnapshot().get("amd.HIP_DEFAULT_TARGETS_TOPOLOGY",
+                                     topology) &&
+             !topology.empty() && topology == getGpuTopology()) {
+    getConfigSnapshot().get("amd.HIP_DEFAULT_TARGETS", targetsStr);
+  } else if (getOSInfo() != windows) {
+    // Else try using rocm_agent_enumerator
+    string ROCM_AGENT_ENUM;
+    ROCM_AGENT_ENUM = getRoccmPath() + "/bin/rocm_agent_enumerator";
+    targetsStr = ROCM_AGENT_ENUM +" -t GPU";
+    SystemCmdOut sysOut = hipBinUtilPtr_->exec(targetsStr.c_str());
+    regex toReplace("\n+");
+    targetsStr = hipBinUtilPtr_->replaceRegex(sysOut.out, toReplace, ",");
+  }
+  defaultTargets_ = targetsStr;
+  return targetsStr;
+}
+
+// --hip-device-lib-path of a HIP compile, unless clang finds the device
+// libraries in their default location
+string HipBinAmd::getDeviceLibFlags() const {
+  string deviceLibPath = getDeviceLibPath();
+  fs::path bitcodeFs = getRoccmPath();
+  bitcodeFs /= "amdgcn/bitcode";
+  if (deviceLibPath == bitcodeFs.string())
+    return "";
+  return " --hip-device-lib-path=\"" + deviceLibPath + "\"";
+}
+
+// the inlining options of an optimized HIP compile
+string HipBinAmd::getInlineFlags() {
+  return " -mllvm -amdgpu-early-inline-all=true"
+         " -mllvm -amdgpu-function-calls=false";
+}
+
+// links the shared HIP runtime, found through the rpath at run time
+string HipBinAmd::getRuntimeLinkFlags() const {
+  return " -Wl,--enable-new-dtags -Wl,-rpath=" + getHipLibPath() + ":" +
+         getRoccmPath() + "/lib -lamdhip64";
+}
+
+// the directory of the clang compiler-rt libraries
+string HipBinAmd::getCompilerRtDir() {
+  return getCompilerPath() + "/../lib/clang/" + getCompilerVersion() +
+         "/lib/linux";
+}
+
+// links compiler-rt, to support __fp16 and _Float16
+string HipBinAmd::getCompilerRtFlags() {
+  return " -L" + getCompilerRtDir() + " -lclang_rt.builtins-x86_64";
+}
+
+// the system libraries of a link on Linux
+string HipBinAmd::getSystemLibFlags() {
+  return " -lgcc_s -lgcc -lpthread -lm -lrt";
+}
+
+// adds what a default hipcc compile of a HIP source and a shared runtime
+// link add: the inlining options of optimized compiles, the device library
+// path, the default targets and the runtime libraries. The -O3 hipcc adds
+// without an -O option is left to the CMake build type.
+vector<std::pair<string, string>> HipBinAmd::getCMakeVariables() {
+  vector<std::pair<string, string>> variables =
+      HipBinBase::getCMakeVariables();
+  vector<string> archs;
+  for (auto& target : hipBinUtilPtr_->splitStr(getDefaultTargets(), ',')) {
+    if (!target.empty() && target != "gfx000")
+      archs.push_back(target);
+  }
+  for (auto& variable : variables) {
+    if (variable.first == "HIPCC_HIP_FLAGS") {
+      variable.second += getDeviceLibFlags();
+    } else if (variable.first == "HIPCC_HIP_OPT_FLAGS") {
+      variable.second = getInlineFlags().substr(1);
+    } else if (variable.first == "HIPCC_LINK_LIBRARIES" &&
+               getOSInfo() != windows) {
+      variable.second = (getRuntimeLinkFlags() + getCompilerRtFlags() +
+                         getSystemLibFlags()).substr(1);
+    } else if (variable.first == "HIPCC_OFFLOAD_ARCHS") {
+      for (auto& arch : archs)
+        variable.second += (variable.second.empty() ? "" : ";") + arch;
+    }
+  }
+  return variables;
+}
+
+// records the paths and the results of the compiler and GPU probes. The
+// GPUs are only recorded if rocm_agent_enumerator found some and KFD is
+// present, together with the KFD topology; they are probed again wherever
+// the topology differs, e.g. on a node other than the one of the snapshot
+// or for a container image built without GPUs.
+void HipBinAmd::addConfigSnapshot(ConfigSnapshot& snapshot) {
+  HipBinBase::addConfigSnapshot(snapshot);
+  snapshot.set("amd.HSA_PATH", getHsaPath());
+  snapshot.set("amd.HIP_CLANG_PATH", getCompilerPath());
+  snapshot.watchEnv(HSA_PATH);
+  snapshot.watchEnv(HIP_CLANG_PATH);
+  string compilerVersion = getCompilerVersion();
+  if (!compilerVersion.empty()) {
+    snapshot.set("amd.HIP_CLANG_VERSION", compilerVersion);
+    snapshot.set("amd.HIP_CLANG_FULL_VERSION", getCompilerFullVersion());
+    if (!getLibrarySearchDirs().empty())
+      snapshot.set("amd.HIP_CLANG_LIBRARY_DIRS", librarySearchDirs_);
+    snapshot.watchFile(getHipCC());
+  }
+  if (getEnvVariables().hccAmdGpuTargetEnv_.empty()) {
+    string targets = getDefaultTargets();
+    string topology = getGpuTopology();
+    if (!targets.empty() && !topology.empty()) {
+      snapshot.set("amd.HIP_DEFAULT_TARGETS", targets);
+      snapshot.set("amd.HIP_DEFAULT_TARGETS_TOPOLOGY", topology);
+    }
+    snapshot.watchFile(getRoccmPath() + "/bin/rocm_agent_enumerator");
+  }
+}
+
+// hipcc --prewarm: reads the files a compile and link for the targets of
+// the command line (or the default targets) would touch into the page cache
+void HipBinAmd::prewarmToolchain(const vector<string>& argv, int verbose) {
+  auto start = std::chrono::steady_clock::now();
+  Prewarm prewarm;
+  // compiler, linker and bundler with the shared libraries they load
+  const string& hipClangPath = getCompilerPath();
+  vector<string> tools = {"clang", "clang++", "lld", "ld.lld",
+                          "clang-offload-bundler", "clang-linker-wrapper"};
+  for (auto& tool : tools)
+    prewarm.addFile(hipClangPath + "/" + tool);
+  fs::path llvmLibFs = hipClangPath;
+  llvmLibFs /= "../lib";
+  std::error_code ec;
+  for (fs::directory_iterator it(llvmLibFs, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    string name = it->path().filename().string();
+    if (hipBinUtilPtr_->stringRegexMatch(name,
+        "lib(LLVM|clang-cpp|lld).*\\.so.*"))
+      prewarm.addFile(it->path().string());
+  }
+  string targetsStr;
+  const vector<string> targetOpts = {"--offload-arch=", "--amdgpu-target="};
+  for (auto& arg : argv) {
+    for (auto& targetOpt : targetOpts) {
+      if (arg.compare(0, targetOpt.size(), targetOpt) == 0)
+        targetsStr += "," + arg.substr(targetOpt.size());
+    }
+  }
+  if (targetsStr.empty())
+    targetsStr = getDefaultTargets();
+  vector<string> targets, isaLibs;
+  for (auto& target : hipBinUtilPtr_->splitStr(targetsStr, ',')) {
+    if (target.empty())
+      continue;
+    string proc = hipBinUtilPtr_->splitStr(target, ':').front();
+    if (proc.compare(0, 3, "gfx") == 0 && proc != "gfx000") {
+      targets.push_back(target);
+      isaLibs.push_back("oclc_isa_version_" + proc.substr(3) + ".bc");
+    }
+  }
+  // the headers a HIP compile reads, from a dependency scan of an empty
+  // source for the host and every target; the include trees if it fails
+  initializeHipCXXFlags();
+  string scanCmd = getHipCC() + " " + getHipCXXFlags() +
+                   getDeviceLibFlags() + " -x hip -M";
+  vector<string> scans = {" --cuda-host-only"};
+  for (auto& target : targets)
+    scans.push_back(" --cuda-device-only --offload-arch=" + target);
+  size_t numHeaders = 0;
+  for (auto& scan : scans) {
+    string cmd = scanCmd + scan + " ";
+#if defined(_WIN32) || defined(_WIN64)
+    cmd += "NUL";
+#else
+    cmd += "/dev/null 2>/dev/null";
+#endif
+    SystemCmdOut sysOut = hipBinUtilPtr_->exec(cmd.c_str());
+    if (sysOut.exitCode == 0)
+      numHeaders += prewarm.addDependencies(sysOut.out);
+  }
+  if (numHeaders == 0) {
+    for (auto& dir : getHipIncludeDirs(true))
+      prewarm.addTree(dir);
+  }
+  // the compiler runtime of the link
+  prewarm.addFile(getCompilerRtDir() + "/libclang_rt.builtins-x86_64.a");
+  // device libraries; of the ISA version libraries only the targets' ones
+  for (fs::directory_iterator it(getDeviceLibPath(), ec), end;
+       !ec && it != end; it.increment(ec)) {
+    string name = it->path().filename().string();
+    if (name.compare(0, 17, "oclc_isa_version_") == 0 &&
+        std::find(isaLibs.begin(), isaLibs.end(), name) == isaLibs.end())
+      continue;
+    if (it->path().extension() == ".bc")
+      prewarm.addFile(it->path().string());
+  }
+  // runtime libraries of the link
+  vector<string> libDirs = {getHipLibPath(), getRoccmPath() + "/lib"};
+  for (auto& libDir : libDirs) {
+    for (fs::directory_iterator it(libDir, ec), end; !ec && it != end;
+         it.increment(ec)) {
+      string name = it->path().filename().string();
+      if (hipBinUtilPtr_->stringRegexMatch(name,
+          "lib(amdhip64|hsa-runtime64)\\.so.*"))
+        prewarm.addFile(it->path().string());
+    }
+  }
+
+  if (verbose & 0x2) {
+    for (auto& file : prewarm.getFiles())
+      cout << "hipcc-prewarm: " << file << endl;
+  }
+  int numThreads = std::max(HIPCC_PREWARM_MIN_THREADS,
+                            JobServer::getNumCores());
+  unsigned long long bytes = prewarm.run(numThreads);
+  double ms = std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - start).count();
+  cout << "hipcc: prewarmed " << prewarm.getNumFiles() << " files, "
+       << std::fixed << std::setprecision(1)
+       << bytes / (1024.0 * 1024.0) << " MiB in "
+       << std::setprecision(0) << ms << " ms" << endl;
+}
+
+// Identifies the toolchain for distributed compilation: the version of the
+// compiler and the contents of the device libraries. The device library
+// hashes are cached by name, size and modification time, the fingerprint
+// is computed once per process.
+string HipBinAmd::getToolchainFingerprint() {
+  if (!toolchainFingerprint_.empty())
+    return toolchainFingerprint_;
+  string fingerprint = getCompilerFullVersion();
+  vector<fs::path> bitcodes;
+  std::error_code ec;
+  for (fs::directory_iterator it(getDeviceLibPath(), ec), end;
+       !ec && it != end; it.increment(ec)) {
+    if (it->path().extension() == ".bc")
+      bitcodes.push_back(it->path());
+  }
+  std::sort(bitcodes.begin(), bitcodes.end());
+  string key = fingerprint;
+  for (auto& bitcode : bitcodes) {
+    key += "\n" + bitcode.string() + " " +
+           std::to_string(fs::file_size(bitcode, ec)) + " " +
+           std::to_string(fs::last_write_time(bitcode, ec)
+                          .time_since_epoch().count());
+  }
+  fs::path cacheFile = getCacheDir("distcc");
+  cacheFile /= "fingerprint-" + hipBinUtilPtr_->hashString(key);
+  ifstream in(cacheFile.string());
+  string cached;
+  if (in.is_open() && getline(in, cached) && cached.size() == 16) {
+    toolchainFingerprint_ = cached;
+    return cached;
+  }
+  for (auto& bitcode : bitcodes) {
+    fingerprint += "\n" + bitcode.filename().string() + " " +
+                   hipBinUtilPtr_->hashFile(bitcode.string());
+  }
+  fingerprint = hipBinUtilPtr_->hashString(fingerprint);
+  ofstream out(cacheFile.string());
+  out << fingerprint << "\n";
+  toolchainFingerprint_ = fingerprint;
+  return fingerprint;
+}
+
+// Compiles the single HIP source of cmd on a hipcc-worker: the source is
+// preprocessed into a bundled .hipi here, then sent. Returns false if the
+// compile has to be done locally.
+bool HipBinAmd::distributeCompile(const string& cmd, const string& hosts,
+                                  const string& object, int verbose,
+                                  int& exitCode) {
+  if (getOSInfo() == windows)
+    return false;
+  vector<string> remoteArgs;
+  if (!DistributedCompile::getRemoteArgs(cmd, remoteArgs))
+    return false;
+  fs::path dirTemplate = hipBinUtilPtr_->getTempDir();
+  dirTemplate /= "hipcc-dist-XXXXXX";
+  string dir = hipBinUtilPtr_->mktempDir(dirTemplate.string());
+  if (dir.empty())
+    return false;
+  fs::path input = dir;
+  input /= HIPCC_DISTCC_INPUT;
+  // the dependency file is written by the local preprocessing
+  string preprocessCmd = PreprocessOnce::stripOutput(cmd) +
+                         PreprocessOnce::getDepFlags(cmd, object) +
+                         " -E -o \"" + input.string() + "\"";
+  if (verbose & 0x1)
+    cout << "hipcc-preprocess-cmd: " << preprocessCmd << "\n";
+  bool done = false;
+  if (hipBinUtilPtr_->exec((preprocessCmd + " 2>/dev/null").c_str())
+      .exitCode == 0) {
+    ifstream in(input.string(), std::ios::binary);
+    stringstream buffer;
+    buffer << in.rdbuf();
+    DistributedCompile distributed(hosts, getToolchainFingerprint(),
+                                   verbose);
+    done = distributed.compile(remoteArgs, buffer.str(), object, exitCode);
+  }
+  std::error_code ec;
+  fs::remove_all(dir, ec);
+  return done;
+}
+
+// hipcc-worker: serves the compile jobs of distributed hipcc invocations
+int HipBinAmd::runCompileWorker(const vector<string>& argv) {
+  const EnvVariables& var = getEnvVariables();
+  int verbose = var.verboseEnv_.empty() ? 0 : stoi(var.verboseEnv_);
+  CompileWorker worker(getHipCC(), getDeviceLibPath(),
+                       getToolchainFingerprint(), verbose);
+  if (!worker.parseArgs(argv))
+    return EXIT_FAILURE;
+  return worker.run();
+}
+
 void HipBinAmd::executeHipCCCmd(vector<string> argv) {
+  bool batch = std::find(argv.begin(), argv.end(), "--batch") != argv.end();
+  bool persistentWorker = std::find(argv.begin(), argv.end(),
+                                    "--persistent_worker") != argv.end();
+  const EnvVariables& var = getEnvVariables();
+  for (auto& arg : argv) {
+    if (arg.compare(0, 14, "--stats-report") == 0)
+      exit(StatsDb(var.hipccStatsDbEnv_).report(argv));
+    if (arg == "--time-report-summary")
+      exit(TimeReport::summarize(argv));
+    if (arg == "--remarks-summary")
+      exit(OptRemarks::summarize(argv));
+  }
+  if (argv.size() < 2 || (!batch && !persistentWorker)) {
+    auto start = std::chrono::steady_clock::now();
+    int exitCode = runHipCCCmd(argv, nullptr);
+    if (!var.hipccStatsDbEnv_.empty() && !stats_.mode.empty()) {
+      stats_.wallMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start).count();
+      stats_.exitCode = exitCode;
+      StatsDb::addProcessUsage(stats_);
+      if (!StatsDb(var.hipccStatsDbEnv_).append(stats_))
+        cout << "Warning: unable to write " << var.hipccStatsDbEnv_ << endl;
+    }
+    exit(exitCode);
+  }
+
+  // hipcc --batch and the Bazel worker plan their jobs in this process and
+  // run the commands in parallel
+  int verbose = var.verboseEnv_.empty() ? 0 : stoi(var.verboseEnv_);
+  string hipcc = argv.at(0);
+  std::error_code ec;
+  if (hipcc.find_first_of("/\\") != string::npos)
+    hipcc = fs::absolute(hipcc, ec).string();
+  BatchPlanner planner = [this](const vector<string>& jobArgv,
+                                BatchJob& job) {
+    int exitCode = runHipCCCmd(jobArgv, &job);
+    job.stats = stats_;
+    return exitCode;
+  };
+  if (persistentWorker) {
+    BazelWorker worker(hipcc, verbose);
+    worker.parseArgs(argv);
+    worker.setStatsDb(var.hipccStatsDbEnv_);
+    exit(worker.run(planner));
+  }
+  BatchCompile batchCompile(hipcc, verbose);
+  batchCompile.setStatsDb(var.hipccStatsDbEnv_);
+  batchCompile.setMemoryHistory(
+      (fs::path(getCacheDir("batch")) / "memory-history").string());
+  if (!batchCompile.parseArgs(argv) || !batchCompile.load())
+    exit(EXIT_FAILURE);
+  exit(batchCompile.run(planner));
+}
+
+// Builds and runs the compiler command of a hipcc invocation and returns its
+// exit code. With batchJob the command is only planned: it is stored in the
+// job, or the job is marked to run as a separate hipcc.
+int HipBinAmd::runHipCCCmd(vector<string> argv, BatchJob* batchJob) {
+  stats_ = StatsRecord();
+  // in --batch and the persistent worker every job decides on its own
+  vfsOverlay_ = VfsOverlay();
   if (argv.size() < 2) {
     cout<< "No Arguments passed, exiting ...\n";
-    exit(EXIT_SUCCESS);
+    return EXIT_SUCCESS;
   }
   const EnvVariables& var = getEnvVariables();
   int verbose = 0;
@@ -527,6 +1087,10 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
     verbose = stoi(var.verboseEnv_);
 
   // Verbose: 0x1=commands, 0x2=paths, 0x4=hipcc args
+  if (std::find(argv.begin(), argv.end(), "--prewarm") != argv.end()) {
+    prewarmToolchain(argv, verbose);
+    return EXIT_SUCCESS;
+  }
   // set if user explicitly requests -stdlib=libc++
   // (else we default to libstdc++ for better interop with g++)
   bool setStdLib = 0;
@@ -552,12 +1116,31 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
   string hsacoVersion;
   bool funcSupp = 0;      // enable function support
   bool rdc = 0;           // whether -fgpu-rdc is on
+  bool linkManifest = 0;  // skip the link if the link manifest is unchanged
+  bool linkManifestTouch = 0;  // touch the output when the link is skipped
+  string outputFile;      // argument of -o
+  ThinLtoCache thinLto;   // --hipcc-thinlto and its cache settings
+  HostPgo pgo;            // --hipcc-pgo-gen/--hipcc-pgo-use
+  // parallel device link partitions: -1 off, 0 sized to the available slots
+  int deviceLinkJobs = -1;
+  bool preprocessOnce = 0;  // share one preprocessed input between targets
+  vector<string> hipSourceArgs;  // escaped HIP sources as passed to clang
+  string distributeHosts = var.hipccDistributeEnv_;  // distributed compile
+  bool inProcess = 1;  // run clang in-process if hipcc was built for it
+  bool timeReport = 0;  // --time-report: merge the -ftime-trace files
+  TieredCompile tiered;  // --tiered: fast object now, optimized one later
+  bool kernelReport = 0;  // --kernel-report: resource usage of the kernels
+  string kernelBudgetsPath;  // --hipcc-kernel-budgets[-warn]=<file>
+  bool kernelBudgetsWarn = 0;
+  vector<string> deviceArchs;
 
   string prevArg;  //  previous argument
   // TODO(hipcc): convert toolArgs to an array rather than a string
   string toolArgs;   // arguments to pass to the clang or nvcc tool
   string optArg;     // -O args
   vector<string> options, inputs;
+  // files the argument processing writes for the compiler command
+  vector<string> temporaries;
 
   // TODO(hipcc): hipcc uses --amdgpu-target for historical reasons.
   // It should be replaced
@@ -575,39 +1158,87 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
     hip_compile_cxx_as_hip = var.hipCompileCxxAsHipEnv_;
   }
 
+  // --unity[=N]: the HIP sources are replaced by generated unity sources
+  // before the arguments are processed
+  const vector<string> originalArgv = argv;
+  UnityBuild unityBuild;
+  bool unityRequested = false;
+  for (auto& arg : argv) {
+    unityRequested = unityBuild.parseOption(arg) || unityRequested;
+    tiered.parseOption(arg);
+  }
+  // --remarks-dir <dir>: the optimization records are collected into dir
+  string remarksDir = OptRemarks::parseDirOption(&argv);
+  // modes keeping state around the compile run as a separate hipcc in batch
+  bool batchSpawn = unityRequested || !remarksDir.empty();
+  for (auto& arg : argv) {
+    batchSpawn = batchSpawn || arg == "--hipcc-preprocess-once" ||
+                 arg.compare(0, 21, "--hipcc-link-manifest") == 0 ||
+                 arg.compare(0, 24, "--hipcc-device-link-jobs") == 0 ||
+                 arg == "--time-report" || arg == "--tiered" ||
+                 arg == "--kernel-report" ||
+                 arg.compare(0, 22, "--hipcc-kernel-budgets") == 0;
+  }
+  if (batchJob && batchSpawn) {
+    batchJob->spawn = true;
+    return EXIT_SUCCESS;
+  }
+  if (unityRequested && unityBuild.isEnabled() &&
+      !unityBuild.checkArgs(argv)) {
+    return EXIT_FAILURE;
+  }
+  if (unityRequested) {
+    argv = unityBuild.rewriteArgs(argv, hip_compile_cxx_as_hip != "0",
+                                  verbose);
+  }
+  if (tiered.isReplace()) {
+    argv = tiered.rewriteArgs(argv);
+  }
+
+  // --hipcc-detect-host-only: C++ sources without device code are compiled
+  // as plain C++ instead of HIP
+  HostOnlyDetector hostOnly;
+  bool detectHostOnly = std::find(argv.begin(), argv.end(),
+                                  "--hipcc-detect-host-only") != argv.end();
+  if (detectHostOnly) {
+    hostOnly.setCacheDir(getCacheDir("host-only"));
+    hostOnly.addArgs(argv);
+  }
+
+  // --hipcc-vfs-overlay: the hipcc include directories are read through a
+  // cached clang VFS overlay, which --hipcc-vfs-overlay-rebuild rewrites
+  bool vfsRebuild = std::find(argv.begin(), argv.end(),
+                              "--hipcc-vfs-overlay-rebuild") != argv.end();
+  if (vfsRebuild || std::find(argv.begin(), argv.end(),
+                              "--hipcc-vfs-overlay") != argv.end()) {
+    if (!vfsOverlay_.create(getHipIncludeDirs(true), getCacheDir("vfs"),
+                            getToolchainKey(), vfsRebuild)) {
+      cout << "Warning: unable to create the VFS overlay, "
+           << "--hipcc-vfs-overlay is ignored." << endl;
+    }
+  }
+
   string HIPLDARCHFLAGS;
 
-  initializeHipCXXFlags();
-  initializeHipCFlags();
-  initializeHipLdFlags();
+  // The hipcc flags are only computed once the arguments have shown which
+  // of them are needed; until then the argument loop collects additions.
   string HIPCXXFLAGS, HIPCFLAGS, HIPLDFLAGS;
-  HIPCFLAGS = getHipCFlags();
-  HIPCXXFLAGS = getHipCXXFlags();
-  HIPLDFLAGS = getHipLdFlags();
-  string hipLibPath;
-  string hipclangIncludePath , hipIncludePath, deviceLibPath;
-  hipLibPath = getHipLibPath();
   const string& roccmPath = getRoccmPath();
-  const string& hipPath = getHipPath();
-  const PlatformInfo& platformInfo = getPlatformInfo();
-  const string& rocclrHomePath = getRocclrHomePath();
   const string& hipClangPath = getCompilerPath();
-  hipclangIncludePath = getCompilerIncludePath();
-  hipIncludePath = getHipInclude();
-  deviceLibPath = getDeviceLibPath();
   const string& hipVersion = getHipVersion();
   if (verbose & 0x2) {
-    cout << "HIP_PATH=" << hipPath << endl;
+    const PlatformInfo& platformInfo = getPlatformInfo();
+    cout << "HIP_PATH=" << getHipPath() << endl;
     cout << "HIP_PLATFORM=" <<  PlatformTypeStr(platformInfo.platform) <<endl;
     cout << "HIP_COMPILER=" << CompilerTypeStr(platformInfo.compiler) <<endl;
     cout << "HIP_RUNTIME=" << RuntimeTypeStr(platformInfo.runtime) <<endl;
     cout << "ROCM_PATH=" << roccmPath << endl;
-    cout << "HIP_ROCCLR_HOME="<< rocclrHomePath << endl;
+    cout << "HIP_ROCCLR_HOME="<< getRocclrHomePath() << endl;
     cout << "HIP_CLANG_PATH=" << hipClangPath <<endl;
-    cout << "HIP_CLANG_INCLUDE_PATH="<< hipclangIncludePath <<endl;
-    cout << "HIP_INCLUDE_PATH="<< hipIncludePath  <<endl;
-    cout << "HIP_LIB_PATH="<< hipLibPath <<endl;
-    cout << "DEVICE_LIB_PATH="<< deviceLibPath <<endl;
+    cout << "HIP_CLANG_INCLUDE_PATH="<< getCompilerIncludePath() <<endl;
+    cout << "HIP_INCLUDE_PATH="<< getHipInclude()  <<endl;
+    cout << "HIP_LIB_PATH="<< getHipLibPath() <<endl;
+    cout << "DEVICE_LIB_PATH="<< getDeviceLibPath() <<endl;
   }
 
   if (verbose & 0x4) {
@@ -631,12 +1262,14 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
     string trimarg = hipBinUtilPtr_->replaceRegex(arg, toRemove, "");
     bool swallowArg = false;
     bool escapeArg = true;
+    bool isHipSource = false;
     if (arg == "-c" || arg == "--genco" || arg == "-E") {
       compileOnly = true;
       needLDFLAGS  = false;
     }
 
     if (skipOutputFile) {
+      outputFile = arg;
       // TODO(hipcc): handle filename with shell metacharacters
       toolArgs += " \"" + arg +"\"";
       prevArg = arg;
@@ -689,6 +1322,17 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
       printLDFlags = 1;
       runCmd = 0;
     }
+    if (trimarg == "--time-report") {
+      timeReport = 1;
+      swallowArg = 1;
+    }
+    if (trimarg == "--tiered") {
+      swallowArg = 1;
+    }
+    if (trimarg == "--kernel-report") {
+      kernelReport = 1;
+      swallowArg = 1;
+    }
     if (trimarg == "-M") {
       compileOnly = 1;
       buildDeps = 1;
@@ -725,12 +1369,12 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
     if ((hipBinUtilPtr_->stringRegexMatch(arg, "^-Wl,@.*")) ||
        (hipBinUtilPtr_->stringRegexMatch(arg, "^@.*"))) {
       // arg will have options type(-Wl,@ or @) and filename
-      vector<string> split_arg = hipBinUtilPtr_->splitStr(targetsStr, '@');
+      vector<string> split_arg = hipBinUtilPtr_->splitStr(arg, '@');
       string file = split_arg.at(1);
       ifstream in(file);
       if (!in.is_open()) {
         cout << "unable to open file for reading: " << file << endl;
-        exit(-1);
+        return -1;
       }
       string new_arg;
       string tmpdir = hipBinUtilPtr_->getTempDir();
@@ -740,8 +1384,9 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
       if (!out.is_open()) {
         cout << "unable to open file for writing: " <<
                  new_file.string() << endl;
-        exit(-1);
+        return -1;
       }
+      temporaries.push_back(new_file.string());
       string line;
       while (getline(in, line)) {
         line = hipBinUtilPtr_->trim(line);
@@ -767,6 +1412,8 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
             obj = hipBinUtilPtr_->trim(obj);
             regex toReplace("x - ");
             obj = hipBinUtilPtr_->replaceRegex(obj, toReplace, "");
+            if (!obj.empty())
+              temporaries.push_back(tmpdir + "/" + obj);
             obj = "\"" + tmpdir + "/" + obj;
             cmd = "file " + obj;
             SystemCmdOut sysOut;
@@ -793,7 +1440,10 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
             string libDir = libFilefs.parent_path().string();
             string libExt = libFilefs.extension().string();
             string  libBaseNameTemp = libBaseName + "XXXXXX";
-            libBaseName = hipBinUtilPtr_->mktempFile(libBaseNameTemp) + libExt;
+            libBaseName = hipBinUtilPtr_->mktempFile(libBaseNameTemp);
+            temporaries.push_back(libBaseName);
+            libBaseName += libExt;
+            temporaries.push_back(tmpdir + "/" + libBaseName);
             cmd = "cd " + tmpdir + "; ar rc " + libBaseName + " " +realObjs;
             SystemCmdOut sysOut;
             sysOut = hipBinUtilPtr_->exec(cmd.c_str());
@@ -821,7 +1471,8 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
       }  // end of while loop
         in.close();
         out.close();
-        arg = "\"" + new_arg +" " +split_arg.at(0) + "\\" + new_file.string();
+        arg = hipBinUtilPtr_->trim(new_arg + " " + split_arg.at(0) + "@\"" +
+                                   new_file.string() + "\"");
         escapeArg = 0;
       } else if ((hipBinUtilPtr_->stringRegexMatch(arg, ".*\\.a$")) ||
                  (hipBinUtilPtr_->stringRegexMatch(arg, ".*\\.lo$"))) {
@@ -842,6 +1493,8 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
           regex toReplace("x - ");
           string replaceWith = "";
           obj = hipBinUtilPtr_->replaceRegex(obj, toReplace , replaceWith);
+          if (!obj.empty())
+            temporaries.push_back(tmpdir + "/" + obj);
           obj = "\"" + tmpdir + "/" + obj + "\"";
           string cmd = "file " + obj;
           SystemCmdOut sysOut;
@@ -879,8 +1532,10 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
           string libDir = libFilefs.parent_path().string();
           string libExt = libFilefs.extension().string();
           string  libBaseNameTemp = libBaseName + "XXXXXX";
-          libBaseName = hipBinUtilPtr_->mktempFile(
-                        libBaseNameTemp) + libExt;
+          libBaseName = hipBinUtilPtr_->mktempFile(libBaseNameTemp);
+          temporaries.push_back(libBaseName);
+          libBaseName += libExt;
+          temporaries.push_back(tmpdir + "/" + libBaseName);
           string cmd = "cd " + tmpdir +"; ar rc " +
                        libBaseName + " " + realObjs;
           SystemCmdOut sysOut;
@@ -926,10 +1581,44 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
           // if $arg eq "--hipcc_profile") {  # Example argument here, hipcc
           //
           // }
+          // the ThinLTO cache and host PGO settings parse their own options
+          if (thinLto.parseOption(arg) || pgo.parseOption(arg)) {
+            prevArg = arg;
+            continue;
+          }
           if (arg == "--hipcc-func-supp") {
             funcSupp = 1;
           } else if (arg == "--hipcc-no-func-supp") {
             funcSupp = 0;
+          } else if (arg == "--hipcc-link-manifest") {
+            linkManifest = 1;
+          } else if (arg == "--hipcc-link-manifest-touch") {
+            linkManifest = 1;
+            linkManifestTouch = 1;
+          } else if (arg == "--hipcc-device-link-jobs") {
+            deviceLinkJobs = 0;
+          } else if (hipBinUtilPtr_->stringRegexMatch(
+                     arg, "--hipcc-device-link-jobs=[0-9]+")) {
+            // strtol saturates, so an overlong count is out of range too
+            long jobs = strtol(arg.c_str() + 25, nullptr, 10);
+            if (jobs > 4096) {
+              cout << "hipcc: --hipcc-device-link-jobs must be at most 4096"
+                   << endl;
+              return EXIT_FAILURE;
+            }
+            deviceLinkJobs = static_cast<int>(jobs);
+          } else if (arg == "--hipcc-preprocess-once") {
+            preprocessOnce = 1;
+          } else if (arg.compare(0, 19, "--hipcc-distribute=") == 0) {
+            distributeHosts = arg.substr(19);
+          } else if (arg == "--hipcc-no-inprocess") {
+            inProcess = 0;
+          } else if (arg.compare(0, 23, "--hipcc-kernel-budgets=") == 0) {
+            kernelBudgetsPath = arg.substr(23);
+            kernelBudgetsWarn = 0;
+          } else if (arg.compare(0, 28, "--hipcc-kernel-budgets-warn=") == 0) {
+            kernelBudgetsPath = arg.substr(28);
+            kernelBudgetsWarn = 1;
           }
         } else {
           options.push_back(arg);
@@ -955,8 +1644,15 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
         needCXXFLAGS = 1;
         if (hip_compile_cxx_as_hip == "0" || hasOMPTargets == 1) {
           hasCXX = 1;
+        } else if (detectHostOnly && hostOnly.isHostOnly(arg)) {
+          if (verbose & 0x1) {
+            cout << "hipcc: " << arg << " has no device code" << endl;
+          }
+          hasCXX = 1;
+          toolArgs += " -x c++";
         } else {
           hasHIP = 1;
+          isHipSource = true;
           toolArgs += " -x hip";
         }
       } else if (((hipBinUtilPtr_->stringRegexMatch(arg, ".*\\.cu$") ||
@@ -965,6 +1661,7 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
                   (hipBinUtilPtr_->stringRegexMatch(arg, ".*\\.hip$"))) {
         needCXXFLAGS = 1;
         hasHIP = 1;
+        isHipSource = true;
         toolArgs += " -x hip";
       }
     }
@@ -988,21 +1685,38 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
     }
     if (!swallowArg)
       toolArgs += " " + arg;
+    if (isHipSource)
+      hipSourceArgs.push_back(arg);
     prevArg = arg;
   }  // end of for loop
-  // No AMDGPU target specified at commandline. So look for HCC_AMDGPU_TARGET
-  if (default_amdgpu_target == 1) {
-    if (!var.hccAmdGpuTargetEnv_.empty()) {
-      targetsStr = var.hccAmdGpuTargetEnv_;
-    } else if (os != windows) {
-      // Else try using rocm_agent_enumerator
-      string ROCM_AGENT_ENUM;
-      ROCM_AGENT_ENUM = roccmPath + "/bin/rocm_agent_enumerator";
-      targetsStr = ROCM_AGENT_ENUM +" -t GPU";
-      SystemCmdOut sysOut = hipBinUtilPtr_->exec(targetsStr.c_str());
-      regex toReplace("\n+");
-      targetsStr = hipBinUtilPtr_->replaceRegex(sysOut.out, toReplace, ",");
+
+  // Queries such as --short-version need no flags at all
+  if (!runCmd && !printCXXFlags && !printLDFlags) {
+    if (printHipVersion) {
+      cout << hipVersion << endl;
     }
+    return EXIT_SUCCESS;
+  }
+  // link state is only computed when linking or printing the link flags
+  bool needLinkFlags = (needLDFLAGS && !compileOnly) || printLDFlags;
+  if (needCFLAGS) {
+    initializeHipCFlags();
+    HIPCFLAGS = getHipCFlags() + HIPCFLAGS;
+  }
+  if (needCXXFLAGS || printCXXFlags) {
+    initializeHipCXXFlags();
+    HIPCXXFLAGS = getHipCXXFlags() + HIPCXXFLAGS;
+  }
+  if (needLinkFlags) {
+    initializeHipLdFlags();
+    HIPLDFLAGS = getHipLdFlags() + HIPLDFLAGS;
+  }
+
+  // No AMDGPU target specified at commandline. So look for HCC_AMDGPU_TARGET.
+  // The targets are only needed for HIP sources and the -fgpu-rdc link.
+  if (default_amdgpu_target == 1) {
+    if (hasHIP || (rdc && !compileOnly))
+      targetsStr = getDefaultTargets();
     default_amdgpu_target = 0;
   }
   // Parse the targets collected in targetStr
@@ -1030,6 +1744,7 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
       GPU_ARCH_ARG = GPU_ARCH_OPT + val;
 
       HIPLDARCHFLAGS += GPU_ARCH_ARG;
+      deviceArchs.push_back(val);
       if (hasHIP) {
         HIPCXXFLAGS += GPU_ARCH_ARG;
       }
@@ -1061,6 +1776,45 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
     HIPLDFLAGS += HIPLDARCHFLAGS;
   }
 
+  // ThinLTO: device code is only linked by lld at -fgpu-rdc/--hip-link time
+  if (thinLto.isEnabled()) {
+    if (thinLto.deviceEnabled() && !rdc && hasHIP) {
+      cout << "Warning: device ThinLTO requires -fgpu-rdc and is ignored."
+           << endl;
+    }
+    HIPCXXFLAGS += thinLto.getCompileFlags(rdc && hasHIP);
+    HIPCFLAGS += thinLto.getCompileFlags(false);
+    if (!compileOnly) {
+      fs::path ltoCacheDir = thinLto.getCacheDir().empty() ?
+                             getCacheDir("lto") : thinLto.getCacheDir();
+      ltoCacheDir /= getToolchainKey();
+      std::error_code ec;
+      fs::create_directories(ltoCacheDir, ec);
+      HIPLDFLAGS += thinLto.getLinkFlags(ltoCacheDir.string(), rdc);
+    }
+  }
+
+  // host PGO: device code is not profiled, the compile flag only goes to
+  // the host compilation of HIP sources
+  if (pgo.isEnabled()) {
+    if (!pgo.setDir(var.hipccPgoDirEnv_)) {
+      cout << "hipcc: --hipcc-pgo-gen and --hipcc-pgo-use need a profile"
+           << " directory (--hipcc-pgo-gen=<dir> or HIPCC_PGO_DIR)" << endl;
+      return EXIT_FAILURE;
+    }
+    if (needCXXFLAGS || needCFLAGS || printCXXFlags) {
+      string pgoFlag = pgo.getCompileFlag(inputs, hipClangPath, verbose);
+      if (!pgoFlag.empty()) {
+        HIPCXXFLAGS += (hasHIP ? " -Xarch_host " : " ") + pgoFlag;
+        HIPCFLAGS += " " + pgoFlag;
+      }
+    }
+    if (!compileOnly) {
+      HIPLDFLAGS += pgo.getLinkFlags(thinLto.hostEnabled(), hipClangPath,
+                                     verbose);
+    }
+  }
+
   // hipcc currrently requires separate compilation of source files,
   // ie it is not possible to pass
   // CPP files combined with .O files
@@ -1068,51 +1822,44 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
   // whether to compile in CUDA mode or
   // pass-through CPP mode.
   // Set default optimization level to -O3 for hip-clang.
+  // the optimization flags of the C++ compile are replaced by -O1 in the
+  // fast compile of --tiered
+  string optCXXFlags;
   if (optArg.empty()) {
-    HIPCXXFLAGS += " -O3";
+    optCXXFlags += " -O3";
     HIPCFLAGS += " -O3";
     HIPLDFLAGS += " -O3";
   }
 
   if (!funcSupp && optArg != "-O0" && hasHIP) {
-    HIPCXXFLAGS +=
-    " -mllvm -amdgpu-early-inline-all=true -mllvm -amdgpu-function-calls=false";
+    optCXXFlags += getInlineFlags();
     if (needLDFLAGS && !needCXXFLAGS) {
-      HIPLDFLAGS +=
-      " -mllvm -amdgpu-early-inline-all=true"
-      " -mllvm -amdgpu-function-calls=false";
+      HIPLDFLAGS += getInlineFlags();
     }
   }
+  HIPCXXFLAGS += optCXXFlags;
 
   if (hasHIP) {
-    fs::path bitcodeFs = roccmPath;
-    bitcodeFs /= "amdgcn/bitcode";
-    if (deviceLibPath != bitcodeFs.string()) {
-      string hip_device_lib_str = " --hip-device-lib-path=\""
-                                  + deviceLibPath + "\"";
-      HIPCXXFLAGS += hip_device_lib_str;
-    }
+    HIPCXXFLAGS += getDeviceLibFlags();
   }
   if (os != windows) {
-    HIPLDFLAGS += " -lgcc_s -lgcc -lpthread -lm -lrt";
+    HIPLDFLAGS += getSystemLibFlags();
   }
 
-  if (os != windows && !compileOnly) {
-    string hipClangVersion, toolArgTemp;
+  if (os != windows && !compileOnly && runCmd) {
+    string hipLibPath = getHipLibPath();
+    string toolArgTemp;
     if (linkType == 0) {
       toolArgTemp = " -L"+ hipLibPath + "-lamdhip64 -L" +
                       roccmPath+ "/lib -lhsa-runtime64 -ldl -lnuma " + toolArgs;
       toolArgs = toolArgTemp;
     } else {
-      toolArgTemp =  toolArgs + " -Wl,--enable-new-dtags -Wl,-rpath=" + hipLibPath + ":"
-                    + roccmPath+"/lib -lamdhip64 ";
+      toolArgTemp =  toolArgs + getRuntimeLinkFlags() + " ";
       toolArgs =  toolArgTemp;
     }
 
-    hipClangVersion = getCompilerVersion();
     // To support __fp16 and _Float16, explicitly link with compiler-rt
-    toolArgs += " -L" + hipClangPath + "/../lib/clang/" +
-                hipClangVersion + "/lib/linux -lclang_rt.builtins-x86_64 ";
+    toolArgs += getCompilerRtFlags() + " ";
   }
   if (!var.hipccCompileFlagsAppendEnv_.empty()) {
     HIPCXXFLAGS += " " + var.hipccCompileFlagsAppendEnv_ + " ";
@@ -1154,16 +1901,310 @@ void HipBinAmd::executeHipCCCmd(vector<string> argv) {
   if (printLDFlags) {
     cout << HIPLDFLAGS;
   }
+  // without -o clang writes a.out, or an object per input with -c
+  bool preprocessOnly = false;
+  for (auto& option : options) {
+    preprocessOnly = preprocessOnly || option == "-E" || option == "-M" ||
+                     option == "-MM";
+  }
+  vector<string> outputs;
+  if (!outputFile.empty()) {
+    outputs.push_back(outputFile);
+  } else if (!compileOnly && !inputs.empty()) {
+    outputs.push_back("a.out");
+  } else if (!preprocessOnly) {
+    for (auto& input : inputs)
+      outputs.push_back(fs::path(input).stem().string() + ".o");
+  }
+  if (runCmd) {
+    // the command as recorded in HIPCC_STATS_DB
+    if (preprocessOnly) {
+      stats_.mode = "preprocess";
+    } else if (compileOnly) {
+      stats_.mode = "compile";
+    } else {
+      stats_.mode = (hasC || hasCXX || hasHIP) ? "compile+link" : "link";
+    }
+    std::error_code ec;
+    for (auto& input : inputs)
+      stats_.inputs.push_back(fs::absolute(input, ec).string());
+    for (auto& output : outputs)
+      stats_.outputs.push_back(fs::absolute(output, ec).string());
+    if (hasHIP || (rdc && !compileOnly))
+      stats_.archs = deviceArchs;
+  }
+  // a single HIP source compiled with -c to an object can be compiled
+  // from its preprocessed form
+  bool singleHipCompile = compileOnly && hasHIP && !fileTypeFlag &&
+                          !buildDeps && inputs.size() == 1 &&
+                          hipSourceArgs.size() == 1;
+  for (auto& option : options) {
+    if (option == "-E" || option == "-S" || option == "-M" ||
+        option == "-MM" || option == "--genco" || option == "-target" ||
+        option.compare(0, 9, "--target=") == 0 ||
+        option.compare(0, 11, "-save-temps") == 0 ||
+        option.compare(0, 6, "--cuda") == 0 ||
+        option == "--offload-device-only" ||
+        option == "--offload-host-only")
+      singleHipCompile = false;
+  }
+  KernelBudgets kernelBudgets;
+  if (!kernelBudgetsPath.empty() && !kernelBudgets.load(kernelBudgetsPath)) {
+    cout << "hipcc: " << kernelBudgets.getError() << endl;
+    return EXIT_FAILURE;
+  }
+  // distributed compile: a single HIP compile without the modes that need
+  // the local side files or inspect the object
+  bool distributable = !distributeHosts.empty() && singleHipCompile &&
+                       !timeReport && remarksDir.empty() && !pgo.isEnabled() &&
+                       !kernelReport && !kernelBudgets.isLoaded();
+  // a batch job that is distributed runs as a separate hipcc
+  if (runCmd && batchJob && distributable) {
+    batchJob->spawn = true;
+    batchJob->temporaries = temporaries;
+    return EXIT_SUCCESS;
+  }
+  if (runCmd && batchJob) {
+    batchJob->cmd = CMD;
+    batchJob->inputs = inputs;
+    batchJob->outputs = outputs;
+    batchJob->temporaries = temporaries;
+    return EXIT_SUCCESS;
+  }
   if (runCmd) {
-    SystemCmdOut sysOut;
-    sysOut = hipBinUtilPtr_->exec(CMD.c_str(), true);
-    string cmdOut = sysOut.out;
-    int CMD_EXIT_CODE = sysOut.exitCode;
+    // --tiered: a -c compile of one object with the default optimization
+    bool tieredCompile = tiered.isRequested() && compileOnly && !buildDeps &&
+                         !preprocessOnly && optArg.empty() && needCXXFLAGS &&
+                         !needCFLAGS && outputs.size() == 1;
+    // the optimized object of --tiered is built in the background, where
+    // its kernels could neither fail the build nor be reported
+    if (kernelBudgets.isLoaded() && tieredCompile) {
+      cout << "hipcc: --tiered cannot be combined with "
+           << (kernelBudgetsWarn ? "--hipcc-kernel-budgets-warn"
+                                 : "--hipcc-kernel-budgets") << endl;
+      return EXIT_FAILURE;
+    }
+    // The manifest covers the inputs, the resolved link flags and the
+    // offload archs; if none of them changed the link is skipped.
+    bool writeManifest = linkManifest && !compileOnly;
+    LinkManifest manifest(outputFile);
+    if (writeManifest) {
+      manifest.addEntry("compiler", compiler);
+      manifest.addEntry("hipldflags", HIPLDFLAGS);
+      manifest.addEntry("targets", HIPLDARCHFLAGS);
+      if (needCXXFLAGS)
+        manifest.addEntry("hipcxxflags", HIPCXXFLAGS);
+      if (needCFLAGS)
+        manifest.addEntry("hipcflags", HIPCFLAGS);
+      manifest.setSearchDirs(getLibrarySearchDirs());
+      manifest.addInputsFromArgs(originalArgv);
+      if (!manifest.getUnresolved().empty() && (verbose & 0x1)) {
+        cout << "hipcc: link not skipped, libraries not found:";
+        for (auto& library : manifest.getUnresolved())
+          cout << " -l" << library;
+        cout << endl;
+      }
+      stats_.cache = "miss";
+      if (manifest.isUpToDate()) {
+        stats_.cache = "hit";
+        if (verbose & 0x1) {
+          cout << "hipcc: link inputs unchanged, skipping link" << endl;
+        }
+        if (linkManifestTouch) {
+          hipBinUtilPtr_->touchFile(outputFile.empty() ? "a.out" : outputFile);
+          manifest.write();
+        }
+        return EXIT_SUCCESS;
+      }
+    }
+    // Split device codegen of the --hip-link step into partitions, one per
+    // job slot taken from the make jobserver (or per core without one).
+    // The slots are only held while the link runs.
+    JobServer jobServer;
+    int devicePartitions = 0;
+    string deviceLinkOutput = outputFile.empty() ? "a.out" : outputFile;
+    string deviceLinkTrace = deviceLinkOutput + ".device-link.json";
+    if (deviceLinkJobs >= 0 && rdc && !compileOnly) {
+      devicePartitions = deviceLinkJobs > 0 ? deviceLinkJobs :
+                         jobServer.acquire(JobServer::getNumCores());
+      string partitionFlags =
+          " -Xoffload-linker --lto-partitions=" +
+          std::to_string(devicePartitions);
+      if (thinLto.deviceEnabled()) {
+        partitionFlags += " -Xoffload-linker --thinlto-jobs=" +
+                          std::to_string(devicePartitions);
+      }
+      partitionFlags += " -Xoffload-linker --time-trace"
+                        " -Xoffload-linker --time-trace-file=\"" +
+                        deviceLinkTrace + "\"";
+      CMD += partitionFlags;
+      if (verbose & 0x1) {
+        cout << "hipcc-device-link-flags:" << partitionFlags << "\n";
+      }
+    }
+    string object = outputFile;
+    if (object.empty() && !inputs.empty())
+      object = fs::path(inputs.at(0)).stem().string() + ".o";
+    // distributed compile: preprocessed here, compiled by a hipcc-worker
+    if (distributable) {
+      int exitCode = 0;
+      if (distributeCompile(CMD, distributeHosts, object, verbose, exitCode))
+        return exitCode;
+      if (verbose & 0x1)
+        cout << "hipcc: compiling locally" << endl;
+    }
+    // --hipcc-preprocess-once: a single HIP source compiled with -c is
+    // compiled from one bundled preprocessed input
+    PreprocessOnce preprocess(compiler, hipClangPath, verbose);
+    if (preprocessOnce) {
+      string preprocessedCmd;
+      if (singleHipCompile && preprocess.prepare(CMD, hipSourceArgs.at(0),
+                                          deviceArchs, object,
+                                          preprocessedCmd)) {
+        CMD = preprocessedCmd;
+        if (verbose & 0x1) {
+          cout << "hipcc-cmd: " << CMD << "\n";
+        }
+      } else {
+        preprocess.cleanup();
+        if (verbose & 0x1) {
+          cout << "hipcc: preprocess once not applicable, compiling normally"
+               << endl;
+        }
+      }
+    }
+    bool tieredFast = tieredCompile &&
+                      TieredCompile::makeFastCommand(CMD, optCXXFlags);
+    if (tieredFast && (verbose & 0x1)) {
+      cout << "hipcc-cmd: " << CMD << "\n";
+    }
+    // --time-report and --remarks-dir: the files clang writes alongside
+    // the compile are collected afterwards. The records of the fast
+    // object of --tiered are not representative.
+    CompileSideFiles sideFiles(outputs, inputs, deviceArchs, !compileOnly);
+    bool compiles = (hasC || hasCXX || hasHIP) && !preprocessOnly &&
+                    !outputs.empty();
+    bool traced = timeReport && compiles && sideFiles.prepare();
+    bool remarks = !remarksDir.empty() && compiles && !tieredFast &&
+                   sideFiles.prepare();
+    if (traced || remarks) {
+      CMD = sideFiles.getCommand(CMD + (traced ? TimeReport::getFlags() : "")
+                                 + (remarks ? OptRemarks::getFlags() : ""));
+      inProcess = 0;  // TMPDIR has to apply to the compile
+      if (verbose & 0x1) {
+        cout << "hipcc-cmd: " << CMD << "\n";
+      }
+    }
+    auto linkStart = std::chrono::steady_clock::now();
+    int CMD_EXIT_CODE;
+    InProcessClang inProcessClang;
+    if (inProcess && inProcessClang.load(getCompilerFullVersion(), verbose)) {
+      if (verbose & 0x1)
+        cout << "hipcc: running clang in-process" << endl;
+      CMD_EXIT_CODE = inProcessClang.run(BatchCompile::splitCommand(CMD));
+    } else {
+      SystemCmdOut sysOut;
+      sysOut = hipBinUtilPtr_->exec(CMD.c_str(), true);
+      CMD_EXIT_CODE = sysOut.exitCode;
+    }
+    jobServer.release();
+    unityBuild.cleanup();
+    preprocess.cleanup();
     if (CMD_EXIT_CODE !=0) {
       cout <<  "failed to execute:"  << CMD << std::endl;
+    } else if (writeManifest && !manifest.write()) {
+      cout << "Warning: unable to write link manifest "
+           << manifest.getPath() << endl;
+    }
+    if (CMD_EXIT_CODE == 0 && tieredFast &&
+        !tiered.startFullCompile(originalArgv, outputs.at(0), verbose)) {
+      cout << "Warning: unable to start the optimized compile of "
+           << outputs.at(0) << endl;
+    }
+    if (tiered.isReplace()) {
+      tiered.finishFullCompile(CMD_EXIT_CODE, verbose);
+    }
+    if (CMD_EXIT_CODE == 0 && traced) {
+      bool userTraces = false;
+      for (auto& option : options)
+        userTraces = userTraces || option.compare(0, 12, "-ftime-trace") == 0;
+      double wallMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - linkStart).count();
+      // one report per output, with the traces of its inputs
+      for (size_t i = 0; i < outputs.size(); i++) {
+        TimeReport report(outputs.at(i), sideFiles.getInputs(i), verbose);
+        if (!report.write(sideFiles, i, wallMs, userTraces)) {
+          cout << "Warning: unable to write the time report of "
+               << outputs.at(i) << endl;
+        }
+      }
+    }
+    if (CMD_EXIT_CODE == 0 && remarks) {
+      bool userRecords = false;
+      for (auto& option : options) {
+        userRecords = userRecords ||
+                      option.compare(0, 26, "-fsave-optimization-record") == 0;
+      }
+      // the records of every output under its own prefix; the optimized
+      // object of --tiered is recorded under its final name
+      for (size_t i = 0; i < outputs.size(); i++) {
+        OptRemarks records(remarksDir, tiered.isReplace() ?
+                           tiered.getObject() : outputs.at(i),
+                           sideFiles.getInputs(i), verbose);
+        if (!records.collect(sideFiles, i, userRecords)) {
+          cout << "Warning: unable to collect the optimization records into "
+               << remarksDir << endl;
+        }
+      }
+    }
+    // --kernel-report and the kernel budgets: the resources of the kernels
+    // in every output
+    bool checkBudgets = kernelBudgets.isLoaded();
+    bool compiled = CMD_EXIT_CODE == 0;
+    for (size_t i = 0; compiled && (kernelReport || checkBudgets) &&
+                       i < outputs.size(); i++) {
+      KernelReport report;
+      // the budgets fail closed: an object whose kernels cannot be read
+      // fails the build like one over budget
+      if (!report.load(outputs.at(i))) {
+        if (checkBudgets && !kernelBudgetsWarn) {
+          cout << "hipcc: cannot check the kernel budgets of "
+               << outputs.at(i) << ": " << report.getError() << endl;
+          std::error_code ec;
+          fs::remove(outputs.at(i), ec);
+          CMD_EXIT_CODE = EXIT_FAILURE;
+        } else if (checkBudgets) {
+          cout << "Warning: cannot check the kernel budgets of "
+               << outputs.at(i) << ": " << report.getError() << endl;
+        } else if (kernelReport || (verbose & 0x1)) {
+          cout << "hipcc: no kernel report for " << outputs.at(i) << ": "
+               << report.getError() << endl;
+        }
+        continue;
+      }
+      if (kernelReport) {
+        report.print();
+        string reportPath = outputs.at(i) + HIPCC_KERNEL_REPORT_EXT;
+        if (!report.writeJson(reportPath))
+          cout << "Warning: unable to write " << reportPath << endl;
+      }
+      // an output over budget is removed, so that make builds it again
+      if (checkBudgets && kernelBudgets.check(report, outputs.at(i)) > 0 &&
+          !kernelBudgetsWarn) {
+        std::error_code ec;
+        fs::remove(outputs.at(i), ec);
+        CMD_EXIT_CODE = EXIT_FAILURE;
+      }
+    }
+    if (CMD_EXIT_CODE == 0 && devicePartitions > 0) {
+      double wallMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - linkStart).count();
+      recordDeviceLinkTimes(deviceLinkOutput, deviceLinkTrace,
+                            devicePartitions, wallMs, verbose);
     }
-    exit(CMD_EXIT_CODE);
+    return CMD_EXIT_CODE;
   }  // end of runCmd section
+  return EXIT_SUCCESS;
 }   // end of function
 
 #endif  // SRC_HIPBIN_AMD_H_
@@ -24,6 +24,8 @@ THE SOFTWARE.
 
 
 #include "hipBin_util.h"
+#include "hipBin_snapshot.h"
+#include "hipBin_json.h"
 #include <vector>
 #include <string>
 
@@ -49,6 +51,13 @@ THE SOFTWARE.
 # define HIP_COMPILE_CXX_AS_HIP         "HIP_COMPILE_CXX_AS_HIP"
 # define HIPCC_VERBOSE                  "HIPCC_VERBOSE"
 # define HCC_AMDGPU_TARGET              "HCC_AMDGPU_TARGET"
+# define HIPCC_CACHE_DIR                "HIPCC_CACHE_DIR"
+# define HIPCC_DISTRIBUTE               "HIPCC_DISTRIBUTE"
+# define HIPCC_CONFIG_SNAPSHOT          "HIPCC_CONFIG_SNAPSHOT"
+# define HIPCC_STATS_DB                 "HIPCC_STATS_DB"
+# define HIPCC_PGO_DIR                  "HIPCC_PGO_DIR"
+# define XDG_CACHE_HOME                 "XDG_CACHE_HOME"
+# define HOME                           "HOME"
 
 # define HIP_BASE_VERSION_MAJOR     "4"
 # define HIP_BASE_VERSION_MINOR     "4"
@@ -163,6 +172,13 @@ struct EnvVariables {
   string hipClangHccCompactModeEnv_ = "";
   string hipCompileCxxAsHipEnv_ = "";
   string hccAmdGpuTargetEnv_ = "";
+  string hipccCacheDirEnv_ = "";
+  string hipccDistributeEnv_ = "";
+  string hipccConfigSnapshotEnv_ = "";
+  string hipccStatsDbEnv_ = "";
+  string hipccPgoDirEnv_ = "";
+  string xdgCacheHomeEnv_ = "";
+  string homeEnv_ = "";
   friend std::ostream& operator <<(std::ostream& os, const EnvVariables& var) {
     os << "Path: "                           << var.path_ << endl;
     os << "Hip Path: "                       << var.hipPathEnv_ << endl;
@@ -187,6 +203,12 @@ struct EnvVariables {
     os << "Hip Compile Cxx as Hip: "         <<
            var.hipCompileCxxAsHipEnv_ << endl;
     os << "Hcc Amd Gpu Target: "             << var.hccAmdGpuTargetEnv_ << endl;
+    os << "Hipcc Cache Dir: "                << var.hipccCacheDirEnv_ << endl;
+    os << "Hipcc Distribute: "               << var.hipccDistributeEnv_ << endl;
+    os << "Hipcc Config Snapshot: "          <<
+           var.hipccConfigSnapshotEnv_ << endl;
+    os << "Hipcc Stats Db: "                 << var.hipccStatsDbEnv_ << endl;
+    os << "Hipcc Pgo Dir: "                  << var.hipccPgoDirEnv_ << endl;
     return os;
   }
 };
@@ -204,6 +226,8 @@ enum HipBinCommand {
   version,
   check,
   newline,
+  freeze,
+  emit_cmake,
   help,
 };
 
@@ -235,6 +259,8 @@ class HipBinBase {
   virtual const string& getHipCFlags() const = 0;
   virtual const string& getHipLdFlags() const = 0;
   virtual void executeHipCCCmd(vector<string> argv) = 0;
+  virtual void addConfigSnapshot(ConfigSnapshot& snapshot);
+  virtual vector<std::pair<string, string>> getCMakeVariables();
   // Common functions used by all platforms
   void getSystemInfo() const;
   void printEnvironmentVariables() const;
@@ -245,12 +271,18 @@ class HipBinBase {
   const string& getHipVersion() const;
   void printUsage() const;
   bool canRunCompiler(string exeName, string& cmdOut);
+  string getCacheDir(const string& subDir) const;
+  string getToolchainKey() const;
   HipBinCommand gethipconfigCmd(string argument);
+  JsonValue queryConfig(const vector<string>& fields);
+  bool writeCMakeFile(const string& file);
+  static const vector<string>& getQueryFields();
 
  protected:
   // hipBinUtilPtr used by derived platforms
   // so therefore its protected
   HipBinUtil* hipBinUtilPtr_;
+  static ConfigSnapshot& getConfigSnapshot();
 
  private:
   EnvVariables envVariables_, variables_;
@@ -258,6 +290,7 @@ class HipBinBase {
   string hipVersion_;
   void readOSInfo();
   void readEnvVariables();
+  void loadConfigSnapshot();
   void constructHipPath();
   void constructRoccmPath();
   void readHipVersion();
@@ -267,6 +300,7 @@ HipBinBase::HipBinBase() {
   hipBinUtilPtr_ = hipBinUtilPtr_->getInstance();
   readOSInfo();                 // detects if windows or linux
   readEnvVariables();           // reads the envirnoment variables
+  loadConfigSnapshot();         // reads HIPCC_CONFIG_SNAPSHOT
   constructHipPath();           // constructs HIP Path
   constructRoccmPath();         // constructs Roccm Path
   readHipVersion();             // stores the hip version
@@ -284,50 +318,102 @@ void HipBinBase::readOSInfo() {
 
 // reads envirnoment variables
 void HipBinBase::readEnvVariables() {
-  if (const char* path = std::getenv(PATH))
+  if (const char* path = hipBinUtilPtr_->getEnv(PATH))
     envVariables_.path_ = path;
-  if (const char* hip = std::getenv(HIP_PATH))
+  if (const char* hip = hipBinUtilPtr_->getEnv(HIP_PATH))
     envVariables_.hipPathEnv_ = hip;
-  if (const char* hip_rocclr = std::getenv(HIP_ROCCLR_HOME))
+  if (const char* hip_rocclr = hipBinUtilPtr_->getEnv(HIP_ROCCLR_HOME))
     envVariables_.hipRocclrPathEnv_ = hip_rocclr;
-  if (const char* roccm = std::getenv(ROCM_PATH))
+  if (const char* roccm = hipBinUtilPtr_->getEnv(ROCM_PATH))
     envVariables_.roccmPathEnv_ = roccm;
-  if (const char* cuda = std::getenv(CUDA_PATH))
+  if (const char* cuda = hipBinUtilPtr_->getEnv(CUDA_PATH))
     envVariables_.cudaPathEnv_ = cuda;
-  if (const char* hsa = std::getenv(HSA_PATH))
+  if (const char* hsa = hipBinUtilPtr_->getEnv(HSA_PATH))
     envVariables_.hsaPathEnv_ = hsa;
-  if (const char* hipClang = std::getenv(HIP_CLANG_PATH))
+  if (const char* hipClang = hipBinUtilPtr_->getEnv(HIP_CLANG_PATH))
     envVariables_.hipClangPathEnv_ = hipClang;
-  if (const char* hipPlatform = std::getenv(HIP_PLATFORM))
+  if (const char* hipPlatform = hipBinUtilPtr_->getEnv(HIP_PLATFORM))
     envVariables_.hipPlatformEnv_ = hipPlatform;
-  if (const char* hipCompiler = std::getenv(HIP_COMPILER))
+  if (const char* hipCompiler = hipBinUtilPtr_->getEnv(HIP_COMPILER))
     envVariables_.hipCompilerEnv_ = hipCompiler;
-  if (const char* hipRuntime = std::getenv(HIP_RUNTIME))
+  if (const char* hipRuntime = hipBinUtilPtr_->getEnv(HIP_RUNTIME))
     envVariables_.hipRuntimeEnv_ = hipRuntime;
-  if (const char* ldLibaryPath = std::getenv(LD_LIBRARY_PATH))
+  if (const char* ldLibaryPath = hipBinUtilPtr_->getEnv(LD_LIBRARY_PATH))
     envVariables_.ldLibraryPathEnv_ = ldLibaryPath;
-  if (const char* hccAmdGpuTarget = std::getenv(HCC_AMDGPU_TARGET))
+  if (const char* hccAmdGpuTarget = hipBinUtilPtr_->getEnv(HCC_AMDGPU_TARGET))
     envVariables_.hccAmdGpuTargetEnv_ = hccAmdGpuTarget;
-  if (const char* verbose = std::getenv(HIPCC_VERBOSE))
+  if (const char* verbose = hipBinUtilPtr_->getEnv(HIPCC_VERBOSE))
     envVariables_.verboseEnv_ = verbose;
   if (const char* hipccCompileFlagsAppend =
-      std::getenv(HIPCC_COMPILE_FLAGS_APPEND))
+      hipBinUtilPtr_->getEnv(HIPCC_COMPILE_FLAGS_APPEND))
     envVariables_.hipccCompileFlagsAppendEnv_ = hipccCompileFlagsAppend;
-  if (const char* hipccLinkFlagsAppend = std::getenv(HIPCC_LINK_FLAGS_APPEND))
+  if (const char* hipccLinkFlagsAppend =
+      hipBinUtilPtr_->getEnv(HIPCC_LINK_FLAGS_APPEND))
     envVariables_.hipccLinkFlagsAppendEnv_ = hipccLinkFlagsAppend;
-  if (const char* hipLibPath = std::getenv(HIP_LIB_PATH))
+  if (const char* hipLibPath = hipBinUtilPtr_->getEnv(HIP_LIB_PATH))
     envVariables_.hipLibPathEnv_ = hipLibPath;
-  if (const char* deviceLibPath = std::getenv(DEVICE_LIB_PATH))
+  if (const char* deviceLibPath = hipBinUtilPtr_->getEnv(DEVICE_LIB_PATH))
     envVariables_.deviceLibPathEnv_ = deviceLibPath;
   if (const char* hipClangHccCompactMode =
-      std::getenv(HIP_CLANG_HCC_COMPAT_MODE))
+      hipBinUtilPtr_->getEnv(HIP_CLANG_HCC_COMPAT_MODE))
     envVariables_.hipClangHccCompactModeEnv_ = hipClangHccCompactMode;
-  if (const char* hipCompileCxxAsHip = std::getenv(HIP_COMPILE_CXX_AS_HIP))
+  if (const char* hipCompileCxxAsHip =
+      hipBinUtilPtr_->getEnv(HIP_COMPILE_CXX_AS_HIP))
     envVariables_.hipCompileCxxAsHipEnv_ = hipCompileCxxAsHip;
+  if (const char* hipccCacheDir = hipBinUtilPtr_->getEnv(HIPCC_CACHE_DIR))
+    envVariables_.hipccCacheDirEnv_ = hipccCacheDir;
+  if (const char* hipccDistribute = hipBinUtilPtr_->getEnv(HIPCC_DISTRIBUTE))
+    envVariables_.hipccDistributeEnv_ = hipccDistribute;
+  if (const char* hipccConfigSnapshot =
+      hipBinUtilPtr_->getEnv(HIPCC_CONFIG_SNAPSHOT))
+    envVariables_.hipccConfigSnapshotEnv_ = hipccConfigSnapshot;
+  if (const char* hipccStatsDb = hipBinUtilPtr_->getEnv(HIPCC_STATS_DB))
+    envVariables_.hipccStatsDbEnv_ = hipccStatsDb;
+  if (const char* hipccPgoDir = hipBinUtilPtr_->getEnv(HIPCC_PGO_DIR))
+    envVariables_.hipccPgoDirEnv_ = hipccPgoDir;
+  if (const char* xdgCacheHome = hipBinUtilPtr_->getEnv(XDG_CACHE_HOME))
+    envVariables_.xdgCacheHomeEnv_ = xdgCacheHome;
+  if (const char* home = hipBinUtilPtr_->getEnv(HOME))
+    envVariables_.homeEnv_ = home;
+}
+
+// the snapshot is shared by all platforms and read once
+ConfigSnapshot& HipBinBase::getConfigSnapshot() {
+  static ConfigSnapshot snapshot;
+  return snapshot;
+}
+
+// reads the snapshot of hipconfig --freeze. It is used only if it was
+// written by a hipconfig next to this executable and nothing it watches has
+// changed since, else the configuration is discovered as usual. It is
+// validated again for every environment of the planning API.
+void HipBinBase::loadConfigSnapshot() {
+  static string readFile;
+  static unsigned readEnvironmentId = 0;
+  const string& file = envVariables_.hipccConfigSnapshotEnv_;
+  unsigned environmentId = hipBinUtilPtr_->getEnvironmentId();
+  if (file == readFile && environmentId == readEnvironmentId)
+    return;
+  readFile = file;
+  readEnvironmentId = environmentId;
+  ConfigSnapshot& snapshot = getConfigSnapshot();
+  string binDir;
+  if (snapshot.load(file) &&
+      (!snapshot.get("HIPCC_BIN_DIR", binDir) ||
+       binDir != hipBinUtilPtr_->getSelfPath())) {
+    snapshot.clear();
+  }
+  if (!snapshot.isLoaded() && std::atoi(envVariables_.verboseEnv_.c_str())) {
+    cout << "hipcc: not using config snapshot " << file << ": "
+         << (snapshot.getError().empty() ? "written for another hipcc"
+                                         : snapshot.getError()) << endl;
+  }
 }
 
 // constructs the HIP path
 void HipBinBase::constructHipPath() {
+  if (getConfigSnapshot().get("HIP_PATH", variables_.hipPathEnv_))
+    return;
   fs::path full_path(hipBinUtilPtr_->getSelfPath());
   if (envVariables_.hipPathEnv_.empty())
     variables_.hipPathEnv_ = (full_path.parent_path()).string();
@@ -338,6 +424,8 @@ void HipBinBase::constructHipPath() {
 
 // constructs the ROCM path
 void HipBinBase::constructRoccmPath() {
+  if (getConfigSnapshot().get("ROCM_PATH", variables_.roccmPathEnv_))
+    return;
   if (envVariables_.roccmPathEnv_.empty()) {
     const string& hipPath = getHipPath();
     fs::path roccm_path(hipPath);
@@ -354,6 +442,8 @@ void HipBinBase::constructRoccmPath() {
 
 // reads the Hip Version
 void HipBinBase::readHipVersion() {
+  if (getConfigSnapshot().get("HIP_VERSION", hipVersion_))
+    return;
   string hipVersion;
   const string& hipPath = getHipPath();
   fs::path hipVersionPath = hipPath;
@@ -455,37 +545,231 @@ void HipBinBase::printUsage() const {
   cout << "  --version, -v      : print hip version\n";
   cout << "  --check            : check configuration\n";
   cout << "  --newline, -n      : print newline\n";
+  cout << "  --json             : print all --query fields as JSON\n";
+  cout << "  --query a,b,...    : print the given fields as JSON, of: ";
+  for (auto& field : getQueryFields())
+    cout << (&field == &getQueryFields().front() ? "" : ",") << field;
+  cout << "\n";
+  cout << "  --emit-cmake FILE  :"
+  " write a CMake toolchain file calling the compiler with the hipcc flags\n";
+  cout << "  --freeze FILE      :"
+  " write a snapshot of the configuration for HIPCC_CONFIG_SNAPSHOT\n";
   cout << "  --help, -h         : print help message\n";
 }
 
 
 
 // compiler canRun or not
+// runs through exec, so that the environment of a plan applies
 bool HipBinBase::canRunCompiler(string exeName, string& cmdOut) {
   string compilerName = exeName;
-  string temp_dir = hipBinUtilPtr_->getTempDir();
-  fs::path templateFs = temp_dir;
-  templateFs /= "canRunXXXXXX";
-  string tmpFileName = hipBinUtilPtr_->mktempFile(templateFs.string());
-  compilerName += " --version > " + tmpFileName + " 2>&1";
-  bool executable = false;
-  if (system(const_cast<char*>(compilerName.c_str()))) {
-    executable = false;
+  compilerName += " --version 2>&1";
+  SystemCmdOut sysOut = hipBinUtilPtr_->exec(compilerName.c_str());
+  if (sysOut.exitCode != 0)
+    return false;
+  stringstream out(sysOut.out);
+  string myline;
+  while (std::getline(out, myline)) {
+    cmdOut += myline;
+  }
+  return true;
+}
+
+// returns (and creates) a hipcc cache directory.
+// HIPCC_CACHE_DIR takes precedence over the XDG cache location.
+string HipBinBase::getCacheDir(const string& subDir) const {
+  const EnvVariables& var = getEnvVariables();
+  fs::path cacheDir;
+  if (!var.hipccCacheDirEnv_.empty()) {
+    cacheDir = var.hipccCacheDirEnv_;
+  } else if (!var.xdgCacheHomeEnv_.empty()) {
+    cacheDir = var.xdgCacheHomeEnv_;
+    cacheDir /= "hipcc";
+  } else if (!var.homeEnv_.empty()) {
+    cacheDir = var.homeEnv_;
+    cacheDir /= ".cache/hipcc";
   } else {
-    string myline;
-    ifstream fp;
-    fp.open(tmpFileName);
-    if (fp.is_open()) {
-      while (std::getline(fp, myline)) {
-        cmdOut += myline;
-      }
+    cacheDir = hipBinUtilPtr_->getTempDir();
+    cacheDir /= "hipcc-cache";
+  }
+  if (!subDir.empty())
+    cacheDir /= subDir;
+  std::error_code ec;
+  fs::create_directories(cacheDir, ec);
+  return cacheDir.string();
+}
+
+// returns a key identifying the toolchain, used to keep caches of different
+// compilers apart. The compiler binary is identified by its path, size and
+// modification time so that no process has to be spawned.
+string HipBinBase::getToolchainKey() const {
+  string compiler = getHipCC();
+  string key = compiler + "\n" + getHipVersion();
+  std::error_code ec;
+  fs::path compilerFs = fs::canonical(compiler, ec);
+  if (!ec) {
+    key += "\n" + compilerFs.string();
+    auto size = fs::file_size(compilerFs, ec);
+    if (!ec)
+      key += "\n" + std::to_string(size);
+    auto mtime = fs::last_write_time(compilerFs, ec);
+    if (!ec)
+      key += "\n" + std::to_string(mtime.time_since_epoch().count());
+  }
+  return hipBinUtilPtr_->hashString(key);
+}
+
+// records what the base derives, and what it depended on, in the snapshot
+void HipBinBase::addConfigSnapshot(ConfigSnapshot& snapshot) {
+  const string& hipPath = getHipPath();
+  snapshot.set("HIPCC_BIN_DIR", hipBinUtilPtr_->getSelfPath());
+  snapshot.set("HIP_PATH", hipPath);
+  snapshot.set("ROCM_PATH", getRoccmPath());
+  snapshot.set("HIP_VERSION", getHipVersion());
+  snapshot.watchEnv(HIP_PATH);
+  snapshot.watchEnv(ROCM_PATH);
+  snapshot.watchFile(hipPath + "/bin/.hipVersion");
+  fs::path rocmAgentEnumerator = fs::path(hipPath).parent_path();
+  rocmAgentEnumerator /= "bin/rocm_agent_enumerator";
+  snapshot.watchFile(rocmAgentEnumerator.string());
+}
+
+// the fields of hipconfig --json and --query. Names are only ever added, so
+// that the schema stays stable for build systems.
+const vector<string>& HipBinBase::getQueryFields() {
+  static const vector<string> fields = {
+    "path", "rocmpath", "cpp_config", "compiler", "platform", "runtime",
+    "hipclangpath", "version", "compiler_version", "cxxflags", "cflags",
+    "ldflags", "device_lib_path", "hip_lib_path" };
+  return fields;
+}
+
+// returns the requested fields as a JSON object; each one is computed only
+// when asked for, as some of them run the compiler
+JsonValue HipBinBase::queryConfig(const vector<string>& fields) {
+  JsonValue result = JsonValue::object();
+  const PlatformInfo& platformInfo = getPlatformInfo();
+  for (auto& field : fields) {
+    if (field == "path") {
+      result.set(field, getHipPath());
+    } else if (field == "rocmpath") {
+      result.set(field, getRoccmPath());
+    } else if (field == "cpp_config") {
+      result.set(field, getCppConfig());
+    } else if (field == "compiler") {
+      result.set(field, CompilerTypeStr(platformInfo.compiler));
+    } else if (field == "platform") {
+      result.set(field, PlatformTypeStr(platformInfo.platform));
+    } else if (field == "runtime") {
+      result.set(field, RuntimeTypeStr(platformInfo.runtime));
+    } else if (field == "hipclangpath") {
+      result.set(field, getCompilerPath());
+    } else if (field == "version") {
+      result.set(field, getHipVersion());
+    } else if (field == "compiler_version") {
+      result.set(field, getCompilerVersion());
+    } else if (field == "cxxflags") {
+      initializeHipCXXFlags();
+      result.set(field, getHipCXXFlags());
+    } else if (field == "cflags") {
+      initializeHipCFlags();
+      result.set(field, getHipCFlags());
+    } else if (field == "ldflags") {
+      initializeHipLdFlags();
+      result.set(field, getHipLdFlags());
+    } else if (field == "device_lib_path") {
+      result.set(field, getDeviceLibPath());
+    } else if (field == "hip_lib_path") {
+      result.set(field, getHipLibPath());
     }
-    fp.close();
-    executable = true;
   }
+  return result;
+}
 
-  fs::remove(tmpFileName);
-  return executable;
+// the HIPCC_* variables of hipconfig --emit-cmake: the compiler and the
+// flags hipcc adds to every compile and link. HIPCC_HIP_FLAGS are those of
+// a HIP source, HIPCC_CXX_FLAGS those of a C++ source. HIPCC_HIP_OPT_FLAGS
+// are only added to optimized HIP compiles, as hipcc skips them for -O0.
+vector<std::pair<string, string>> HipBinBase::getCMakeVariables() {
+  initializeHipCFlags();
+  initializeHipCXXFlags();
+  initializeHipLdFlags();
+  const EnvVariables& var = getEnvVariables();
+  string cFlags = getHipCFlags(), cxxFlags = getHipCXXFlags();
+  string ldFlags = getHipLdFlags();
+  if (!var.hipccCompileFlagsAppendEnv_.empty()) {
+    cFlags += " " + var.hipccCompileFlagsAppendEnv_;
+    cxxFlags += " " + var.hipccCompileFlagsAppendEnv_;
+  }
+  if (!var.hipccLinkFlagsAppendEnv_.empty())
+    ldFlags += " " + var.hipccLinkFlagsAppendEnv_;
+  return {
+    {"HIPCC_COMPILER", getHipCC()},
+    {"HIPCC_C_COMPILER", getCompilerPath() + "/clang"},
+    {"HIPCC_C_FLAGS", hipBinUtilPtr_->trim(cFlags)},
+    {"HIPCC_CXX_FLAGS", hipBinUtilPtr_->trim(cxxFlags)},
+    {"HIPCC_HIP_FLAGS", hipBinUtilPtr_->trim(cxxFlags)},
+    {"HIPCC_HIP_OPT_FLAGS", ""},
+    {"HIPCC_LINK_FLAGS", hipBinUtilPtr_->trim(ldFlags)},
+    {"HIPCC_LINK_LIBRARIES", ""},
+    {"HIPCC_OFFLOAD_ARCHS", ""},
+    {"HIPCC_DEVICE_LIB_PATH", getDeviceLibPath()},
+  };
+}
+
+// writes a CMake toolchain file that sets the HIPCC_* cache variables and
+// makes the C, CXX and HIP languages call the compiler with them, bypassing
+// hipcc. Used with -DCMAKE_TOOLCHAIN_FILE=<file>.
+bool HipBinBase::writeCMakeFile(const string& file) {
+  auto quote = [](const string& value) {
+    string quoted = "\"";
+    for (char c : value) {
+      if (c == '"' || c == '\\' || c == '$')
+        quoted += '\\';
+      quoted += c;
+    }
+    return quoted + "\"";
+  };
+  vector<std::pair<string, string>> variables = getCMakeVariables();
+  string archs;
+  for (auto& variable : variables) {
+    if (variable.first == "HIPCC_OFFLOAD_ARCHS")
+      archs = variable.second;
+  }
+  ofstream out(file, std::ios::trunc);
+  if (!out.is_open())
+    return false;
+  out << "# CMake toolchain file written by hipconfig --emit-cmake for HIP "
+      << getHipVersion() << "\n\n";
+  for (auto& variable : variables) {
+    out << "set(" << variable.first << " " << quote(variable.second)
+        << " CACHE STRING \"Set by hipconfig --emit-cmake\")\n";
+  }
+  out << "\n"
+      << "set(CMAKE_C_COMPILER \"${HIPCC_C_COMPILER}\")\n"
+      << "set(CMAKE_CXX_COMPILER \"${HIPCC_COMPILER}\")\n"
+      << "set(CMAKE_HIP_COMPILER \"${HIPCC_COMPILER}\")\n";
+  if (!archs.empty()) {
+    out << "set(CMAKE_HIP_ARCHITECTURES \"${HIPCC_OFFLOAD_ARCHS}\" "
+        << "CACHE STRING \"Set by hipconfig --emit-cmake\")\n";
+  }
+  out << "set(CMAKE_C_FLAGS_INIT \"${HIPCC_C_FLAGS}\")\n"
+      << "set(CMAKE_CXX_FLAGS_INIT \"${HIPCC_CXX_FLAGS}\")\n"
+      << "set(CMAKE_HIP_FLAGS_INIT \"${HIPCC_HIP_FLAGS}\")\n";
+  // the Debug configuration compiles without optimization
+  for (const char* config : {"RELEASE", "RELWITHDEBINFO", "MINSIZEREL"}) {
+    out << "set(CMAKE_HIP_FLAGS_" << config
+        << "_INIT \"${HIPCC_HIP_OPT_FLAGS}\")\n";
+  }
+  out << "set(CMAKE_EXE_LINKER_FLAGS_INIT \"${HIPCC_LINK_FLAGS}\")\n"
+      << "set(CMAKE_SHARED_LINKER_FLAGS_INIT \"${HIPCC_LINK_FLAGS}\")\n"
+      << "set(CMAKE_MODULE_LINKER_FLAGS_INIT \"${HIPCC_LINK_FLAGS}\")\n";
+  for (const char* lang : {"C", "CXX", "HIP"}) {
+    out << "set(CMAKE_" << lang
+        << "_STANDARD_LIBRARIES \"${HIPCC_LINK_LIBRARIES}\")\n";
+  }
+  out.close();
+  return !out.fail();
 }
 
 HipBinCommand HipBinBase::gethipconfigCmd(string argument) {
@@ -524,6 +808,12 @@ HipBinCommand HipBinBase::gethipconfigCmd(string argument) {
   vector<string> newlineStrs = { "--n", "-n", "--newline", "-newline" };
   if (hipBinUtilPtr_->checkCmd(newlineStrs, argument))
     return newline;
+  vector<string> freezeStrs = { "--freeze", "-freeze" };
+  if (hipBinUtilPtr_->checkCmd(freezeStrs, argument))
+    return freeze;
+  vector<string> emitCMakeStrs = { "--emit-cmake", "-emit-cmake" };
+  if (hipBinUtilPtr_->checkCmd(emitCMakeStrs, argument))
+    return emit_cmake;
   vector<string> helpStrs = { "-h", "--help", "-help", "--h" };
   if (hipBinUtilPtr_->checkCmd(helpStrs, argument))
     return help;
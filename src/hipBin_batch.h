@@ -0,0 +1,437 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_BATCH_H_
+#define SRC_HIPBIN_BATCH_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include "hipBin_jobserver.h"
+#include "hipBin_stats.h"
+#include "hipBin_memsched.h"
+#include <vector>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+/**
+ * @brief A job of hipcc --batch
+ */
+struct BatchJob {
+  vector<string> args;  // hipcc arguments, without the compiler
+  string directory;     // working directory of the job
+  string file;          // main source, for reporting
+  string cmd;           // planned compiler command
+  vector<string> inputs;   // inputs of the planned command
+  vector<string> outputs;  // files the planned command writes
+  vector<string> temporaries;  // files written while planning
+  bool spawn = false;   // run as a separate hipcc process instead
+  int exitCode = 0;
+  string output;        // captured diagnostics
+  double ms = 0;
+  StatsRecord stats;    // the planned command for HIPCC_STATS_DB
+};
+
+// plans a job: sets cmd (or spawn) or returns a non zero exit code
+typedef std::function<int(const vector<string>&, BatchJob&)> BatchPlanner;
+
+/**
+ * @brief Batch compile mode of hipcc (hipcc --batch <jobs>).
+ *
+ * The job list is a JSON Lines file with one compile_commands.json style
+ * entry per line, or a compile_commands.json array. The arguments (or
+ * command) of an entry start with the compiler, which is replaced by hipcc.
+ * Every job is turned into its compiler command in this process, so the
+ * platform detection and the toolchain probes are done once; the commands
+ * then run on a pool of threads, at most -j (or the make jobserver slots,
+ * or the number of cores) at a time, as far as their predicted memory use
+ * fits (see MemoryScheduler). The diagnostics of each job are printed
+ * together once it finished.
+ */
+class BatchCompile {
+ public:
+  BatchCompile(const string& hipcc, int verbose);
+  bool parseArgs(const vector<string>& argv);
+  bool load();
+  int run(const BatchPlanner& planner);
+  static string getCommand(const BatchJob& job, const string& hipcc);
+  static vector<string> splitCommand(const string& command);
+  static string quote(const string& arg);
+  static void recordStats(const string& statsDb, BatchJob& job,
+                          const SystemCmdOut& sysOut);
+  void setStatsDb(const string& statsDb);
+  void setMemoryHistory(const string& path);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string hipcc_, jobsPath_, resultsPath_, statsDb_, memoryHistory_;
+  int verbose_;
+  int maxJobs_ = 0;
+  long memBudgetKb_ = 0;  // --batch-mem, 0 for MemAvailable
+  long memDefaultKb_ = HIPCC_MEM_DEFAULT_MB * 1024L;
+  long memLimitKb_ = 0;   // --batch-mem-limit: address space of a job
+  vector<BatchJob> jobs_;
+  std::mutex outputMutex_;
+  bool addEntry(const JsonValue& entry, size_t index);
+  void runJob(size_t index, MemoryScheduler& scheduler);
+  void writeResults() const;
+};
+
+BatchCompile::BatchCompile(const string& hipcc, int verbose)
+    : hipcc_(hipcc), verbose_(verbose) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+// handles --batch <file>, -j N, --batch-results=<file> and the
+// --batch-mem[-default|-limit]=<MB> memory settings
+bool BatchCompile::parseArgs(const vector<string>& argv) {
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg == "--batch" && i + 1 < argv.size()) {
+      jobsPath_ = argv.at(++i);
+    } else if (arg.compare(0, 8, "--batch=") == 0) {
+      jobsPath_ = arg.substr(8);
+    } else if (arg.compare(0, 16, "--batch-results=") == 0) {
+      resultsPath_ = arg.substr(16);
+    } else if (hipBinUtilPtr_->stringRegexMatch(arg, "--batch-mem=[0-9]+")) {
+      memBudgetKb_ = stol(arg.substr(12)) * 1024;
+    } else if (hipBinUtilPtr_->stringRegexMatch(
+               arg, "--batch-mem-default=[0-9]+")) {
+      memDefaultKb_ = stol(arg.substr(20)) * 1024;
+    } else if (hipBinUtilPtr_->stringRegexMatch(
+               arg, "--batch-mem-limit=[0-9]+")) {
+      memLimitKb_ = stol(arg.substr(18)) * 1024;
+    } else if (arg == "-j" && i + 1 < argv.size() &&
+               hipBinUtilPtr_->stringRegexMatch(argv.at(i + 1), "[0-9]+")) {
+      maxJobs_ = stoi(argv.at(++i));
+    } else if (hipBinUtilPtr_->stringRegexMatch(arg, "-j[0-9]+")) {
+      maxJobs_ = stoi(arg.substr(2));
+    } else {
+      cout << "Warning: " << arg << " is ignored in batch mode." << endl;
+    }
+  }
+  if (jobsPath_.empty()) {
+    cout << "--batch requires a job list" << endl;
+    return false;
+  }
+  return true;
+}
+
+// splits a compile_commands.json command the way a POSIX shell would
+vector<string> BatchCompile::splitCommand(const string& command) {
+  vector<string> args;
+  string arg;
+  bool inArg = false;
+  char quoteChar = 0;
+  for (size_t i = 0; i < command.size(); i++) {
+    char c = command.at(i);
+    if (quoteChar == '\'') {
+      if (c == '\'')
+        quoteChar = 0;
+      else
+        arg += c;
+    } else if (c == '\\' && i + 1 < command.size() &&
+               (quoteChar == 0 || strchr("\"\\$`", command.at(i + 1)))) {
+      arg += command.at(++i);
+      inArg = true;
+    } else if (quoteChar == '"') {
+      if (c == '"')
+        quoteChar = 0;
+      else
+        arg += c;
+    } else if (c == '"' || c == '\'') {
+      quoteChar = c;
+      inArg = true;
+    } else if (isspace(static_cast<unsigned char>(c))) {
+      if (inArg)
+        args.push_back(arg);
+      arg.clear();
+      inArg = false;
+    } else {
+      arg += c;
+      inArg = true;
+    }
+  }
+  if (inArg)
+    args.push_back(arg);
+  return args;
+}
+
+// quotes the characters significant to the shell, as hipcc does for the
+// arguments it passes on
+string BatchCompile::quote(const string& arg) {
+#if defined(_WIN32) || defined(_WIN64)
+  return arg.find(' ') == string::npos ? arg : "\"" + arg + "\"";
+#else
+  return regex_replace(arg, regex("[^-a-zA-Z0-9_=+,.\\/]"), "\\$&");
+#endif
+}
+
+bool BatchCompile::addEntry(const JsonValue& entry, size_t index) {
+  BatchJob job;
+  vector<string> args;
+  const JsonValue* arguments = entry.find("arguments");
+  if (arguments && arguments->isArray()) {
+    for (auto& item : arguments->items) {
+      if (!item.isString())
+        break;
+      args.push_back(item.stringValue);
+    }
+  } else {
+    args = splitCommand(entry.getString("command"));
+  }
+  if (!entry.isObject() || args.empty()) {
+    cout << "hipcc: " << jobsPath_ << ": entry " << index + 1
+         << " has no arguments or command" << endl;
+    return false;
+  }
+  // the first argument is the compiler the entry was written for
+  job.args.assign(args.begin() + 1, args.end());
+  std::error_code ec;
+  fs::path directory = entry.getString("directory");
+  job.directory = fs::absolute(directory.empty() ? fs::current_path(ec) :
+                               directory).string();
+  job.file = entry.getString("file");
+  for (size_t i = 0; job.file.empty() && i < job.args.size(); i++) {
+    if (job.args.at(i) == "-o")
+      i++;
+    else if (job.args.at(i).compare(0, 1, "-") != 0)
+      job.file = job.args.at(i);
+  }
+  jobs_.push_back(job);
+  return true;
+}
+
+// reads the job list: JSON Lines, or a single JSON array
+bool BatchCompile::load() {
+  ifstream in(jobsPath_);
+  if (!in.is_open()) {
+    cout << "unable to open file for reading: " << jobsPath_ << endl;
+    return false;
+  }
+  stringstream buffer;
+  buffer << in.rdbuf();
+  string text = buffer.str();
+  string error;
+  size_t first = text.find_first_not_of(" \t\r\n");
+  if (first != string::npos && text.at(first) == '[') {
+    JsonValue entries;
+    if (!JsonValue::parse(text, entries, &error) || !entries.isArray()) {
+      cout << "hipcc: " << jobsPath_ << ": " << error << endl;
+      return false;
+    }
+    for (size_t i = 0; i < entries.items.size(); i++) {
+      if (!addEntry(entries.items.at(i), i))
+        return false;
+    }
+    return true;
+  }
+  stringstream lines(text);
+  string line;
+  size_t lineNumber = 0;
+  while (getline(lines, line)) {
+    lineNumber++;
+    if (hipBinUtilPtr_->trim(line).empty())
+      continue;
+    JsonValue entry;
+    if (!JsonValue::parse(line, entry, &error)) {
+      cout << "hipcc: " << jobsPath_ << ":" << lineNumber << ": " << error
+           << endl;
+      return false;
+    }
+    if (!addEntry(entry, lineNumber - 1))
+      return false;
+  }
+  return true;
+}
+
+// returns the shell command running the planned (or spawned) command of a
+// job in its directory, with the diagnostics on stdout
+string BatchCompile::getCommand(const BatchJob& job, const string& hipcc) {
+  string cmd = job.cmd;
+  if (job.spawn) {
+    cmd = quote(hipcc);
+    for (auto& arg : job.args)
+      cmd += " " + quote(arg);
+  }
+#if defined(_WIN32) || defined(_WIN64)
+  return "cd /d \"" + job.directory + "\" && " + cmd + " 2>&1";
+#else
+  return "cd " + quote(job.directory) + " && " + cmd + " 2>&1";
+#endif
+}
+
+void BatchCompile::setStatsDb(const string& statsDb) {
+  statsDb_ = statsDb;
+}
+
+void BatchCompile::setMemoryHistory(const string& path) {
+  memoryHistory_ = path;
+}
+
+// appends the planned command of a job that ran to the stats database; a
+// spawned hipcc records itself
+void BatchCompile::recordStats(const string& statsDb, BatchJob& job,
+                               const SystemCmdOut& sysOut) {
+  if (statsDb.empty() || job.spawn || job.stats.mode.empty())
+    return;
+  job.stats.wallMs = job.ms;
+  job.stats.exitCode = job.exitCode;
+  StatsDb::addUsage(job.stats, sysOut);
+  StatsDb(statsDb).append(job.stats);
+}
+
+// runs the command of a job and prints its output. A job that ran out of
+// memory is handed back to the scheduler.
+void BatchCompile::runJob(size_t index, MemoryScheduler& scheduler) {
+  BatchJob& job = jobs_.at(index);
+  string cmd = getCommand(job, hipcc_);
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (memLimitKb_ > 0)
+    cmd = "ulimit -v " + std::to_string(memLimitKb_) + " && " + cmd;
+#endif
+  auto start = std::chrono::steady_clock::now();
+  SystemCmdOut sysOut = hipBinUtilPtr_->exec(cmd.c_str());
+  bool outOfMemory = MemoryScheduler::isOutOfMemory(sysOut);
+  if (scheduler.release(index, sysOut.maxRssKb, outOfMemory)) {
+    std::lock_guard<std::mutex> lock(outputMutex_);
+    cout << "hipcc: " << job.file << ": out of memory, retrying with at most "
+         << scheduler.getMaxJobs() << " parallel jobs" << endl;
+    return;
+  }
+  job.ms = std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start).count();
+  job.exitCode = sysOut.exitCode;
+  job.output = sysOut.out;
+  recordStats(statsDb_, job, sysOut);
+
+  std::lock_guard<std::mutex> lock(outputMutex_);
+  if (verbose_ & 0x1)
+    cout << "hipcc-batch-cmd: " << cmd << "\n";
+  cout << job.output;
+  if (job.exitCode != 0) {
+    cout << "hipcc: " << job.file << ": failed with exit code "
+         << job.exitCode << endl;
+  }
+  cout.flush();
+}
+
+// --batch-results: one entry with the exit code and diagnostics per job
+void BatchCompile::writeResults() const {
+  JsonValue results = JsonValue::array();
+  for (auto& job : jobs_) {
+    JsonValue result = JsonValue::object();
+    result.set("file", job.file);
+    result.set("directory", job.directory);
+    result.set("exit_code", job.exitCode);
+    result.set("wall_ms", static_cast<long long>(job.ms));
+    result.set("output", job.output);
+    results.push(result);
+  }
+  ofstream out(resultsPath_);
+  if (!out.is_open()) {
+    cout << "Warning: unable to write " << resultsPath_ << endl;
+    return;
+  }
+  out << results.dump(2) << "\n";
+}
+
+// Plans every job in this thread, in the job's directory, then runs the
+// commands. Returns the exit code of hipcc: 0 if all jobs succeeded.
+int BatchCompile::run(const BatchPlanner& planner) {
+  auto start = std::chrono::steady_clock::now();
+  std::error_code ec;
+  fs::path cwd = fs::current_path(ec);
+  vector<size_t> runnable;
+  int spawned = 0;
+  for (size_t i = 0; i < jobs_.size(); i++) {
+    BatchJob& job = jobs_.at(i);
+    fs::current_path(job.directory, ec);
+    if (ec) {
+      job.exitCode = -1;
+      job.output = "unable to change to directory " + job.directory + "\n";
+    } else {
+      vector<string> argv = {hipcc_};
+      argv.insert(argv.end(), job.args.begin(), job.args.end());
+      job.exitCode = planner(argv, job);
+    }
+    if (job.exitCode != 0) {
+      cout << job.output << "hipcc: " << job.file
+           << ": failed with exit code " << job.exitCode << endl;
+    } else if (job.spawn || !job.cmd.empty()) {
+      runnable.push_back(i);
+      spawned += job.spawn;
+    }
+  }
+  fs::current_path(cwd, ec);
+
+  JobServer jobServer;
+  int numThreads = maxJobs_ > 0 ? maxJobs_ :
+                   jobServer.acquire(JobServer::getNumCores());
+  numThreads = std::max(1, std::min(numThreads,
+                                    static_cast<int>(runnable.size())));
+  MemoryScheduler scheduler(numThreads, memBudgetKb_, memDefaultKb_);
+  if (!memoryHistory_.empty())
+    scheduler.loadHistory(memoryHistory_);
+  for (auto index : runnable) {
+    const BatchJob& job = jobs_.at(index);
+    scheduler.add(index, (fs::path(job.directory) / job.file)
+                         .lexically_normal().string());
+  }
+  if (verbose_ & 0x1) {
+    cout << "hipcc: batch memory budget "
+         << scheduler.getBudgetKb() / 1024 << " MB" << endl;
+  }
+  auto worker = [&]() {
+    size_t index;
+    while (scheduler.acquire(index))
+      runJob(index, scheduler);
+  };
+  vector<std::thread> threads;
+  for (int i = 1; i < numThreads; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+  jobServer.release();
+  if (!memoryHistory_.empty() && !scheduler.saveHistory(memoryHistory_))
+    cout << "Warning: unable to write " << memoryHistory_ << endl;
+
+  int failed = 0;
+  for (auto& job : jobs_)
+    failed += job.exitCode != 0;
+  if (!resultsPath_.empty())
+    writeResults();
+  double ms = std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - start).count();
+  cout << "hipcc: batch of " << jobs_.size() << " jobs, " << failed
+       << " failed";
+  if (spawned > 0)
+    cout << ", " << spawned << " run as separate hipcc";
+  cout << ", " << numThreads << " parallel, "
+       << static_cast<long long>(ms) << " ms" << endl;
+  return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif  // SRC_HIPBIN_BATCH_H_
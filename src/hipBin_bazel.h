@@ -0,0 +1,374 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_BAZEL_H_
+#define SRC_HIPBIN_BAZEL_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include "hipBin_batch.h"
+#include "hipBin_jobserver.h"
+#include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+
+// verbosity of a request from bazel --worker_verbose
+# define HIPCC_WORKER_VERBOSE      10
+
+/**
+ * @brief A WorkRequest of the Bazel persistent worker protocol
+ */
+struct WorkerRequest {
+  vector<string> arguments;
+  int requestId = 0;
+  bool cancel = false;
+  int verbosity = 0;
+  string sandboxDir;
+};
+
+/**
+ * @brief Bazel persistent worker mode of hipcc (hipcc --persistent_worker).
+ *
+ * Reads WorkRequests from stdin and writes a WorkResponse for each to stdout,
+ * either as JSON lines or as length delimited protocol buffers; the format is
+ * taken from --worker_protocol=json|proto, protocol buffers by default.
+ * The platform detection, the version files and the toolchain probes are
+ * done once for the life of the worker. Requests are planned one at a time
+ * like the jobs of hipcc --batch; the compiler commands of multiplex
+ * requests (non zero request id) run on a pool of threads. Cancellation is
+ * not supported, so cancel requests are ignored. The startup arguments other
+ * than the worker flags are prepended to the arguments of every request.
+ */
+class BazelWorker {
+ public:
+  BazelWorker(const string& hipcc, int verbose);
+  void parseArgs(const vector<string>& argv);
+  int run(const BatchPlanner& planner);
+  void setStatsDb(const string& statsDb);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string hipcc_, statsDb_;
+  int verbose_;
+  bool json_ = false;
+  vector<string> startupArgs_;
+  std::mutex outputMutex_, queueMutex_;
+  std::condition_variable queueCond_;
+  std::deque<std::pair<WorkerRequest, BatchJob>> queue_;
+  bool done_ = false;
+  BatchJob plan(const WorkerRequest& request, const BatchPlanner& planner);
+  void execute(const WorkerRequest& request, BatchJob& job);
+  bool readRequest(WorkerRequest& request);
+  void writeResponse(int requestId, int exitCode, const string& output);
+  int readByte();
+  bool readVarint(uint64_t& value);
+  static bool parseVarint(const string& buffer, size_t& pos, uint64_t& value);
+  static void appendVarint(string& buffer, uint64_t value);
+  static bool parseProtoRequest(const string& buffer, WorkerRequest& request);
+};
+
+BazelWorker::BazelWorker(const string& hipcc, int verbose)
+    : hipcc_(hipcc), verbose_(verbose) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+void BazelWorker::setStatsDb(const string& statsDb) {
+  statsDb_ = statsDb;
+}
+
+// handles --persistent_worker and --worker_protocol=; other arguments are
+// startup arguments of every request
+void BazelWorker::parseArgs(const vector<string>& argv) {
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg == "--persistent_worker") {
+      continue;
+    } else if (arg == "--worker_protocol=json") {
+      json_ = true;
+    } else if (arg == "--worker_protocol=proto") {
+      json_ = false;
+    } else if (arg.compare(0, 18, "--worker_protocol=") == 0) {
+      std::cerr << "Warning: unknown worker protocol " << arg.substr(18)
+                << ", using proto" << endl;
+      json_ = false;
+    } else {
+      startupArgs_.push_back(arg);
+    }
+  }
+}
+
+int BazelWorker::readByte() {
+  return fgetc(stdin);
+}
+
+bool BazelWorker::readVarint(uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = readByte();
+    if (c == EOF)
+      return false;
+    value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool BazelWorker::parseVarint(const string& buffer, size_t& pos,
+                              uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && pos < buffer.size(); shift += 7) {
+    unsigned char c = buffer.at(pos++);
+    value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+void BazelWorker::appendVarint(string& buffer, uint64_t value) {
+  while (value >= 0x80) {
+    buffer += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  buffer += static_cast<char>(value);
+}
+
+// WorkRequest: 1 arguments, 2 inputs, 3 request_id, 4 cancel,
+// 5 verbosity, 6 sandbox_dir
+bool BazelWorker::parseProtoRequest(const string& buffer,
+                                    WorkerRequest& request) {
+  size_t pos = 0;
+  while (pos < buffer.size()) {
+    uint64_t key, value;
+    if (!parseVarint(buffer, pos, key))
+      return false;
+    int field = static_cast<int>(key >> 3);
+    switch (key & 0x7) {
+    case 0:
+      if (!parseVarint(buffer, pos, value))
+        return false;
+      if (field == 3)
+        request.requestId = static_cast<int>(value);
+      else if (field == 4)
+        request.cancel = value != 0;
+      else if (field == 5)
+        request.verbosity = static_cast<int>(value);
+      break;
+    case 1:
+      pos += 8;
+      break;
+    case 2:
+      if (!parseVarint(buffer, pos, value) || value > buffer.size() - pos)
+        return false;
+      if (field == 1)
+        request.arguments.push_back(buffer.substr(pos, value));
+      else if (field == 6)
+        request.sandboxDir = buffer.substr(pos, value);
+      pos += value;
+      break;
+    case 5:
+      pos += 4;
+      break;
+    default:
+      return false;
+    }
+  }
+  return pos == buffer.size();
+}
+
+// reads the next request; false at the end of the input
+bool BazelWorker::readRequest(WorkerRequest& request) {
+  if (json_) {
+    string line;
+    int c;
+    while ((c = readByte()) != EOF && c != '\n')
+      line += static_cast<char>(c);
+    if (c == EOF && hipBinUtilPtr_->trim(line).empty())
+      return false;
+    if (hipBinUtilPtr_->trim(line).empty())
+      return readRequest(request);
+    JsonValue value;
+    string error;
+    if (!JsonValue::parse(line, value, &error) || !value.isObject()) {
+      std::cerr << "hipcc: invalid work request: " << error << endl;
+      return false;
+    }
+    const JsonValue* arguments = value.find("arguments");
+    if (arguments && arguments->isArray()) {
+      for (auto& item : arguments->items)
+        request.arguments.push_back(item.stringValue);
+    }
+    request.requestId = static_cast<int>(value.getNumber("requestId"));
+    const JsonValue* cancel = value.find("cancel");
+    request.cancel = cancel && cancel->boolValue;
+    request.verbosity = static_cast<int>(value.getNumber("verbosity"));
+    request.sandboxDir = value.getString("sandboxDir");
+    return true;
+  }
+  uint64_t size;
+  if (!readVarint(size))
+    return false;
+  string buffer(size, '\0');
+  for (uint64_t i = 0; i < size; i++) {
+    int c = readByte();
+    if (c == EOF)
+      return false;
+    buffer[i] = static_cast<char>(c);
+  }
+  if (!parseProtoRequest(buffer, request)) {
+    std::cerr << "hipcc: invalid work request" << endl;
+    return false;
+  }
+  return true;
+}
+
+// WorkResponse: 1 exit_code, 2 output, 3 request_id
+void BazelWorker::writeResponse(int requestId, int exitCode,
+                                const string& output) {
+  string response;
+  if (json_) {
+    JsonValue value = JsonValue::object();
+    value.set("exitCode", exitCode);
+    value.set("output", output);
+    value.set("requestId", requestId);
+    response = value.dump() + "\n";
+  } else {
+    string message;
+    if (exitCode != 0) {
+      message += '\x08';
+      appendVarint(message, static_cast<uint64_t>(
+                   static_cast<int64_t>(exitCode)));
+    }
+    if (!output.empty()) {
+      message += '\x12';
+      appendVarint(message, output.size());
+      message += output;
+    }
+    if (requestId != 0) {
+      message += '\x18';
+      appendVarint(message, static_cast<uint64_t>(requestId));
+    }
+    appendVarint(response, message.size());
+    response += message;
+  }
+  std::lock_guard<std::mutex> lock(outputMutex_);
+  fwrite(response.data(), 1, response.size(), stdout);
+  fflush(stdout);
+}
+
+// plans the request in its sandbox. stdout belongs to the protocol, so
+// what hipcc prints meanwhile becomes part of the response output.
+BatchJob BazelWorker::plan(const WorkerRequest& request,
+                           const BatchPlanner& planner) {
+  BatchJob job;
+  job.args = startupArgs_;
+  job.args.insert(job.args.end(), request.arguments.begin(),
+                  request.arguments.end());
+  std::error_code ec;
+  fs::path cwd = fs::current_path(ec);
+  job.directory = request.sandboxDir.empty() ? cwd.string() :
+                  fs::absolute(request.sandboxDir, ec).string();
+  stringstream printed;
+  std::streambuf* coutBuf = cout.rdbuf(printed.rdbuf());
+  fs::current_path(job.directory, ec);
+  if (ec) {
+    printed << "unable to change to directory " << job.directory << "\n";
+    job.exitCode = -1;
+  } else {
+    vector<string> argv = {hipcc_};
+    argv.insert(argv.end(), job.args.begin(), job.args.end());
+    job.exitCode = planner(argv, job);
+  }
+  fs::current_path(cwd, ec);
+  cout.rdbuf(coutBuf);
+  job.output = printed.str();
+  return job;
+}
+
+// runs the planned command of a request and responds
+void BazelWorker::execute(const WorkerRequest& request, BatchJob& job) {
+  if (job.exitCode == 0 && (job.spawn || !job.cmd.empty())) {
+    string cmd = BatchCompile::getCommand(job, hipcc_);
+    if (request.verbosity >= HIPCC_WORKER_VERBOSE || (verbose_ & 0x1))
+      job.output += "hipcc-worker-cmd: " + cmd + "\n";
+    auto start = std::chrono::steady_clock::now();
+    SystemCmdOut sysOut = hipBinUtilPtr_->exec(cmd.c_str());
+    job.ms = std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start).count();
+    job.output += sysOut.out;
+    job.exitCode = sysOut.exitCode;
+    BatchCompile::recordStats(statsDb_, job, sysOut);
+  }
+  writeResponse(request.requestId, job.exitCode, job.output);
+}
+
+// serves requests until stdin is closed
+int BazelWorker::run(const BatchPlanner& planner) {
+  int numThreads = std::max(1, JobServer::getNumCores());
+  vector<std::thread> threads;
+  auto worker = [&]() {
+    while (true) {
+      std::unique_lock<std::mutex> lock(queueMutex_);
+      queueCond_.wait(lock, [&]() { return done_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      auto item = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      execute(item.first, item.second);
+    }
+  };
+  WorkerRequest request;
+  while (readRequest(request)) {
+    if (!request.cancel) {
+      BatchJob job = plan(request, planner);
+      if (request.requestId == 0) {
+        execute(request, job);
+      } else {
+        if (threads.empty()) {
+          for (int i = 0; i < numThreads; i++)
+            threads.emplace_back(worker);
+        }
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        queue_.push_back({request, job});
+        queueCond_.notify_one();
+      }
+    }
+    request = WorkerRequest();
+  }
+  {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    done_ = true;
+  }
+  queueCond_.notify_all();
+  for (auto& thread : threads)
+    thread.join();
+  return EXIT_SUCCESS;
+}
+
+#endif  // SRC_HIPBIN_BAZEL_H_
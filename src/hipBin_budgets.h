@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_BUDGETS_H_
+#define SRC_HIPBIN_BUDGETS_H_
+
+#include "hipBin_util.h"
+#include "hipBin_kernelreport.h"
+#include <vector>
+#include <string>
+
+// a line of the budgets file
+struct KernelBudget {
+  string kernelGlob, archGlob;
+  map<string, long long> limits;  // max_<resource> or min_occupancy
+  int line = 0;
+};
+
+/**
+ * @brief Kernel resource budgets (--hipcc-kernel-budgets=<file>).
+ *
+ * Every line of the budgets file is a kernel name glob, an arch glob and
+ * limits, e.g.
+ *   *gemm*  gfx90a*  max_vgprs=128 max_spills=0 min_occupancy=4
+ * Kernel names are matched mangled and demangled. The limits are max_vgprs,
+ * max_agprs, max_sgprs, max_lds, max_scratch, max_spills (VGPR and SGPR
+ * spills) and min_occupancy; every matching line applies. '#' starts a
+ * comment.
+ */
+class KernelBudgets {
+ public:
+  bool load(const string& path);
+  bool isLoaded() const;
+  const string& getError() const;
+  int check(const KernelReport& report, const string& file) const;
+
+ private:
+  string path_, error_;
+  vector<KernelBudget> budgets_;
+};
+
+bool KernelBudgets::isLoaded() const {
+  return !path_.empty();
+}
+
+const string& KernelBudgets::getError() const {
+  return error_;
+}
+
+bool KernelBudgets::load(const string& path) {
+  const vector<string> names = {"max_vgprs", "max_agprs", "max_sgprs",
+                                "max_lds", "max_scratch", "max_spills",
+                                "min_occupancy"};
+  ifstream in(path);
+  if (!in.is_open()) {
+    error_ = "unable to read " + path;
+    return false;
+  }
+  string line;
+  int lineNumber = 0;
+  while (std::getline(in, line)) {
+    lineNumber++;
+    line = line.substr(0, line.find('#'));
+    stringstream words(line);
+    KernelBudget budget;
+    budget.line = lineNumber;
+    if (!(words >> budget.kernelGlob))
+      continue;
+    string word;
+    if (!(words >> budget.archGlob) || budget.archGlob.find('=') !=
+        string::npos) {
+      error_ = path + ":" + std::to_string(lineNumber) +
+               ": expected <kernel glob> <arch glob> <limit>=<value>...";
+      return false;
+    }
+    while (words >> word) {
+      smatch m;
+      if (!regex_match(word, m, regex("([a-z_]+)=([0-9]+)")) ||
+          std::find(names.begin(), names.end(), m[1].str()) == names.end()) {
+        error_ = path + ":" + std::to_string(lineNumber) +
+                 ": unknown limit " + word;
+        return false;
+      }
+      // 18 digits always fit a long long
+      if (m[2].length() > 18) {
+        error_ = path + ":" + std::to_string(lineNumber) +
+                 ": limit out of range " + word;
+        return false;
+      }
+      budget.limits[m[1].str()] = std::stoll(m[2].str());
+    }
+    budgets_.push_back(budget);
+  }
+  path_ = path;
+  return true;
+}
+
+// prints the kernels over budget with the limits they exceed and returns
+// their number
+int KernelBudgets::check(const KernelReport& report,
+                         const string& file) const {
+  HipBinUtil* hipBinUtilPtr = HipBinUtil::getInstance();
+  int failed = 0;
+  for (auto& kernel : report.getKernels().items) {
+    string name = kernel.getString("name");
+    string demangled = hipBinUtilPtr->demangle(name);
+    string arch = kernel.getString("arch");
+    auto number = [&kernel](const string& key) {
+      return static_cast<long long>(kernel.getNumber(key));
+    };
+    map<string, long long> usage = {
+      {"vgprs", number("vgpr_count")},
+      {"agprs", number("agpr_count")},
+      {"sgprs", number("sgpr_count")},
+      {"lds", number("lds_bytes")},
+      {"scratch", number("scratch_bytes")},
+      {"spills", number("vgpr_spill_count") + number("sgpr_spill_count")},
+      {"occupancy", number("occupancy")}};
+    string diff;
+    for (auto& budget : budgets_) {
+      if ((!hipBinUtilPtr->globMatch(budget.kernelGlob, name) &&
+           !hipBinUtilPtr->globMatch(budget.kernelGlob, demangled)) ||
+          !hipBinUtilPtr->globMatch(budget.archGlob, arch))
+        continue;
+      for (auto& limit : budget.limits) {
+        bool isMin = limit.first.compare(0, 4, "min_") == 0;
+        string resource = limit.first.substr(4);
+        long long used = usage.at(resource);
+        if (isMin ? used >= limit.second : used <= limit.second)
+          continue;
+        stringstream line;
+        line << "  " << std::left << std::setw(10) << resource << std::right
+             << std::setw(8) << used << (isMin ? " < " : " > ")
+             << limit.second << "  (" << path_ << ":" << budget.line
+             << ")\n";
+        diff += line.str();
+      }
+    }
+    if (!diff.empty()) {
+      failed++;
+      cout << "hipcc: " << file << ": kernel " << demangled << " (" << arch
+           << ") is over budget:\n" << diff;
+    }
+  }
+  cout.flush();
+  return failed;
+}
+
+#endif  // SRC_HIPBIN_BUDGETS_H_
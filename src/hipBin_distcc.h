@@ -0,0 +1,634 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_DISTCC_H_
+#define SRC_HIPBIN_DISTCC_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include "hipBin_batch.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cerrno>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif
+
+# define HIPCC_DISTCC_PROTOCOL        2
+# define HIPCC_DISTCC_DEFAULT_PORT    "3634"
+# define HIPCC_DISTCC_CONNECT_MS      1000
+# define HIPCC_DISTCC_IO_MS           30000
+# define HIPCC_DISTCC_COMPILE_MS      600000
+# define HIPCC_DISTCC_MAX_HEADER      (1ULL << 20)
+# define HIPCC_DISTCC_MAX_FRAME       (256ULL << 20)
+# define HIPCC_DISTCC_INPUT           "input.hipi"
+# define HIPCC_DISTCC_OUTPUT          "output.o"
+
+/**
+ * @brief Length prefixed frames over a TCP connection
+ */
+class DistConnection {
+ public:
+  explicit DistConnection(int fd = -1) : fd_(fd) {}
+  ~DistConnection();
+  bool connectTo(const string& hostPort, int timeoutMs);
+  bool setTimeout(int timeoutMs);
+  bool send(const string& frame);
+  bool receive(string& frame, uint64_t maxSize);
+  bool isOpen() const { return fd_ >= 0; }
+
+ private:
+  int fd_;
+  bool sendAll(const char* data, size_t size);
+  bool receiveAll(char* data, size_t size);
+};
+
+DistConnection::~DistConnection() {
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (fd_ >= 0)
+    close(fd_);
+#endif
+}
+
+// connects to host:port (port defaults to HIPCC_DISTCC_DEFAULT_PORT)
+bool DistConnection::connectTo(const string& hostPort, int timeoutMs) {
+#if defined(_WIN32) || defined(_WIN64)
+  return false;
+#else
+  string host = hostPort, port = HIPCC_DISTCC_DEFAULT_PORT;
+  size_t colon = hostPort.rfind(':');
+  if (colon != string::npos && hostPort.find(']') == string::npos) {
+    host = hostPort.substr(0, colon);
+    port = hostPort.substr(colon + 1);
+  }
+  if (host.size() > 2 && host.front() == '[') {
+    size_t bracket = host.find(']');
+    if (bracket != string::npos) {
+      if (bracket + 2 < host.size() && host.at(bracket + 1) == ':')
+        port = host.substr(bracket + 2);
+      host = host.substr(1, bracket - 1);
+    }
+  }
+  struct addrinfo hints = {}, *addresses = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+    return false;
+  for (struct addrinfo* addr = addresses; addr && fd_ < 0;
+       addr = addr->ai_next) {
+    int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC,
+                    addr->ai_protocol);
+    if (fd < 0)
+      continue;
+    // a bounded connect, so that an unreachable worker costs little
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(fd, addr->ai_addr, addr->ai_addrlen);
+    if (rc != 0 && errno == EINPROGRESS) {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      int error = 0;
+      socklen_t len = sizeof(error);
+      if (poll(&pfd, 1, timeoutMs) == 1 &&
+          getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 &&
+          error == 0)
+        rc = 0;
+    }
+    fcntl(fd, F_SETFL, flags);
+    if (rc == 0)
+      fd_ = fd;
+    else
+      close(fd);
+  }
+  freeaddrinfo(addresses);
+  return fd_ >= 0;
+#endif
+}
+
+// bounds every later send and receive, so that a peer which stops
+// responding fails the transfer instead of blocking it
+bool DistConnection::setTimeout(int timeoutMs) {
+#if defined(_WIN32) || defined(_WIN64)
+  return false;
+#else
+  struct timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+  return fd_ >= 0 &&
+         setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                    sizeof(timeout)) == 0 &&
+         setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                    sizeof(timeout)) == 0;
+#endif
+}
+
+bool DistConnection::sendAll(const char* data, size_t size) {
+#if defined(_WIN32) || defined(_WIN64)
+  return false;
+#else
+  while (size > 0) {
+    ssize_t sent = ::send(fd_, data, size, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      if (sent < 0 && errno == EINTR)
+        continue;
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+#endif
+}
+
+bool DistConnection::receiveAll(char* data, size_t size) {
+#if defined(_WIN32) || defined(_WIN64)
+  return false;
+#else
+  while (size > 0) {
+    ssize_t received = recv(fd_, data, size, 0);
+    if (received <= 0) {
+      if (received < 0 && errno == EINTR)
+        continue;
+      return false;
+    }
+    data += received;
+    size -= received;
+  }
+  return true;
+#endif
+}
+
+// a frame is its size as 8 bytes big endian followed by its contents
+bool DistConnection::send(const string& frame) {
+  char header[8];
+  uint64_t size = frame.size();
+  for (int i = 7; i >= 0; i--, size >>= 8)
+    header[i] = static_cast<char>(size & 0xff);
+  return fd_ >= 0 && sendAll(header, 8) &&
+         sendAll(frame.data(), frame.size());
+}
+
+// frames larger than maxSize are refused before their contents are read
+bool DistConnection::receive(string& frame, uint64_t maxSize) {
+  unsigned char header[8];
+  if (fd_ < 0 || !receiveAll(reinterpret_cast<char*>(header), 8))
+    return false;
+  uint64_t size = 0;
+  for (int i = 0; i < 8; i++)
+    size = (size << 8) | header[i];
+  if (size > maxSize)
+    return false;
+  frame.assign(size, '\0');
+  return size == 0 || receiveAll(&frame[0], size);
+}
+
+/**
+ * @brief Distributed compilation of hipcc (HIPCC_DISTRIBUTE or
+ * --hipcc-distribute=host[:port],...).
+ *
+ * The source is preprocessed locally into a bundled .hipi. The remaining
+ * compile arguments are sent to a hipcc-worker first, and the .hipi only
+ * once the worker has accepted the job. The worker only accepts it if its
+ * toolchain fingerprint (the clang version and the hashes of the device
+ * libraries) equals the local one, the arguments are allowed and it has a
+ * free slot, and returns the diagnostics and the object. Hosts are tried in
+ * turn, starting from one picked by the source; if none of them takes the
+ * job, or a worker stops responding (HIPCC_DISTCC_IO_MS, or
+ * HIPCC_DISTCC_COMPILE_MS for the compile), it is compiled locally.
+ */
+class DistributedCompile {
+ public:
+  DistributedCompile(const string& hosts, const string& fingerprint,
+                     int verbose);
+  static bool getRemoteArgs(const string& cmd, vector<string>& remoteArgs);
+  bool compile(const vector<string>& remoteArgs, const string& input,
+               const string& object, int& exitCode);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  vector<string> hosts_;
+  string fingerprint_;
+  int verbose_;
+  bool compileOn(const string& host, const string& request,
+                 const string& input, const string& object, int& exitCode);
+};
+
+DistributedCompile::DistributedCompile(const string& hosts,
+                                       const string& fingerprint,
+                                       int verbose)
+    : fingerprint_(fingerprint), verbose_(verbose) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+  for (auto& host : hipBinUtilPtr_->splitStr(hosts, ',')) {
+    string trimmed = hipBinUtilPtr_->trim(host);
+    if (!trimmed.empty())
+      hosts_.push_back(trimmed);
+  }
+}
+
+// Turns the local compile command of '-x hip <source>' into the arguments
+// of the remote compile of the preprocessed input. Preprocessor, output and
+// local path options are dropped; the worker adds its own device library
+// path. Returns false if the command is not a single HIP compile.
+bool DistributedCompile::getRemoteArgs(const string& cmd,
+                                       vector<string>& remoteArgs) {
+  vector<string> args = BatchCompile::splitCommand(cmd);
+  vector<string> withValue = {"-o", "-I", "-isystem", "-iquote",
+                              "-idirafter", "-include", "-D", "-U", "-MF",
+                              "-MT", "-MQ", "-ivfsoverlay"};
+  vector<string> prefixes = {"-I", "-D", "-U", "-isystem", "-iquote",
+                             "-idirafter", "-MF", "-MT", "-MQ",
+                             "--hip-device-lib-path=", "--rocm-path=",
+                             "--hip-path="};
+  bool hasSource = false;
+  remoteArgs.clear();
+  for (size_t i = 1; i < args.size(); i++) {
+    const string& arg = args.at(i);
+    if (arg == "-x" && i + 2 < args.size() && args.at(i + 1) == "hip") {
+      if (hasSource)
+        return false;
+      remoteArgs.insert(remoteArgs.end(),
+                        {"-x", "hip-cpp-output", HIPCC_DISTCC_INPUT});
+      hasSource = true;
+      i += 2;
+      continue;
+    }
+    if (std::find(withValue.begin(), withValue.end(), arg) !=
+        withValue.end()) {
+      i++;
+      continue;
+    }
+    if (arg == "-MD" || arg == "-MMD" || arg == "-MP")
+      continue;
+    bool dropped = false;
+    for (auto& prefix : prefixes)
+      dropped = dropped || arg.compare(0, prefix.size(), prefix) == 0;
+    if (!dropped)
+      remoteArgs.push_back(arg);
+  }
+  return hasSource;
+}
+
+bool DistributedCompile::compileOn(const string& host, const string& request,
+                                   const string& input, const string& object,
+                                   int& exitCode) {
+  DistConnection connection;
+  string header, result;
+  if (!connection.connectTo(host, HIPCC_DISTCC_CONNECT_MS) ||
+      !connection.setTimeout(HIPCC_DISTCC_IO_MS) ||
+      !connection.send(request) ||
+      !connection.receive(header, HIPCC_DISTCC_MAX_HEADER)) {
+    if (verbose_ & 0x1)
+      cout << "hipcc: worker " << host << " not available" << endl;
+    return false;
+  }
+  // the worker accepts the job with an empty object, then gets the input
+  JsonValue response;
+  if (!JsonValue::parse(header, response) || !response.isObject())
+    return false;
+  string error = response.getString("error");
+  if (!error.empty()) {
+    if (verbose_ & 0x1)
+      cout << "hipcc: worker " << host << ": " << error << endl;
+    return false;
+  }
+  if (!connection.send(input) ||
+      !connection.setTimeout(HIPCC_DISTCC_COMPILE_MS) ||
+      !connection.receive(header, HIPCC_DISTCC_MAX_HEADER) ||
+      !JsonValue::parse(header, response) || !response.isObject()) {
+    if (verbose_ & 0x1)
+      cout << "hipcc: worker " << host << " did not complete the job" << endl;
+    return false;
+  }
+  exitCode = static_cast<int>(response.getNumber("exitCode", -1));
+  if (exitCode == 0 && !connection.receive(result, HIPCC_DISTCC_MAX_FRAME)) {
+    if (verbose_ & 0x1)
+      cout << "hipcc: worker " << host << " did not complete the job" << endl;
+    return false;
+  }
+  cout << response.getString("output");
+  if (verbose_ & 0x1)
+    cout << "hipcc: compiled on " << host << endl;
+  if (exitCode != 0)
+    return true;
+  string tmpPath = object + ".hipcc-tmp";
+  ofstream out(tmpPath, std::ios::binary);
+  if (!out.is_open())
+    return false;
+  out.write(result.data(), result.size());
+  out.close();
+  std::error_code ec;
+  fs::rename(tmpPath, object, ec);
+  if (ec) {
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+// compiles on the first worker that takes the job. Returns false if the
+// job has to be compiled locally.
+bool DistributedCompile::compile(const vector<string>& remoteArgs,
+                                 const string& input, const string& object,
+                                 int& exitCode) {
+  if (hosts_.empty() || input.size() > HIPCC_DISTCC_MAX_FRAME)
+    return false;
+  JsonValue request = JsonValue::object();
+  request.set("protocol", HIPCC_DISTCC_PROTOCOL);
+  request.set("fingerprint", fingerprint_);
+  JsonValue arguments = JsonValue::array();
+  for (auto& arg : remoteArgs)
+    arguments.push(arg);
+  request.set("arguments", arguments);
+  string requestText = request.dump();
+  // spread the sources over the workers
+  size_t first = std::stoull(hipBinUtilPtr_->hashString(object).substr(0, 8),
+                             nullptr, 16) % hosts_.size();
+  for (size_t i = 0; i < hosts_.size(); i++) {
+    const string& host = hosts_.at((first + i) % hosts_.size());
+    if (compileOn(host, requestText, input, object, exitCode))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief The hipcc-worker daemon serving DistributedCompile.
+ *
+ * Listens on --listen (127.0.0.1 by default, the daemon must only be
+ * reachable from trusted hosts) and --port, and compiles up to -j jobs at a
+ * time. Only the compile options of an allowlist are accepted, so a job can
+ * only read its input and write its object in a private directory. The
+ * input is read once the job is accepted, and is at most
+ * HIPCC_DISTCC_MAX_FRAME bytes.
+ */
+class CompileWorker {
+ public:
+  CompileWorker(const string& compiler, const string& deviceLibPath,
+                const string& fingerprint, int verbose);
+  bool parseArgs(const vector<string>& argv);
+  int run();
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string compiler_, deviceLibPath_, fingerprint_;
+  string listen_ = "127.0.0.1", port_ = HIPCC_DISTCC_DEFAULT_PORT;
+  int verbose_;
+  int maxJobs_ = 0;
+  std::atomic<int> activeJobs_;
+  void serve(int fd);
+  static bool isAllowed(const vector<string>& args, string* refused);
+  static bool isAllowedOption(const string& arg, bool llvmOption);
+};
+
+CompileWorker::CompileWorker(const string& compiler,
+                             const string& deviceLibPath,
+                             const string& fingerprint, int verbose)
+    : compiler_(compiler), deviceLibPath_(deviceLibPath),
+      fingerprint_(fingerprint), verbose_(verbose), activeJobs_(0) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+// handles --listen=<address>, --port=<port> and -j N
+bool CompileWorker::parseArgs(const vector<string>& argv) {
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg.compare(0, 9, "--listen=") == 0) {
+      listen_ = arg.substr(9);
+    } else if (arg.compare(0, 7, "--port=") == 0) {
+      port_ = arg.substr(7);
+    } else if (arg == "-j" && i + 1 < argv.size() &&
+               hipBinUtilPtr_->stringRegexMatch(argv.at(i + 1), "[0-9]+")) {
+      maxJobs_ = stoi(argv.at(++i));
+    } else if (hipBinUtilPtr_->stringRegexMatch(arg, "-j[0-9]+")) {
+      maxJobs_ = stoi(arg.substr(2));
+    } else {
+      cout << "usage: hipcc-worker [--listen=<address>] [--port=<port>]"
+           << " [-j N]" << endl;
+      return false;
+    }
+  }
+  if (maxJobs_ <= 0)
+    maxJobs_ = JobServer::getNumCores();
+  return true;
+}
+
+// Whether the arguments of a job only use allowed compile options: the
+// input, optimization, debug, warning, language and target options. Options
+// naming files, loading plugins or passing arguments to other tools are
+// refused; refused is set to the first argument that is not allowed.
+bool CompileWorker::isAllowed(const vector<string>& args, string* refused) {
+  for (size_t i = 0; i < args.size(); i++) {
+    const string& arg = args.at(i);
+    bool allowed;
+    if (arg == "-x") {
+      allowed = i + 1 < args.size() && args.at(++i) == "hip-cpp-output";
+    } else if (arg == "-mllvm" || arg == "-Xclang" ||
+               arg == "-Xarch_device" || arg == "-Xarch_host") {
+      allowed = i + 1 < args.size() &&
+                isAllowedOption(args.at(++i), arg == "-mllvm");
+    } else {
+      allowed = arg == HIPCC_DISTCC_INPUT || isAllowedOption(arg, false);
+    }
+    if (!allowed) {
+      *refused = args.at(i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// a single compile option, or the value of -mllvm if llvmOption is true
+bool CompileWorker::isAllowedOption(const string& arg, bool llvmOption) {
+  // no option may name a file outside of the job directory
+  if (arg.size() < 2 || arg.at(0) != '-' || arg.find('/') != string::npos ||
+      arg.find('\\') != string::npos || arg.find("..") != string::npos)
+    return false;
+  if (llvmOption)
+    return arg.find("load") == string::npos &&
+           arg.find("plugin") == string::npos;
+  const vector<string> exact = {"-c", "-w", "-pedantic", "-pthread",
+                                "-nogpuinc", "-nogpulib",
+                                "--cuda-device-only", "--cuda-host-only",
+                                "--offload-device-only",
+                                "--offload-host-only"};
+  const vector<string> prefixes = {"-O", "-g", "-W", "-f", "-m", "-std=",
+                                   "--std=", "--offload-arch=",
+                                   "--cuda-gpu-arch="};
+  // options of the prefixes above that load code, write side files or
+  // pass arguments on
+  const vector<string> excluded = {"-Wl,", "-Wa,", "-Wp,", "-fplugin",
+                                   "-fpass-plugin", "-fprofile",
+                                   "-fcrash-diagnostics",
+                                   "-fsave-optimization-record",
+                                   "-ftime-trace", "-fmodule",
+                                   "-fdebug-compilation-dir",
+                                   "-fsanitize-ignorelist",
+                                   "-fsanitize-blacklist", "-mllvm"};
+  if (std::find(exact.begin(), exact.end(), arg) != exact.end())
+    return true;
+  for (auto& prefix : excluded) {
+    if (arg.compare(0, prefix.size(), prefix) == 0)
+      return false;
+  }
+  for (auto& prefix : prefixes) {
+    if (arg.compare(0, prefix.size(), prefix) == 0)
+      return true;
+  }
+  return false;
+}
+
+// handles one job on the accepted connection fd
+void CompileWorker::serve(int fd) {
+  DistConnection connection(fd);
+  string header, input;
+  // a client that stops sending must not hold a worker thread
+  if (!connection.setTimeout(HIPCC_DISTCC_IO_MS) ||
+      !connection.receive(header, HIPCC_DISTCC_MAX_HEADER))
+    return;
+  JsonValue request, response = JsonValue::object();
+  vector<string> args;
+  string refused;
+  if (!JsonValue::parse(header, request) || !request.isObject() ||
+      request.getNumber("protocol") != HIPCC_DISTCC_PROTOCOL) {
+    response.set("error", "unsupported protocol");
+  } else if (request.getString("fingerprint") != fingerprint_) {
+    response.set("error", "toolchain mismatch");
+  } else {
+    const JsonValue* arguments = request.find("arguments");
+    if (arguments && arguments->isArray()) {
+      for (auto& item : arguments->items)
+        args.push_back(item.stringValue);
+    }
+    if (!isAllowed(args, &refused)) {
+      response.set("error", "unsupported argument " + refused);
+    } else if (activeJobs_++ >= maxJobs_) {
+      activeJobs_--;
+      response.set("error", "busy");
+    }
+  }
+  if (response.find("error")) {
+    if (verbose_ & 0x1)
+      cout << "hipcc-worker: " << response.getString("error") << endl;
+    connection.send(response.dump());
+    return;
+  }
+  // accepted, only now is the input read
+  if (!connection.send(response.dump()) ||
+      !connection.receive(input, HIPCC_DISTCC_MAX_FRAME)) {
+    activeJobs_--;
+    return;
+  }
+  response.set("exitCode", -1);
+
+  fs::path dirTemplate = hipBinUtilPtr_->getTempDir();
+  dirTemplate /= "hipcc-worker-XXXXXX";
+  string dir = hipBinUtilPtr_->mktempDir(dirTemplate.string());
+  string object;
+  if (!dir.empty()) {
+    ofstream out((fs::path(dir) / HIPCC_DISTCC_INPUT).string(),
+                 std::ios::binary);
+    out.write(input.data(), input.size());
+    out.close();
+    string cmd = "cd " + BatchCompile::quote(dir) + " && " +
+                 BatchCompile::quote(compiler_) +
+                 " --hip-device-lib-path=" +
+                 BatchCompile::quote(deviceLibPath_);
+    for (auto& arg : args)
+      cmd += " " + BatchCompile::quote(arg);
+    cmd += " -o " HIPCC_DISTCC_OUTPUT " 2>&1";
+    if (verbose_ & 0x1)
+      cout << "hipcc-worker-cmd: " << cmd << endl;
+    SystemCmdOut sysOut = hipBinUtilPtr_->exec(cmd.c_str());
+    response.set("exitCode", sysOut.exitCode);
+    response.set("output", sysOut.out);
+    ifstream in((fs::path(dir) / HIPCC_DISTCC_OUTPUT).string(),
+                std::ios::binary);
+    stringstream buffer;
+    buffer << in.rdbuf();
+    object = buffer.str();
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+  }
+  activeJobs_--;
+  if (connection.send(response.dump()) &&
+      response.getNumber("exitCode", -1) == 0)
+    connection.send(object);
+}
+
+// accepts jobs until the process is terminated
+int CompileWorker::run() {
+#if defined(_WIN32) || defined(_WIN64)
+  cout << "hipcc-worker is not supported on Windows" << endl;
+  return EXIT_FAILURE;
+#else
+  struct addrinfo hints = {}, *addresses = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(listen_.c_str(), port_.c_str(), &hints, &addresses) != 0) {
+    cout << "hipcc-worker: unable to resolve " << listen_ << endl;
+    return EXIT_FAILURE;
+  }
+  int listenFd = -1;
+  for (struct addrinfo* addr = addresses; addr && listenFd < 0;
+       addr = addr->ai_next) {
+    int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC,
+                    addr->ai_protocol);
+    if (fd < 0)
+      continue;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, addr->ai_addr, addr->ai_addrlen) == 0 &&
+        ::listen(fd, SOMAXCONN) == 0)
+      listenFd = fd;
+    else
+      close(fd);
+  }
+  freeaddrinfo(addresses);
+  if (listenFd < 0) {
+    cout << "hipcc-worker: unable to listen on " << listen_ << ":" << port_
+         << endl;
+    return EXIT_FAILURE;
+  }
+  cout << "hipcc-worker: listening on " << listen_ << ":" << port_ << ", "
+       << maxJobs_ << " jobs, toolchain " << fingerprint_ << endl;
+  while (true) {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    std::thread(&CompileWorker::serve, this, fd).detach();
+  }
+  close(listenFd);
+  return EXIT_FAILURE;
+#endif
+}
+
+#endif  // SRC_HIPBIN_DISTCC_H_
@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_HOSTONLY_H_
+#define SRC_HIPBIN_HOSTONLY_H_
+
+#include "hipBin_util.h"
+#include "hipBin_scan.h"
+#include <vector>
+#include <string>
+#include <set>
+#include <deque>
+
+/**
+ * @brief Scan result of a single file as stored in the verdict cache
+ */
+struct HostOnlyEntry {
+  bool deviceCode = true;
+  vector<string> quotedIncludes;
+  vector<string> angledIncludes;
+};
+
+/**
+ * @brief Detection of C++ sources without device code.
+ *
+ * A source is host only if neither it nor any header it includes uses a
+ * device construct, tests for device compilation or includes a HIP header.
+ * Headers are followed through the -I, -iquote and -isystem directories of
+ * the command line; a quoted include that cannot be found makes the source
+ * a HIP source. The scan result of every file is cached by content hash
+ * and scanner version.
+ */
+class HostOnlyDetector {
+ public:
+  HostOnlyDetector();
+  void setCacheDir(const string& cacheDir);
+  void addArgs(const vector<string>& argv);
+  bool isHostOnly(const string& source);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string cacheDir_;
+  vector<string> quoteDirs_, includeDirs_;
+  bool disabled_ = false;
+  map<string, HostOnlyEntry> entries_;  // by path, for this invocation
+  bool getEntry(const string& path, HostOnlyEntry& entry);
+  bool readCache(const string& hash, HostOnlyEntry& entry) const;
+  void writeCache(const string& hash, const HostOnlyEntry& entry) const;
+  static bool isHipHeader(const string& include);
+  static string findInclude(const string& include,
+                            const vector<string>& dirs);
+};
+
+HostOnlyDetector::HostOnlyDetector() {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+void HostOnlyDetector::setCacheDir(const string& cacheDir) {
+  cacheDir_ = cacheDir;
+}
+
+// collects the include directories. A forced include or a macro defined
+// to a device construct on the command line disables the detection.
+void HostOnlyDetector::addArgs(const vector<string>& argv) {
+  string prevArg;
+  for (auto& arg : argv) {
+    if (prevArg == "-I" || prevArg == "-isystem" || prevArg == "-idirafter") {
+      includeDirs_.push_back(arg);
+    } else if (prevArg == "-iquote") {
+      quoteDirs_.push_back(arg);
+    } else if (prevArg == "-D" || arg.compare(0, 2, "-D") == 0) {
+      SourceInfo info;
+      SourceScanner::scan(arg, info);
+      if (info.deviceCode)
+        disabled_ = true;
+    } else if (arg == "-include" || arg.compare(0, 8, "-include") == 0) {
+      disabled_ = true;
+    } else if (arg.compare(0, 8, "-isystem") == 0 && arg.size() > 8) {
+      includeDirs_.push_back(arg.substr(8));
+    } else if (arg.compare(0, 7, "-iquote") == 0 && arg.size() > 7) {
+      quoteDirs_.push_back(arg.substr(7));
+    } else if (arg.compare(0, 2, "-I") == 0 && arg.size() > 2) {
+      includeDirs_.push_back(arg.substr(2));
+    }
+    prevArg = arg;
+  }
+}
+
+// headers of HIP and of the HIP/CUDA libraries
+bool HostOnlyDetector::isHipHeader(const string& include) {
+  return regex_search(include, regex("^(hip|roc|cuda|thrust/|cub/)"));
+}
+
+string HostOnlyDetector::findInclude(const string& include,
+                                     const vector<string>& dirs) {
+  for (auto& dir : dirs) {
+    fs::path candidate = dir;
+    candidate /= include;
+    std::error_code ec;
+    if (fs::is_regular_file(candidate, ec))
+      return candidate.string();
+  }
+  return "";
+}
+
+// cache entries end with a marker line so that a partially written entry
+// is never taken for a host only verdict
+bool HostOnlyDetector::readCache(const string& hash,
+                                 HostOnlyEntry& entry) const {
+  if (cacheDir_.empty())
+    return false;
+  fs::path cacheFile = cacheDir_;
+  cacheFile /= hash;
+  ifstream in(cacheFile.string());
+  if (!in.is_open())
+    return false;
+  string line;
+  bool complete = false;
+  HostOnlyEntry cached;
+  if (!getline(in, line) || (line != "host" && line != "device"))
+    return false;
+  cached.deviceCode = line == "device";
+  while (getline(in, line)) {
+    if (line.compare(0, 6, "quote=") == 0) {
+      cached.quotedIncludes.push_back(line.substr(6));
+    } else if (line.compare(0, 6, "angle=") == 0) {
+      cached.angledIncludes.push_back(line.substr(6));
+    } else if (line == "end") {
+      complete = true;
+      break;
+    }
+  }
+  if (!complete)
+    return false;
+  entry = cached;
+  return true;
+}
+
+void HostOnlyDetector::writeCache(const string& hash,
+                                  const HostOnlyEntry& entry) const {
+  if (cacheDir_.empty())
+    return;
+  fs::path cacheFile = cacheDir_;
+  cacheFile /= hash;
+  string tmpPath = cacheFile.string() + ".tmp";
+  ofstream out(tmpPath);
+  if (!out.is_open())
+    return;
+  out << (entry.deviceCode ? "device" : "host") << "\n";
+  for (auto& include : entry.quotedIncludes)
+    out << "quote=" << include << "\n";
+  for (auto& include : entry.angledIncludes)
+    out << "angle=" << include << "\n";
+  out << "end\n";
+  out.close();
+  std::error_code ec;
+  fs::rename(tmpPath, cacheFile, ec);
+}
+
+// returns the scan result of a file, from the cache if its contents are known
+bool HostOnlyDetector::getEntry(const string& path, HostOnlyEntry& entry) {
+  auto known = entries_.find(path);
+  if (known != entries_.end()) {
+    entry = known->second;
+    return true;
+  }
+  ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+    return false;
+  stringstream buffer;
+  buffer << in.rdbuf();
+  string text = buffer.str();
+  string hash = hipBinUtilPtr_->hashString(
+                HIPCC_SCANNER_VERSION + string(1, '\0') + text);
+  if (!readCache(hash, entry)) {
+    SourceInfo info;
+    SourceScanner::scan(text, info);
+    entry.deviceCode = info.deviceCode;
+    entry.quotedIncludes = info.quotedIncludes;
+    entry.angledIncludes = info.angledIncludes;
+    writeCache(hash, entry);
+  }
+  entries_[path] = entry;
+  return true;
+}
+
+// follows the includes of the source breadth first
+bool HostOnlyDetector::isHostOnly(const string& source) {
+  if (disabled_)
+    return false;
+  std::set<string> visited;
+  std::deque<string> pending;
+  pending.push_back(source);
+  while (!pending.empty()) {
+    string path = pending.front();
+    pending.pop_front();
+    std::error_code ec;
+    fs::path canonical = fs::canonical(path, ec);
+    string key = ec ? path : canonical.string();
+    if (!visited.insert(key).second)
+      continue;
+    HostOnlyEntry entry;
+    if (!getEntry(path, entry) || entry.deviceCode)
+      return false;
+    vector<string> quoteDirs;
+    quoteDirs.push_back(fs::path(path).parent_path().string());
+    quoteDirs.insert(quoteDirs.end(), quoteDirs_.begin(), quoteDirs_.end());
+    quoteDirs.insert(quoteDirs.end(), includeDirs_.begin(),
+                     includeDirs_.end());
+    for (auto& include : entry.quotedIncludes) {
+      if (isHipHeader(include))
+        return false;
+      string found = findInclude(include, quoteDirs);
+      if (found.empty())
+        return false;
+      pending.push_back(found);
+    }
+    // angled includes outside of the given directories are system headers
+    for (auto& include : entry.angledIncludes) {
+      if (isHipHeader(include))
+        return false;
+      string found = findInclude(include, includeDirs_);
+      if (!found.empty())
+        pending.push_back(found);
+    }
+  }
+  return true;
+}
+
+#endif  // SRC_HIPBIN_HOSTONLY_H_
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// libhipcc-inprocess.so: the clang driver and -cc1 of libclang-cpp behind
+// a C interface, loaded by hipcc (see hipBin_inprocess.h)
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Driver/Compilation.h"
+#include "clang/Driver/Driver.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticBuffer.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/FrontendTool/Utils.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#if __has_include("llvm/TargetParser/Host.h")
+#include "llvm/TargetParser/Host.h"
+#else
+#include "llvm/Support/Host.h"
+#endif
+#include <memory>
+#include <mutex>
+#include <string>
+
+// runs a job of the driver: -cc1 in-process, anything else (-cc1as) by the
+// clang executable. The -mllvm options of the previous -cc1 are reset, as
+// every job of a compile passes them again.
+static int executeCC1(llvm::SmallVectorImpl<const char*>& argV) {
+  if (argV.size() < 2 || llvm::StringRef(argV[1]) != "-cc1") {
+    llvm::SmallVector<llvm::StringRef, 64> args(argV.begin(), argV.end());
+    return llvm::sys::ExecuteAndWait(argV[0], args);
+  }
+  llvm::cl::ResetAllOptionOccurrences();
+  auto instance = std::make_unique<clang::CompilerInstance>();
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> diagID(
+      new clang::DiagnosticIDs());
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagOpts =
+      new clang::DiagnosticOptions();
+  auto* diagsBuffer = new clang::TextDiagnosticBuffer;
+  clang::DiagnosticsEngine diags(diagID, &*diagOpts, diagsBuffer);
+  bool success = clang::CompilerInvocation::CreateFromArgs(
+      instance->getInvocation(), llvm::ArrayRef<const char*>(argV).slice(2),
+      diags, argV[0]);
+  instance->createDiagnostics();
+  if (!instance->hasDiagnostics())
+    return 1;
+  diagsBuffer->FlushDiagnostics(instance->getDiagnostics());
+  if (!success)
+    return 1;
+  success = clang::ExecuteCompilerInvocation(instance.get());
+  return success ? 0 : 1;
+}
+
+// the version line clang --version prints first, with the vendor and the
+// revision
+extern "C" const char* hipcc_inprocess_version() {
+  static const std::string version = clang::getClangFullVersion();
+  return version.c_str();
+}
+
+// runs the clang driver; argv[0] is the clang executable of the toolchain
+extern "C" int hipcc_inprocess_run(int argc, const char** argv) {
+  static std::once_flag initialized;
+  std::call_once(initialized, []() {
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+    llvm::InitializeAllAsmParsers();
+    // a crash of an in-process -cc1 is reported like one of a clang process
+    llvm::CrashRecoveryContext::Enable();
+  });
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagOpts =
+      new clang::DiagnosticOptions();
+  auto* diagClient = new clang::TextDiagnosticPrinter(llvm::errs(),
+                                                      &*diagOpts);
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> diagID(
+      new clang::DiagnosticIDs());
+  clang::DiagnosticsEngine diags(diagID, &*diagOpts, diagClient);
+  clang::driver::Driver driver(argv[0], llvm::sys::getDefaultTargetTriple(),
+                               diags);
+  driver.CC1Main = &executeCC1;
+  std::unique_ptr<clang::driver::Compilation> compilation(
+      driver.BuildCompilation(llvm::ArrayRef<const char*>(argv, argc)));
+  if (!compilation || compilation->containsError())
+    return 1;
+  llvm::SmallVector<std::pair<int, const clang::driver::Command*>, 4>
+      failingCommands;
+  int result = driver.ExecuteCompilation(*compilation, failingCommands);
+  for (auto& failing : failingCommands) {
+    if (failing.first != 0) {
+      result = failing.first;
+      break;
+    }
+  }
+  llvm::outs().flush();
+  llvm::errs().flush();
+  return result;
+}
@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_INPROCESS_H_
+#define SRC_HIPBIN_INPROCESS_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+
+#if defined(HIPCC_USE_LIBCLANG)
+#include <dlfcn.h>
+#endif
+
+# define HIPCC_INPROCESS_MODULE     "libhipcc-inprocess.so"
+
+// entry points of the module built from hipBin_inprocess.cpp
+typedef const char* (*HipccInProcessVersionFn)();
+typedef int (*HipccInProcessRunFn)(int argc, const char** argv);
+
+/**
+ * @brief In-process clang driver (builds with -DHIPCC_USE_LIBCLANG=ON).
+ *
+ * The compile command runs through the clang driver and -cc1 of
+ * libclang-cpp, loaded from libhipcc-inprocess.so next to hipcc, instead of
+ * starting the clang binary. The clang path of the command still locates
+ * the resource directory and the external tools. If the module or
+ * libclang-cpp cannot be loaded, or the module was built for another clang
+ * than the one hipcc found (the full version line, with the vendor and the
+ * revision, must be equal), the command is executed as usual.
+ */
+class InProcessClang {
+ public:
+  bool load(const string& compilerFullVersion, int verbose);
+  bool isLoaded() const;
+  int run(const vector<string>& args) const;
+
+ private:
+  HipccInProcessRunFn run_ = nullptr;
+};
+
+bool InProcessClang::isLoaded() const {
+  return run_ != nullptr;
+}
+
+// loads the module if it matches compilerFullVersion, the first line of
+// clang --version
+bool InProcessClang::load([[maybe_unused]] const string& compilerFullVersion,
+                          [[maybe_unused]] int verbose) {
+#if defined(HIPCC_USE_LIBCLANG)
+  std::error_code ec;
+  fs::path modulePath = fs::read_symlink("/proc/self/exe", ec);
+  if (ec)
+    return false;
+  modulePath = modulePath.parent_path() / HIPCC_INPROCESS_MODULE;
+  void* handle = dlopen(modulePath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    if (verbose & 0x1)
+      cout << "hipcc: in-process clang not available: " << dlerror() << endl;
+    return false;
+  }
+  auto version = reinterpret_cast<HipccInProcessVersionFn>(
+                 dlsym(handle, "hipcc_inprocess_version"));
+  auto run = reinterpret_cast<HipccInProcessRunFn>(
+             dlsym(handle, "hipcc_inprocess_run"));
+  if (!version || !run || compilerFullVersion.empty() ||
+      compilerFullVersion != version()) {
+    if (verbose & 0x1) {
+      cout << "hipcc: in-process clang \"" << (version ? version() : "")
+           << "\" does not match \"" << compilerFullVersion << "\"" << endl;
+    }
+    dlclose(handle);
+    return false;
+  }
+  run_ = run;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// runs the clang driver with args, args[0] being the clang executable
+int InProcessClang::run(const vector<string>& args) const {
+  vector<const char*> argv;
+  for (auto& arg : args)
+    argv.push_back(arg.c_str());
+  argv.push_back(nullptr);
+  cout.flush();
+  return run_(static_cast<int>(args.size()), argv.data());
+}
+
+#endif  // SRC_HIPBIN_INPROCESS_H_
@@ -0,0 +1,145 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_JOBSERVER_H_
+#define SRC_HIPBIN_JOBSERVER_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#endif
+
+# define MAKEFLAGS                  "MAKEFLAGS"
+
+/**
+ * @brief Client side of the GNU make jobserver.
+ *
+ * hipcc always owns one implicit job slot. Additional slots are taken from
+ * the jobserver without blocking and must be given back with release().
+ * Without a jobserver the number of cores is used.
+ */
+class JobServer {
+ public:
+  JobServer();
+  ~JobServer();
+  bool isAvailable() const;
+  int acquire(int maxSlots);
+  void release();
+  static int getNumCores();
+
+ private:
+  int readFd_ = -1;
+  int writeFd_ = -1;
+  bool ownFds_ = false;
+  string tokens_;
+  void parseMakeFlags(const string& makeFlags);
+};
+
+JobServer::JobServer() {
+  if (const char* makeFlags = HipBinUtil::getInstance()->getEnv(MAKEFLAGS))
+    parseMakeFlags(makeFlags);
+}
+
+JobServer::~JobServer() {
+  release();
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (ownFds_) {
+    if (readFd_ >= 0)
+      close(readFd_);
+    if (writeFd_ >= 0 && writeFd_ != readFd_)
+      close(writeFd_);
+  }
+#endif
+}
+
+// finds --jobserver-auth=R,W, --jobserver-fds=R,W or
+// --jobserver-auth=fifo:PATH in MAKEFLAGS
+void JobServer::parseMakeFlags(const string& makeFlags) {
+#if !defined(_WIN32) && !defined(_WIN64)
+  smatch m;
+  if (regex_search(makeFlags, m,
+                   regex("--jobserver-(auth|fds)=fifo:([^ ]+)"))) {
+    readFd_ = open(m[2].str().c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    writeFd_ = readFd_;
+    ownFds_ = true;
+  } else if (regex_search(makeFlags, m,
+                          regex("--jobserver-(auth|fds)=([0-9]+),([0-9]+)"))) {
+    int readFd = stoi(m[2].str());
+    int writeFd = stoi(m[3].str());
+    // make only passes the pipe to recipes marked with '+'
+    if (fcntl(readFd, F_GETFD) < 0 || fcntl(writeFd, F_GETFD) < 0)
+      return;
+    // reopen the read side so O_NONBLOCK does not leak into the shared
+    // file description used by make and its other children
+    string readPath = "/proc/self/fd/" + std::to_string(readFd);
+    readFd_ = open(readPath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (readFd_ < 0)
+      return;
+    writeFd_ = dup(writeFd);
+    ownFds_ = true;
+  }
+#endif
+}
+
+bool JobServer::isAvailable() const {
+  return readFd_ >= 0 && writeFd_ >= 0;
+}
+
+// returns the number of job slots available to hipcc, at most maxSlots.
+// The implicit slot is always included.
+int JobServer::acquire(int maxSlots) {
+  if (maxSlots < 1)
+    maxSlots = 1;
+  if (!isAvailable())
+    return std::min(maxSlots, getNumCores());
+#if !defined(_WIN32) && !defined(_WIN64)
+  while (static_cast<int>(tokens_.size()) + 1 < maxSlots) {
+    char token;
+    if (read(readFd_, &token, 1) != 1)
+      break;
+    tokens_ += token;
+  }
+#endif
+  return static_cast<int>(tokens_.size()) + 1;
+}
+
+// gives all acquired tokens back to the jobserver
+void JobServer::release() {
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (!tokens_.empty() && writeFd_ >= 0) {
+    ssize_t written = write(writeFd_, tokens_.data(), tokens_.size());
+    (void)written;
+  }
+#endif
+  tokens_.clear();
+}
+
+int JobServer::getNumCores() {
+  unsigned int cores = std::thread::hardware_concurrency();
+  return cores == 0 ? 1 : static_cast<int>(cores);
+}
+
+#endif  // SRC_HIPBIN_JOBSERVER_H_
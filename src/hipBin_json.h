@@ -0,0 +1,415 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_JSON_H_
+#define SRC_HIPBIN_JSON_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+enum JsonType {
+  jsonNull = 0,
+  jsonBool,
+  jsonNumber,
+  jsonString,
+  jsonArray,
+  jsonObject
+};
+
+/**
+ * @brief Minimal JSON value used for the hipcc machine readable inputs and
+ * outputs (trace files, job lists, worker requests, query results).
+ * Object members keep their insertion order.
+ */
+class JsonValue {
+ public:
+  JsonType type = jsonNull;
+  bool boolValue = false;
+  double numberValue = 0;
+  string stringValue;
+  vector<JsonValue> items;
+  vector<std::pair<string, JsonValue>> members;
+
+  JsonValue() {}
+  JsonValue(bool value) : type(jsonBool), boolValue(value) {}
+  JsonValue(int value) : type(jsonNumber), numberValue(value) {}
+  JsonValue(long value) : type(jsonNumber), numberValue(value) {}
+  JsonValue(long long value) : type(jsonNumber), numberValue(value) {}
+  JsonValue(unsigned long value) : type(jsonNumber), numberValue(value) {}
+  JsonValue(unsigned long long value) : type(jsonNumber),
+                                         numberValue(value) {}
+  JsonValue(double value) : type(jsonNumber), numberValue(value) {}
+  JsonValue(const char* value) : type(jsonString), stringValue(value) {}
+  JsonValue(const string& value) : type(jsonString), stringValue(value) {}
+
+  static JsonValue array() {
+    JsonValue value;
+    value.type = jsonArray;
+    return value;
+  }
+  static JsonValue object() {
+    JsonValue value;
+    value.type = jsonObject;
+    return value;
+  }
+
+  bool isNull() const { return type == jsonNull; }
+  bool isString() const { return type == jsonString; }
+  bool isNumber() const { return type == jsonNumber; }
+  bool isArray() const { return type == jsonArray; }
+  bool isObject() const { return type == jsonObject; }
+
+  // returns the member with the given key or nullptr
+  const JsonValue* find(const string& key) const {
+    for (auto& member : members) {
+      if (member.first == key)
+        return &member.second;
+    }
+    return nullptr;
+  }
+  string getString(const string& key, const string& defaultValue = "") const {
+    const JsonValue* value = find(key);
+    return (value && value->isString()) ? value->stringValue : defaultValue;
+  }
+  double getNumber(const string& key, double defaultValue = 0) const {
+    const JsonValue* value = find(key);
+    return (value && value->isNumber()) ? value->numberValue : defaultValue;
+  }
+
+  // sets (or replaces) an object member
+  JsonValue& set(const string& key, const JsonValue& value) {
+    type = jsonObject;
+    for (auto& member : members) {
+      if (member.first == key) {
+        member.second = value;
+        return member.second;
+      }
+    }
+    members.push_back({key, value});
+    return members.back().second;
+  }
+  // appends an array item
+  JsonValue& push(const JsonValue& value) {
+    type = jsonArray;
+    items.push_back(value);
+    return items.back();
+  }
+
+  string dump(int indent = -1) const;
+  static bool parse(const string& text, JsonValue& result,
+                    string* error = nullptr);
+  static string escape(const string& str);
+
+ private:
+  void dump(string& out, int indent, int level) const;
+};
+
+// returns the quoted JSON string literal for str
+string JsonValue::escape(const string& str) {
+  string out = "\"";
+  for (unsigned char c : str) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    case '\b': out += "\\b"; break;
+    case '\f': out += "\\f"; break;
+    default:
+      if (c < 0x20) {
+        char buffer[8];
+        snprintf(buffer, sizeof buffer, "\\u%04x", c);
+        out += buffer;
+      } else {
+        out += static_cast<char>(c);
+      }
+    }
+  }
+  out += "\"";
+  return out;
+}
+
+// serializes the value, compact if indent < 0
+string JsonValue::dump(int indent) const {
+  string out;
+  dump(out, indent, 0);
+  return out;
+}
+
+void JsonValue::dump(string& out, int indent, int level) const {
+  string newline, pad, padInner;
+  if (indent >= 0) {
+    newline = "\n";
+    pad = string(indent * level, ' ');
+    padInner = string(indent * (level + 1), ' ');
+  }
+  switch (type) {
+  case jsonNull:
+    out += "null";
+    break;
+  case jsonBool:
+    out += boolValue ? "true" : "false";
+    break;
+  case jsonNumber: {
+    char buffer[32];
+    if (numberValue == static_cast<long long>(numberValue)) {
+      snprintf(buffer, sizeof buffer, "%lld",
+               static_cast<long long>(numberValue));
+    } else {
+      snprintf(buffer, sizeof buffer, "%.17g", numberValue);
+    }
+    out += buffer;
+    break;
+  }
+  case jsonString:
+    out += escape(stringValue);
+    break;
+  case jsonArray:
+    if (items.empty()) {
+      out += "[]";
+      break;
+    }
+    out += "[" + newline;
+    for (size_t i = 0; i < items.size(); i++) {
+      out += padInner;
+      items.at(i).dump(out, indent, level + 1);
+      out += (i + 1 < items.size() ? "," : "") + newline;
+    }
+    out += pad + "]";
+    break;
+  case jsonObject:
+    if (members.empty()) {
+      out += "{}";
+      break;
+    }
+    out += "{" + newline;
+    for (size_t i = 0; i < members.size(); i++) {
+      out += padInner + escape(members.at(i).first) +
+             (indent >= 0 ? ": " : ":");
+      members.at(i).second.dump(out, indent, level + 1);
+      out += (i + 1 < members.size() ? "," : "") + newline;
+    }
+    out += pad + "}";
+    break;
+  }
+}
+
+/**
+ * @brief Recursive descent parser behind JsonValue::parse
+ */
+class JsonParser {
+ public:
+  explicit JsonParser(const string& text) : text_(text) {}
+  bool parse(JsonValue& result) {
+    if (!parseValue(result, 0))
+      return false;
+    skipSpace();
+    if (pos_ != text_.size())
+      return fail("trailing characters");
+    return true;
+  }
+  const string& getError() const { return error_; }
+
+ private:
+  const string& text_;
+  size_t pos_ = 0;
+  string error_;
+
+  bool fail(const string& message) {
+    if (error_.empty())
+      error_ = message + " at offset " + std::to_string(pos_);
+    return false;
+  }
+  void skipSpace() {
+    while (pos_ < text_.size() && isspace(
+           static_cast<unsigned char>(text_.at(pos_))))
+      pos_++;
+  }
+  bool consume(char c) {
+    skipSpace();
+    if (pos_ < text_.size() && text_.at(pos_) == c) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+  bool parseLiteral(const char* literal) {
+    size_t len = strlen(literal);
+    if (text_.compare(pos_, len, literal) != 0)
+      return fail("invalid literal");
+    pos_ += len;
+    return true;
+  }
+  static void appendUtf8(string& out, unsigned int code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xc0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xe0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+  bool parseHex4(unsigned int& code) {
+    if (pos_ + 4 > text_.size())
+      return fail("truncated escape");
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+      char c = text_.at(pos_++);
+      code <<= 4;
+      if (c >= '0' && c <= '9') code |= c - '0';
+      else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+      else
+        return fail("invalid escape");
+    }
+    return true;
+  }
+  bool parseString(string& out) {
+    if (!consume('"'))
+      return fail("expected string");
+    while (pos_ < text_.size()) {
+      char c = text_.at(pos_++);
+      if (c == '"')
+        return true;
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos_ >= text_.size())
+        break;
+      char e = text_.at(pos_++);
+      switch (e) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '/': out += '/'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        unsigned int code;
+        if (!parseHex4(code))
+          return false;
+        // combine surrogate pairs
+        if (code >= 0xd800 && code < 0xdc00 &&
+            text_.compare(pos_, 2, "\\u") == 0) {
+          pos_ += 2;
+          unsigned int low;
+          if (!parseHex4(low))
+            return false;
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+        appendUtf8(out, code);
+        break;
+      }
+      default:
+        return fail("invalid escape");
+      }
+    }
+    return fail("unterminated string");
+  }
+  bool parseValue(JsonValue& value, int depth) {
+    if (depth > 512)
+      return fail("nesting too deep");
+    skipSpace();
+    if (pos_ >= text_.size())
+      return fail("unexpected end of input");
+    char c = text_.at(pos_);
+    if (c == '{') {
+      pos_++;
+      value = JsonValue::object();
+      if (consume('}'))
+        return true;
+      do {
+        string key;
+        skipSpace();
+        if (!parseString(key))
+          return false;
+        if (!consume(':'))
+          return fail("expected ':'");
+        JsonValue member;
+        if (!parseValue(member, depth + 1))
+          return false;
+        value.members.push_back({key, member});
+      } while (consume(','));
+      return consume('}') ? true : fail("expected '}'");
+    } else if (c == '[') {
+      pos_++;
+      value = JsonValue::array();
+      if (consume(']'))
+        return true;
+      do {
+        JsonValue item;
+        if (!parseValue(item, depth + 1))
+          return false;
+        value.items.push_back(item);
+      } while (consume(','));
+      return consume(']') ? true : fail("expected ']'");
+    } else if (c == '"') {
+      value = JsonValue("");
+      return parseString(value.stringValue);
+    } else if (c == 't') {
+      value = JsonValue(true);
+      return parseLiteral("true");
+    } else if (c == 'f') {
+      value = JsonValue(false);
+      return parseLiteral("false");
+    } else if (c == 'n') {
+      value = JsonValue();
+      return parseLiteral("null");
+    }
+    const char* start = text_.c_str() + pos_;
+    char* end = nullptr;
+    double number = strtod(start, &end);
+    if (end == start)
+      return fail("unexpected character");
+    pos_ += end - start;
+    value = JsonValue(number);
+    return true;
+  }
+};
+
+// parses text into result, on failure the reason is stored in error
+bool JsonValue::parse(const string& text, JsonValue& result, string* error) {
+  JsonParser parser(text);
+  if (parser.parse(result))
+    return true;
+  if (error)
+    *error = parser.getError();
+  return false;
+}
+
+#endif  // SRC_HIPBIN_JSON_H_
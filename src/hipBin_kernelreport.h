@@ -0,0 +1,553 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_KERNELREPORT_H_
+#define SRC_HIPBIN_KERNELREPORT_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include <vector>
+#include <string>
+#include <cstring>
+#include <iomanip>
+
+# define HIPCC_BUNDLE_MAGIC         "__CLANG_OFFLOAD_BUNDLE__"
+# define HIPCC_COMPRESSED_MAGIC     "CCOB"
+# define HIPCC_FATBIN_SECTION       ".hip_fatbin"
+# define HIPCC_KERNEL_REPORT_EXT    ".kernels.json"
+# define ELF_EM_AMDGPU              224
+# define ELF_SHT_NOTE               7
+# define NT_AMDGPU_METADATA         32
+
+/**
+ * @brief Reader for MessagePack data, as used by the AMDGPU metadata note.
+ * Maps become JSON objects (non string keys are dumped as JSON), binary and
+ * extension data become strings.
+ */
+class MsgPackReader {
+ public:
+  MsgPackReader(const string& data, size_t pos, size_t end)
+      : data_(data), pos_(pos), end_(end) {}
+  bool read(JsonValue& value, int depth = 0);
+
+ private:
+  const string& data_;
+  size_t pos_, end_;
+  bool readUInt(int bytes, uint64_t& value);
+  bool readString(size_t size, string& value);
+};
+
+// big endian unsigned integer of the given size
+bool MsgPackReader::readUInt(int bytes, uint64_t& value) {
+  if (end_ - pos_ < static_cast<size_t>(bytes))
+    return false;
+  value = 0;
+  for (int i = 0; i < bytes; i++)
+    value = (value << 8) | static_cast<unsigned char>(data_[pos_++]);
+  return true;
+}
+
+bool MsgPackReader::readString(size_t size, string& value) {
+  if (end_ - pos_ < size)
+    return false;
+  value = data_.substr(pos_, size);
+  pos_ += size;
+  return true;
+}
+
+bool MsgPackReader::read(JsonValue& value, int depth) {
+  if (pos_ >= end_ || depth > 64)
+    return false;
+  unsigned char type = static_cast<unsigned char>(data_[pos_++]);
+  uint64_t size = 0;
+  bool isMap = false, isArray = false, isString = false;
+  if (type <= 0x7f) {
+    value = JsonValue(static_cast<long long>(type));
+    return true;
+  } else if (type >= 0xe0) {
+    value = JsonValue(static_cast<long long>(static_cast<int8_t>(type)));
+    return true;
+  } else if (type >= 0x80 && type <= 0x8f) {
+    isMap = true;
+    size = type & 0x0f;
+  } else if (type >= 0x90 && type <= 0x9f) {
+    isArray = true;
+    size = type & 0x0f;
+  } else if (type >= 0xa0 && type <= 0xbf) {
+    isString = true;
+    size = type & 0x1f;
+  } else {
+    switch (type) {
+    case 0xc0:
+      value = JsonValue();
+      return true;
+    case 0xc2:
+    case 0xc3:
+      value = JsonValue(type == 0xc3);
+      return true;
+    case 0xc4: case 0xc5: case 0xc6:  // bin
+    case 0xd9: case 0xda: case 0xdb:  // str
+      isString = true;
+      if (!readUInt(1 << ((type - (type >= 0xd9 ? 0xd9 : 0xc4))), size))
+        return false;
+      break;
+    case 0xc7: case 0xc8: case 0xc9: {  // ext
+      uint64_t extType;
+      if (!readUInt(1 << (type - 0xc7), size) || !readUInt(1, extType))
+        return false;
+      isString = true;
+      break;
+    }
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8: {  // fixext
+      uint64_t extType;
+      if (!readUInt(1, extType))
+        return false;
+      isString = true;
+      size = 1ULL << (type - 0xd4);
+      break;
+    }
+    case 0xca: case 0xcb: {
+      uint64_t bits;
+      if (!readUInt(type == 0xca ? 4 : 8, bits))
+        return false;
+      if (type == 0xca) {
+        uint32_t bits32 = static_cast<uint32_t>(bits);
+        float number;
+        memcpy(&number, &bits32, sizeof number);
+        value = JsonValue(static_cast<double>(number));
+      } else {
+        double number;
+        memcpy(&number, &bits, sizeof number);
+        value = JsonValue(number);
+      }
+      return true;
+    }
+    case 0xcc: case 0xcd: case 0xce: case 0xcf: {
+      uint64_t number;
+      if (!readUInt(1 << (type - 0xcc), number))
+        return false;
+      value = JsonValue(static_cast<unsigned long long>(number));
+      return true;
+    }
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+      int bytes = 1 << (type - 0xd0);
+      uint64_t number;
+      if (!readUInt(bytes, number))
+        return false;
+      // sign extend
+      if (bytes < 8 && (number >> (bytes * 8 - 1)) & 1)
+        number |= ~0ULL << (bytes * 8);
+      value = JsonValue(static_cast<long long>(number));
+      return true;
+    }
+    case 0xdc: case 0xdd:
+      isArray = true;
+      if (!readUInt(type == 0xdc ? 2 : 4, size))
+        return false;
+      break;
+    case 0xde: case 0xdf:
+      isMap = true;
+      if (!readUInt(type == 0xde ? 2 : 4, size))
+        return false;
+      break;
+    default:
+      return false;
+    }
+  }
+  if (isString) {
+    string str;
+    if (!readString(size, str))
+      return false;
+    value = JsonValue(str);
+  } else if (isArray) {
+    value = JsonValue::array();
+    for (uint64_t i = 0; i < size; i++) {
+      JsonValue item;
+      if (!read(item, depth + 1))
+        return false;
+      value.push(item);
+    }
+  } else if (isMap) {
+    value = JsonValue::object();
+    for (uint64_t i = 0; i < size; i++) {
+      JsonValue key, item;
+      if (!read(key, depth + 1) || !read(item, depth + 1))
+        return false;
+      value.members.push_back({key.isString() ? key.stringValue : key.dump(),
+                               item});
+    }
+  }
+  return true;
+}
+
+// register and LDS limits of an arch, after AMDGPUBaseInfo of LLVM
+struct AmdgpuLimits {
+  int maxWaves = 10;       // waves per SIMD
+  int vgprs = 256;         // per SIMD lane, for the kernel's wave size
+  int vgprGranule = 4;
+  int sgprs = 800;         // 0 where SGPRs don't limit the occupancy
+  int sgprGranule = 16;
+  int ldsBytes = 65536;    // per CU (per WGP in CU mode on gfx10+)
+  int simdsPerCU = 4;
+};
+
+/**
+ * @brief Kernel resource usage of the AMDGPU code objects in a file
+ * (hipcc --kernel-report).
+ *
+ * The file may be a host object or executable with a .hip_fatbin section,
+ * a clang offload bundle, or a code object. The NT_AMDGPU_METADATA note of
+ * every code object is decoded, and for each kernel the registers, LDS,
+ * scratch, spills and wavefront size are reported with the occupancy (waves
+ * per SIMD) these resources allow.
+ */
+class KernelReport {
+ public:
+  bool load(const string& path);
+  const string& getError() const;
+  void print() const;
+  JsonValue toJson() const;
+  bool writeJson(const string& path) const;
+  const JsonValue& getKernels() const;
+  static AmdgpuLimits getLimits(const string& arch, int wavefrontSize);
+  static int getOccupancy(const JsonValue& kernel, const string& arch);
+
+ private:
+  string path_, error_;
+  JsonValue kernels_ = JsonValue::array();
+  int numCodeObjects_ = 0;
+  bool readBundle(const string& data, size_t offset, size_t size);
+  bool readCodeObject(const string& data, size_t offset, size_t size);
+  static bool findSection(const string& data, const string& name,
+                          size_t& offset, size_t& size);
+  static uint64_t readLE(const string& data, size_t pos, int bytes);
+};
+
+const string& KernelReport::getError() const {
+  return error_;
+}
+
+const JsonValue& KernelReport::getKernels() const {
+  return kernels_;
+}
+
+uint64_t KernelReport::readLE(const string& data, size_t pos, int bytes) {
+  uint64_t value = 0;
+  if (pos + bytes > data.size())
+    return 0;
+  for (int i = bytes - 1; i >= 0; i--)
+    value = (value << 8) | static_cast<unsigned char>(data[pos + i]);
+  return value;
+}
+
+// finds a section of a 64-bit little endian ELF file by name
+bool KernelReport::findSection(const string& data, const string& name,
+                               size_t& offset, size_t& size) {
+  if (data.size() < 64 || data.compare(0, 4, "\x7f" "ELF") != 0 ||
+      data[4] != 2 || data[5] != 1)
+    return false;
+  uint64_t shoff = readLE(data, 0x28, 8);
+  uint64_t shentsize = readLE(data, 0x3a, 2);
+  uint64_t shnum = readLE(data, 0x3c, 2);
+  uint64_t shstrndx = readLE(data, 0x3e, 2);
+  // the offsets and sizes of the file are checked by subtraction, so that
+  // they cannot overflow
+  if (shentsize < 64 || shstrndx >= shnum || shoff > data.size() ||
+      shnum * shentsize > data.size() - shoff)
+    return false;
+  uint64_t strOffset = readLE(data, shoff + shstrndx * shentsize + 0x18, 8);
+  if (strOffset >= data.size())
+    return false;
+  for (uint64_t i = 0; i < shnum; i++) {
+    size_t header = shoff + i * shentsize;
+    size_t nameOffset = strOffset + readLE(data, header, 4);
+    if (nameOffset < data.size() &&
+        data.compare(nameOffset, name.size() + 1,
+                     name.c_str(), name.size() + 1) == 0) {
+      offset = readLE(data, header + 0x18, 8);
+      size = readLE(data, header + 0x20, 8);
+      return offset <= data.size() && size <= data.size() - offset;
+    }
+  }
+  return false;
+}
+
+// reads the code objects of the offload bundles in the file
+bool KernelReport::load(const string& path) {
+  path_ = path;
+  ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    error_ = "unable to read " + path;
+    return false;
+  }
+  stringstream buffer;
+  buffer << in.rdbuf();
+  string data = buffer.str();
+  size_t offset = 0, size = data.size();
+  if (data.compare(0, 4, "\x7f" "ELF") == 0 &&
+      readLE(data, 0x12, 2) == ELF_EM_AMDGPU)
+    return readCodeObject(data, 0, data.size());
+  if (findSection(data, HIPCC_FATBIN_SECTION, offset, size)) {
+    data = data.substr(offset, size);
+    offset = 0;
+    size = data.size();
+  }
+  // the section (or file) holds one or more bundles, each page aligned
+  const string magic = HIPCC_BUNDLE_MAGIC;
+  size_t pos = data.find(magic);
+  if (pos == string::npos) {
+    error_ = data.find(HIPCC_COMPRESSED_MAGIC) != string::npos ?
+             "compressed offload bundles are not supported" :
+             "no offload bundle found";
+    return false;
+  }
+  while (pos != string::npos) {
+    readBundle(data, pos, size - pos);
+    pos = data.find(magic, pos + magic.size());
+  }
+  if (numCodeObjects_ == 0 && error_.empty())
+    error_ = "no code objects (device bitcode of -fgpu-rdc?)";
+  return numCodeObjects_ > 0;
+}
+
+// __CLANG_OFFLOAD_BUNDLE__, number of entries, then per entry offset, size,
+// id length and id
+bool KernelReport::readBundle(const string& data, size_t offset,
+                              size_t size) {
+  size_t end = offset + size;
+  size_t pos = offset + strlen(HIPCC_BUNDLE_MAGIC);
+  if (end > data.size() || pos + 8 > end)
+    return false;
+  uint64_t numEntries = readLE(data, pos, 8);
+  pos += 8;
+  for (uint64_t i = 0; i < numEntries && end - pos >= 24; i++) {
+    uint64_t entryOffset = readLE(data, pos, 8);
+    uint64_t entrySize = readLE(data, pos + 8, 8);
+    uint64_t idSize = readLE(data, pos + 16, 8);
+    pos += 24;
+    // checked by subtraction, the values are untrusted
+    if (idSize > end - pos || entryOffset > size ||
+        entrySize > size - entryOffset)
+      return false;
+    string id = data.substr(pos, idSize);
+    pos += idSize;
+    if (id.compare(0, 4, "host") != 0 && entrySize > 0)
+      readCodeObject(data, offset + entryOffset, entrySize);
+  }
+  return true;
+}
+
+// decodes the NT_AMDGPU_METADATA notes of a code object
+bool KernelReport::readCodeObject(const string& data, size_t offset,
+                                  size_t size) {
+  string object = data.substr(offset, size);
+  if (object.size() < 64 || object.compare(0, 4, "\x7f" "ELF") != 0 ||
+      readLE(object, 0x12, 2) != ELF_EM_AMDGPU)
+    return false;
+  numCodeObjects_++;
+  uint64_t shoff = readLE(object, 0x28, 8);
+  uint64_t shentsize = readLE(object, 0x3a, 2);
+  uint64_t shnum = readLE(object, 0x3c, 2);
+  if (shentsize < 64 || shoff > object.size() ||
+      shnum * shentsize > object.size() - shoff)
+    return false;
+  for (uint64_t i = 0; i < shnum; i++) {
+    size_t header = shoff + i * shentsize;
+    if (readLE(object, header + 4, 4) != ELF_SHT_NOTE)
+      continue;
+    size_t pos = readLE(object, header + 0x18, 8);
+    size_t noteSize = readLE(object, header + 0x20, 8);
+    if (pos > object.size() || noteSize > object.size() - pos)
+      continue;
+    size_t end = pos + noteSize;
+    while (pos + 12 <= end) {
+      uint64_t nameSize = readLE(object, pos, 4);
+      uint64_t descSize = readLE(object, pos + 4, 4);
+      uint64_t type = readLE(object, pos + 8, 4);
+      size_t name = pos + 12;
+      size_t desc = name + ((nameSize + 3) & ~3ULL);
+      pos = desc + ((descSize + 3) & ~3ULL);
+      if (desc + descSize > end)
+        break;
+      if (type != NT_AMDGPU_METADATA ||
+          object.compare(name, 6, "AMDGPU") != 0)
+        continue;
+      JsonValue metadata;
+      MsgPackReader reader(object, desc, desc + descSize);
+      if (!reader.read(metadata))
+        continue;
+      string target = metadata.getString("amdhsa.target");
+      smatch match;
+      string arch = regex_search(target, match, regex("gfx[0-9a-z]+.*")) ?
+                    match.str(0) : target;
+      const JsonValue* kernels = metadata.find("amdhsa.kernels");
+      if (!kernels)
+        continue;
+      for (auto& kernel : kernels->items) {
+        JsonValue entry = JsonValue::object();
+        auto number = [&kernel](const string& key) {
+          return static_cast<long long>(kernel.getNumber(key));
+        };
+        entry.set("arch", arch);
+        entry.set("name", kernel.getString(".name"));
+        entry.set("symbol", kernel.getString(".symbol"));
+        entry.set("vgpr_count", number(".vgpr_count"));
+        entry.set("agpr_count", number(".agpr_count"));
+        entry.set("sgpr_count", number(".sgpr_count"));
+        entry.set("lds_bytes", number(".group_segment_fixed_size"));
+        entry.set("scratch_bytes", number(".private_segment_fixed_size"));
+        entry.set("vgpr_spill_count", number(".vgpr_spill_count"));
+        entry.set("sgpr_spill_count", number(".sgpr_spill_count"));
+        entry.set("wavefront_size", number(".wavefront_size"));
+        entry.set("max_flat_workgroup_size",
+                  number(".max_flat_workgroup_size"));
+        const JsonValue* dynamicStack = kernel.find(".uses_dynamic_stack");
+        entry.set("uses_dynamic_stack", dynamicStack &&
+                  dynamicStack->type == jsonBool && dynamicStack->boolValue);
+        entry.set("occupancy", getOccupancy(entry, arch));
+        kernels_.push(entry);
+      }
+    }
+  }
+  return true;
+}
+
+AmdgpuLimits KernelReport::getLimits(const string& arch, int wavefrontSize) {
+  AmdgpuLimits limits;
+  smatch match;
+  string name;
+  if (regex_search(arch, match, regex("gfx(([0-9]+)(-[0-9]+)?)-generic"))) {
+    // a generic target has the limits of the smallest processor it covers
+    static const map<string, string> generic = {
+        {"9", "900"}, {"9-4", "940"}, {"10-1", "1010"}, {"10-3", "1030"},
+        {"11", "1102"}, {"12", "1200"}};
+    auto it = generic.find(match.str(1));
+    name = it != generic.end() ? it->second : match.str(2) + "00";
+  } else {
+    name = regex_search(arch, match, regex("gfx([0-9a-f]+)")) ?
+           match.str(1) : "900";
+  }
+  int major = name.size() > 2 ? stoi(name.substr(0, name.size() - 2)) : 9;
+  bool gfx90aInsts = major == 9 &&
+                     (name == "90a" || name.compare(0, 2, "94") == 0 ||
+                      name.compare(0, 2, "95") == 0);
+  if (gfx90aInsts) {
+    // VGPRs and AGPRs share one file
+    limits.maxWaves = 8;
+    limits.vgprs = 512;
+    limits.vgprGranule = 8;
+  } else if (major >= 10) {
+    bool wave32 = wavefrontSize == 32;
+    bool moreVgprs = name == "1100" || name == "1101" || name == "1151" ||
+                     name == "1200" || name == "1201";
+    limits.maxWaves = major == 10 ? 20 : 16;
+    limits.vgprs = (wave32 ? 1024 : 512) * (moreVgprs ? 3 : 2) / 2;
+    limits.vgprGranule = (wave32 ? 8 : 4) * (moreVgprs ? 3 : 1);
+    limits.sgprs = 0;
+    limits.simdsPerCU = 2;
+  } else if (major < 8) {
+    limits.sgprs = 512;
+    limits.sgprGranule = 8;
+  }
+  if (name == "950")
+    limits.ldsBytes = 163840;
+  return limits;
+}
+
+// waves per SIMD allowed by the VGPRs, SGPRs and LDS of a kernel
+int KernelReport::getOccupancy(const JsonValue& kernel, const string& arch) {
+  int wavefrontSize = static_cast<int>(kernel.getNumber("wavefront_size"));
+  if (wavefrontSize <= 0)
+    wavefrontSize = 64;
+  AmdgpuLimits limits = getLimits(arch, wavefrontSize);
+  auto alignTo = [](long long value, int granule) {
+    return (std::max(1LL, value) + granule - 1) / granule * granule;
+  };
+  long long waves = limits.maxWaves;
+  long long vgprs = static_cast<long long>(kernel.getNumber("vgpr_count"));
+  waves = std::min(waves, limits.vgprs / alignTo(vgprs, limits.vgprGranule));
+  if (limits.sgprs > 0) {
+    long long sgprs = static_cast<long long>(kernel.getNumber("sgpr_count"));
+    waves = std::min(waves, limits.sgprs /
+                            alignTo(sgprs, limits.sgprGranule));
+  }
+  long long lds = static_cast<long long>(kernel.getNumber("lds_bytes"));
+  if (lds > 0) {
+    long long groupSize = static_cast<long long>(
+                          kernel.getNumber("max_flat_workgroup_size", 1024));
+    long long wavesPerGroup = (std::max(1LL, groupSize) + wavefrontSize - 1) /
+                              wavefrontSize;
+    long long groups = limits.ldsBytes / lds;
+    waves = std::min(waves, groups * wavesPerGroup / limits.simdsPerCU);
+  }
+  return static_cast<int>(std::max(0LL, waves));
+}
+
+JsonValue KernelReport::toJson() const {
+  JsonValue report = JsonValue::object();
+  std::error_code ec;
+  report.set("schema", 1);
+  report.set("file", fs::absolute(path_, ec).string());
+  report.set("kernels", kernels_);
+  return report;
+}
+
+bool KernelReport::writeJson(const string& path) const {
+  ofstream out(path);
+  if (!out.is_open())
+    return false;
+  out << toJson().dump(1) << "\n";
+  return static_cast<bool>(out);
+}
+
+// one line per kernel and arch
+void KernelReport::print() const {
+  cout << "hipcc: kernel resources of " << path_ << "\n";
+  cout << std::left << std::setw(16) << "arch" << std::right
+       << std::setw(6) << "VGPR" << std::setw(6) << "AGPR"
+       << std::setw(6) << "SGPR" << std::setw(8) << "LDS"
+       << std::setw(9) << "scratch" << std::setw(8) << "spills"
+       << std::setw(6) << "wave" << std::setw(6) << "occ"
+       << "  kernel\n";
+  for (auto& kernel : kernels_.items) {
+    auto number = [&kernel](const string& key) {
+      return static_cast<long long>(kernel.getNumber(key));
+    };
+    string spills = std::to_string(number("vgpr_spill_count")) + "/" +
+                    std::to_string(number("sgpr_spill_count"));
+    string scratch = std::to_string(number("scratch_bytes"));
+    if (kernel.find("uses_dynamic_stack")->boolValue)
+      scratch += "+";
+    cout << std::left << std::setw(16) << kernel.getString("arch")
+         << std::right << std::setw(6) << number("vgpr_count")
+         << std::setw(6) << number("agpr_count")
+         << std::setw(6) << number("sgpr_count")
+         << std::setw(8) << number("lds_bytes")
+         << std::setw(9) << scratch << std::setw(8) << spills
+         << std::setw(6) << number("wavefront_size")
+         << std::setw(6) << number("occupancy")
+         << "  " << kernel.getString("name") << "\n";
+  }
+  cout.flush();
+}
+
+#endif  // SRC_HIPBIN_KERNELREPORT_H_
@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_LTO_H_
+#define SRC_HIPBIN_LTO_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+
+// Default pruning policy of the ThinLTO cache: prune at most every 20
+// minutes, drop entries unused for a week and keep the cache under 10 GB.
+# define HIPCC_LTO_CACHE_PRUNE_INTERVAL   "20m"
+# define HIPCC_LTO_CACHE_PRUNE_AFTER      "168h"
+# define HIPCC_LTO_CACHE_SIZE             "10g"
+
+enum ThinLtoMode {
+  thinLtoNone = 0,
+  thinLtoHost = 0x1,
+  thinLtoDevice = 0x2,
+  thinLtoAll = thinLtoHost | thinLtoDevice
+};
+
+/**
+ * @brief ThinLTO for host and/or device code with a hipcc managed cache.
+ *
+ * Compile steps emit ThinLTO bitcode, link steps point lld at a cache
+ * directory that is keyed per toolchain, so that relinking after a change
+ * only re-optimizes the modules that changed.
+ */
+class ThinLtoCache {
+ public:
+  ThinLtoCache();
+  bool parseOption(const string& arg);
+  bool isEnabled() const;
+  bool hostEnabled() const;
+  bool deviceEnabled() const;
+  const string& getCacheDir() const;
+  string getPolicy() const;
+  string getCompileFlags(bool device) const;
+  string getLinkFlags(const string& cacheDir, bool device) const;
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  int mode_ = thinLtoNone;
+  string cacheDir_, cacheSize_, policy_;
+};
+
+ThinLtoCache::ThinLtoCache() {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+  cacheSize_ = HIPCC_LTO_CACHE_SIZE;
+}
+
+// handles the --hipcc-thinlto* and --hipcc-lto-cache* options.
+// returns false if the argument is not a ThinLTO option.
+bool ThinLtoCache::parseOption(const string& arg) {
+  if (arg == "--hipcc-thinlto") {
+    mode_ = thinLtoAll;
+  } else if (arg.compare(0, 16, "--hipcc-thinlto=") == 0) {
+    string mode = arg.substr(16);
+    if (mode == "host") {
+      mode_ = thinLtoHost;
+    } else if (mode == "device") {
+      mode_ = thinLtoDevice;
+    } else if (mode == "all") {
+      mode_ = thinLtoAll;
+    } else if (mode == "none") {
+      mode_ = thinLtoNone;
+    } else {
+      cout << "Warning: unknown ThinLTO mode " << mode
+           << ", expected host, device, all or none." << endl;
+    }
+  } else if (arg.compare(0, 22, "--hipcc-lto-cache-dir=") == 0) {
+    cacheDir_ = arg.substr(22);
+  } else if (arg.compare(0, 23, "--hipcc-lto-cache-size=") == 0) {
+    string size = arg.substr(23);
+    if (hipBinUtilPtr_->stringRegexMatch(size, "[0-9]+[kmg]?") ||
+        hipBinUtilPtr_->stringRegexMatch(size, "[0-9]+%")) {
+      cacheSize_ = size;
+    } else {
+      cout << "Warning: invalid ThinLTO cache size " << size
+           << ", expected <bytes>[k|m|g] or <percent>%." << endl;
+    }
+  } else if (arg.compare(0, 25, "--hipcc-lto-cache-policy=") == 0) {
+    policy_ = arg.substr(25);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ThinLtoCache::isEnabled() const {
+  return mode_ != thinLtoNone;
+}
+
+bool ThinLtoCache::hostEnabled() const {
+  return (mode_ & thinLtoHost) != 0;
+}
+
+bool ThinLtoCache::deviceEnabled() const {
+  return (mode_ & thinLtoDevice) != 0;
+}
+
+// user provided cache directory, empty for the default location
+const string& ThinLtoCache::getCacheDir() const {
+  return cacheDir_;
+}
+
+// returns the lld --thinlto-cache-policy value
+string ThinLtoCache::getPolicy() const {
+  if (!policy_.empty())
+    return policy_;
+  string policy = "prune_interval=" HIPCC_LTO_CACHE_PRUNE_INTERVAL
+                  ":prune_after=" HIPCC_LTO_CACHE_PRUNE_AFTER;
+  if (cacheSize_.back() == '%') {
+    policy += ":cache_size=" + cacheSize_;
+  } else {
+    policy += ":cache_size_bytes=" + cacheSize_;
+  }
+  return policy;
+}
+
+// flags for the compile step so that the objects carry ThinLTO bitcode
+string ThinLtoCache::getCompileFlags(bool device) const {
+  string flags;
+  if (hostEnabled())
+    flags += " -flto=thin";
+  if (device && deviceEnabled())
+    flags += " -foffload-lto=thin";
+  return flags;
+}
+
+// flags for the link step. Host and device code use separate
+// subdirectories of the cache as they are linked by different lld flavors.
+string ThinLtoCache::getLinkFlags(const string& cacheDir, bool device) const {
+  string flags;
+  string policy = getPolicy();
+  if (hostEnabled()) {
+    fs::path hostCache = cacheDir;
+    hostCache /= "host";
+    flags += " -flto=thin -fuse-ld=lld";
+    flags += " -Wl,--thinlto-cache-dir=\"" + hostCache.string() + "\"";
+    flags += " -Wl,--thinlto-cache-policy=" + policy;
+  }
+  if (device && deviceEnabled()) {
+    fs::path deviceCache = cacheDir;
+    deviceCache /= "device";
+    flags += " -foffload-lto=thin";
+    flags += " -Xoffload-linker --thinlto-cache-dir=\"" +
+             deviceCache.string() + "\"";
+    flags += " -Xoffload-linker --thinlto-cache-policy=" + policy;
+  }
+  return flags;
+}
+
+#endif  // SRC_HIPBIN_LTO_H_
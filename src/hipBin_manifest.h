@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_MANIFEST_H_
+#define SRC_HIPBIN_MANIFEST_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+
+# define HIPCC_MANIFEST_VERSION     "2"
+# define HIPCC_MANIFEST_EXT         ".hipcc-manifest"
+
+/**
+ * @brief Link manifest stored next to the link output.
+ *
+ * Records the content hashes of all link inputs together with the resolved
+ * link flags and the offload arch set. When a later link produces the same
+ * manifest and the output was not modified in between, the link is skipped.
+ * Libraries named with -l are resolved against the -L directories and the
+ * search directories of the linker, as given to setSearchDirs(); if one
+ * cannot be found the link is never skipped, as a rebuilt library would go
+ * unnoticed.
+ */
+class LinkManifest {
+ public:
+  explicit LinkManifest(const string& output);
+  void addEntry(const string& key, const string& value);
+  void addInput(const string& path);
+  void addInputsFromArgs(const vector<string>& argv);
+  void setSearchDirs(const vector<string>& searchDirs);
+  bool isUpToDate() const;
+  bool write() const;
+  const string& getPath() const;
+  const vector<string>& getUnresolved() const;
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string output_, manifestPath_;
+  map<string, string> entries_;
+  int numInputs_ = 0;
+  vector<string> unresolved_, searchDirs_;
+  string getOutputStamp() const;
+  void addLibrary(const string& name, const vector<string>& libDirs);
+};
+
+LinkManifest::LinkManifest(const string& output) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+  output_ = output.empty() ? "a.out" : output;
+  manifestPath_ = output_ + HIPCC_MANIFEST_EXT;
+  addEntry("version", HIPCC_MANIFEST_VERSION);
+}
+
+// values are stored one per line, so newlines are flattened to spaces.
+// Empty values are dropped as parseConfigFile does not read them back.
+void LinkManifest::addEntry(const string& key, const string& value) {
+  string flat = value;
+  std::replace(flat.begin(), flat.end(), '\n', ' ');
+  std::replace(flat.begin(), flat.end(), '\r', ' ');
+  flat = hipBinUtilPtr_->trim(flat);
+  if (!flat.empty())
+    entries_[key] = flat;
+}
+
+// records the content hash of an input file
+void LinkManifest::addInput(const string& path) {
+  string hash = hipBinUtilPtr_->hashFile(path);
+  if (hash.empty())
+    hash = "missing";
+  addEntry("input" + std::to_string(numInputs_++), hash + " " + path);
+}
+
+// records the library the linker picks for -l<name>: the shared library,
+// else the archive, in the first directory holding one; -l:<file> names the
+// file itself
+void LinkManifest::addLibrary(const string& name,
+                              const vector<string>& libDirs) {
+  vector<string> candidates;
+  if (name.compare(0, 1, ":") == 0) {
+    candidates.push_back(name.substr(1));
+  } else {
+    candidates.push_back("lib" + name + ".so");
+    candidates.push_back("lib" + name + ".a");
+  }
+  vector<string> dirs = libDirs;
+  if (const char* libraryPath = hipBinUtilPtr_->getEnv("LIBRARY_PATH")) {
+    stringstream paths(libraryPath);
+    string dir;
+    while (std::getline(paths, dir, ':')) {
+      if (!dir.empty())
+        dirs.push_back(dir);
+    }
+  }
+  dirs.insert(dirs.end(), searchDirs_.begin(), searchDirs_.end());
+  std::error_code ec;
+  for (auto& dir : dirs) {
+    for (auto& candidate : candidates) {
+      fs::path path = fs::path(dir) / candidate;
+      if (fs::is_regular_file(path, ec)) {
+        addInput(path.string());
+        return;
+      }
+    }
+  }
+  unresolved_.push_back(name);
+}
+
+// the default library directories of the linker, searched after the -L
+// directories; must be set before addInputsFromArgs
+void LinkManifest::setSearchDirs(const vector<string>& searchDirs) {
+  searchDirs_ = searchDirs;
+}
+
+// collects the input files from the hipcc command line: the files given
+// directly, to -Xlinker or -Wl, the files listed in linker response files
+// and the libraries named with -l
+void LinkManifest::addInputsFromArgs(const vector<string>& argv) {
+  string allArgs;
+  vector<string> libDirs, libraries;
+  // the operands hipcc passes on to the linker
+  vector<string> linkerArgs;
+  for (unsigned int i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    allArgs += arg + '\0';
+    if (arg == "-o") {
+      i++;
+      continue;
+    }
+    if ((arg == "-L" || arg == "-l" || arg == "-Xlinker") &&
+        i + 1 < argv.size()) {
+      const string& value = argv.at(++i);
+      allArgs += value + '\0';
+      if (arg == "-L")
+        libDirs.push_back(value);
+      else if (arg == "-l")
+        libraries.push_back(value);
+      else
+        linkerArgs.push_back(value);
+      continue;
+    }
+    if (arg.compare(0, 4, "-Wl,") == 0 && arg.compare(0, 5, "-Wl,@") != 0) {
+      stringstream operands(arg.substr(4));
+      string operand;
+      while (std::getline(operands, operand, ','))
+        linkerArgs.push_back(operand);
+      continue;
+    }
+    if (arg.compare(0, 2, "-L") == 0) {
+      libDirs.push_back(arg.substr(2));
+      continue;
+    }
+    if (arg.compare(0, 2, "-l") == 0) {
+      libraries.push_back(arg.substr(2));
+      continue;
+    }
+    string responseFile;
+    if (arg.compare(0, 5, "-Wl,@") == 0) {
+      responseFile = arg.substr(5);
+    } else if (arg.compare(0, 1, "@") == 0) {
+      responseFile = arg.substr(1);
+    }
+    if (!responseFile.empty()) {
+      addInput(responseFile);
+      ifstream in(responseFile);
+      string line;
+      while (std::getline(in, line)) {
+        line = hipBinUtilPtr_->trim(line);
+        if (!line.empty() && line.at(0) != '-' && fs::is_regular_file(line))
+          addInput(line);
+      }
+    } else if (!arg.empty() && arg.at(0) != '-' &&
+               fs::is_regular_file(arg)) {
+      addInput(arg);
+    }
+  }
+  for (auto& linkerArg : linkerArgs) {
+    if (linkerArg.compare(0, 2, "-L") == 0) {
+      libDirs.push_back(linkerArg.substr(2));
+    } else if (linkerArg.compare(0, 2, "-l") == 0) {
+      libraries.push_back(linkerArg.substr(2));
+    } else if (!linkerArg.empty() && linkerArg.at(0) != '-' &&
+               fs::is_regular_file(linkerArg)) {
+      addInput(linkerArg);
+    }
+  }
+  for (auto& library : libraries)
+    addLibrary(library, libDirs);
+  addEntry("args", hipBinUtilPtr_->hashString(allArgs));
+}
+
+// size and modification time of the output, so that an output which was
+// rebuilt or edited behind hipcc's back is never reused
+string LinkManifest::getOutputStamp() const {
+  std::error_code ec;
+  auto size = fs::file_size(output_, ec);
+  if (ec)
+    return "";
+  auto mtime = fs::last_write_time(output_, ec);
+  if (ec)
+    return "";
+  return std::to_string(size) + ":" +
+         std::to_string(mtime.time_since_epoch().count());
+}
+
+// returns true if the output exists and the stored manifest matches
+bool LinkManifest::isUpToDate() const {
+  if (!unresolved_.empty())
+    return false;
+  string outputStamp = getOutputStamp();
+  if (outputStamp.empty() || !fs::exists(manifestPath_))
+    return false;
+  map<string, string> stored = hipBinUtilPtr_->parseConfigFile(manifestPath_);
+  map<string, string> current = entries_;
+  current["output"] = outputStamp;
+  return stored == current;
+}
+
+// writes the manifest for the current output
+bool LinkManifest::write() const {
+  string outputStamp = getOutputStamp();
+  if (outputStamp.empty())
+    return false;
+  string tmpPath = manifestPath_ + ".tmp";
+  ofstream out(tmpPath);
+  if (!out.is_open())
+    return false;
+  for (auto& entry : entries_) {
+    out << entry.first << "=" << entry.second << "\n";
+  }
+  out << "output=" << outputStamp << "\n";
+  out.close();
+  std::error_code ec;
+  fs::rename(tmpPath, manifestPath_, ec);
+  return !ec;
+}
+
+const string& LinkManifest::getPath() const {
+  return manifestPath_;
+}
+
+// the -l libraries that were not found
+const vector<string>& LinkManifest::getUnresolved() const {
+  return unresolved_;
+}
+
+#endif  // SRC_HIPBIN_MANIFEST_H_
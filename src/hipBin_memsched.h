@@ -0,0 +1,228 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_MEMSCHED_H_
+#define SRC_HIPBIN_MEMSCHED_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+# define HIPCC_MEM_DEFAULT_MB       2048
+# define HIPCC_MEM_MARGIN           1.25
+# define HIPCC_MEM_RETRIES          2
+
+/**
+ * @brief Memory aware scheduler of the hipcc --batch jobs.
+ *
+ * Every job is predicted to need the peak RSS it had the last time it ran
+ * (from the history file in the hipcc cache) plus a margin, or a
+ * conservative default for a new source. A job starts only if its
+ * prediction fits into the smaller of the unreserved budget and the memory
+ * the system currently has available; the budget defaults to MemAvailable
+ * when the batch starts. The job limit (-j) still applies, and a job always
+ * starts when nothing else runs. A job killed for running out of memory is
+ * queued again with a larger prediction and the job limit is halved.
+ */
+class MemoryScheduler {
+ public:
+  MemoryScheduler(int maxJobs, long budgetKb, long defaultKb);
+  void loadHistory(const string& path);
+  bool saveHistory(const string& path) const;
+  void add(size_t job, const string& key);
+  bool acquire(size_t& job);
+  bool release(size_t job, long peakKb, bool outOfMemory);
+  int getMaxJobs() const;
+  long getBudgetKb() const;
+  static long getAvailableKb();
+  static bool isOutOfMemory(const SystemCmdOut& sysOut);
+
+ private:
+  struct Entry {
+    string key;
+    long predictedKb = 0;
+    int retries = 0;
+  };
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  map<size_t, Entry> entries_;
+  std::deque<size_t> queue_;
+  map<string, long> history_;  // peak RSS in KB by source
+  int maxJobs_, running_ = 0;
+  long budgetKb_, defaultKb_, reservedKb_ = 0;
+  long getFreeKb() const;
+  bool fits(const Entry& entry, long freeKb) const;
+};
+
+MemoryScheduler::MemoryScheduler(int maxJobs, long budgetKb, long defaultKb)
+    : maxJobs_(std::max(1, maxJobs)), budgetKb_(budgetKb),
+      defaultKb_(defaultKb) {
+  if (budgetKb_ <= 0)
+    budgetKb_ = getAvailableKb();
+}
+
+// MemAvailable of /proc/meminfo, 0 where it is unknown
+long MemoryScheduler::getAvailableKb() {
+  ifstream meminfo("/proc/meminfo");
+  string line;
+  while (std::getline(meminfo, line)) {
+    if (line.compare(0, 13, "MemAvailable:") == 0)
+      return std::strtol(line.c_str() + 13, nullptr, 10);
+  }
+  return 0;
+}
+
+// killed (by the OOM killer, reported by the shell as 128 + SIGKILL) or
+// failed to allocate memory
+bool MemoryScheduler::isOutOfMemory(const SystemCmdOut& sysOut) {
+  if (sysOut.exitCode == 137)
+    return true;
+  return sysOut.exitCode != 0 &&
+         regex_search(sysOut.out, regex("out of memory|std::bad_alloc|"
+                                        "Cannot allocate memory",
+                                        std::regex::icase));
+}
+
+// reads the "<peak KB> <source>" lines of the history file
+void MemoryScheduler::loadHistory(const string& path) {
+  ifstream in(path);
+  string line;
+  while (std::getline(in, line)) {
+    size_t space = line.find(' ');
+    if (space == string::npos || space == 0 ||
+        line.find_first_not_of("0123456789") != space)
+      continue;
+    history_[line.substr(space + 1)] = std::stol(line.substr(0, space));
+  }
+}
+
+bool MemoryScheduler::saveHistory(const string& path) const {
+  string tmpPath = path + ".tmp";
+  {
+    ofstream out(tmpPath);
+    if (!out.is_open())
+      return false;
+    for (auto& entry : history_)
+      out << entry.second << " " << entry.first << "\n";
+    if (!out)
+      return false;
+  }
+  std::error_code ec;
+  fs::rename(tmpPath, path, ec);
+  return !ec;
+}
+
+// queues a job; key identifies its source in the history
+void MemoryScheduler::add(size_t job, const string& key) {
+  Entry entry;
+  entry.key = key;
+  auto it = history_.find(key);
+  entry.predictedKb = it != history_.end() ?
+                      static_cast<long>(it->second * HIPCC_MEM_MARGIN) :
+                      defaultKb_;
+  entries_[job] = entry;
+  // the biggest jobs first, so that they don't end the batch alone
+  auto pos = std::find_if(queue_.begin(), queue_.end(), [&](size_t other) {
+    return entries_.at(other).predictedKb < entry.predictedKb;
+  });
+  queue_.insert(pos, job);
+}
+
+// the smaller of the unreserved budget and the available memory
+long MemoryScheduler::getFreeKb() const {
+  long freeKb = budgetKb_ - reservedKb_;
+  long availableKb = getAvailableKb();
+  if (availableKb > 0)
+    freeKb = std::min(freeKb, availableKb);
+  return freeKb;
+}
+
+bool MemoryScheduler::fits(const Entry& entry, long freeKb) const {
+  if (running_ == 0)
+    return true;
+  if (running_ >= maxJobs_)
+    return false;
+  if (budgetKb_ <= 0)
+    return true;
+  return entry.predictedKb <= freeKb;
+}
+
+// waits for a queued job that fits and reserves its memory; returns false
+// once all jobs are done
+bool MemoryScheduler::acquire(size_t& job) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (queue_.empty() && running_ == 0)
+      return false;
+    // the available memory is read once per pass over the queue, and only
+    // if it can decide
+    long freeKb = 0;
+    if (!queue_.empty() && running_ > 0 && running_ < maxJobs_ &&
+        budgetKb_ > 0)
+      freeKb = getFreeKb();
+    for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+      Entry& entry = entries_.at(*it);
+      if (fits(entry, freeKb)) {
+        job = *it;
+        queue_.erase(it);
+        running_++;
+        reservedKb_ += entry.predictedKb;
+        return true;
+      }
+    }
+    // other processes may free memory, so check again now and then
+    cond_.wait_for(lock, std::chrono::seconds(1));
+  }
+}
+
+// ends a job. Returns true if it ran out of memory and was queued again.
+bool MemoryScheduler::release(size_t job, long peakKb, bool outOfMemory) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_.at(job);
+  running_--;
+  reservedKb_ -= entry.predictedKb;
+  bool retry = outOfMemory && entry.retries < HIPCC_MEM_RETRIES;
+  if (retry) {
+    entry.retries++;
+    entry.predictedKb = std::max(peakKb, entry.predictedKb * 2);
+    maxJobs_ = std::max(1, std::min(maxJobs_, running_ + 1) / 2);
+    queue_.push_front(job);
+  } else if (!outOfMemory && peakKb > 0) {
+    history_[entry.key] = peakKb;
+  }
+  cond_.notify_all();
+  return retry;
+}
+
+int MemoryScheduler::getMaxJobs() const {
+  return maxJobs_;
+}
+
+long MemoryScheduler::getBudgetKb() const {
+  return budgetKb_;
+}
+
+#endif  // SRC_HIPBIN_MEMSCHED_H_
@@ -0,0 +1,306 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_PGO_H_
+#define SRC_HIPBIN_PGO_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+
+# define HIPCC_PGO_PROFILE          "merged.profdata"
+# define HIPCC_PGO_RAW_DIR          "raw"
+# define HIPCC_PGO_SOURCES_DIR      "sources"
+
+enum HostPgoMode {
+  hostPgoNone = 0,
+  hostPgoGenerate,
+  hostPgoUse
+};
+
+/**
+ * @brief Host profile guided optimization with a hipcc managed profile
+ * directory (--hipcc-pgo-gen, --hipcc-pgo-use).
+ *
+ * The generate build instruments the host code, writing the raw profiles of
+ * the training runs to <dir>/raw, and records the content hash of every
+ * instrumented source in <dir>/sources. The use build merges the raw
+ * profiles into <dir>/merged.profdata with the llvm-profdata of the clang
+ * hipcc found, whenever a raw profile is newer than the merged one, and
+ * compiles the host code with it. A source that changed since it was
+ * instrumented, or was instrumented again after the last training run, is
+ * compiled without the profile. Device code is not profiled.
+ */
+class HostPgo {
+ public:
+  HostPgo();
+  bool parseOption(const string& arg);
+  bool isEnabled() const;
+  bool setDir(const string& defaultDir);
+  const string& getDir() const;
+  string getCompileFlag(const vector<string>& inputs,
+                        const string& clangPath, int verbose);
+  string getLinkFlags(bool lto, const string& clangPath, int verbose);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  int mode_ = hostPgoNone;
+  string dir_;
+  bool merged_ = false;
+  fs::path getRawDir() const;
+  fs::path getProfile() const;
+  fs::path getSourceRecord(const string& source) const;
+  static bool isSource(const string& input);
+  bool merge(const string& clangPath, int verbose);
+  bool isStale(const string& source, string* reason) const;
+};
+
+HostPgo::HostPgo() {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+// handles --hipcc-pgo-gen[=<dir>] and --hipcc-pgo-use[=<dir>].
+// returns false if the argument is not a PGO option.
+bool HostPgo::parseOption(const string& arg) {
+  if (arg.size() > 15 && arg[15] != '=')
+    return false;
+  if (arg.compare(0, 15, "--hipcc-pgo-gen") == 0) {
+    mode_ = hostPgoGenerate;
+  } else if (arg.compare(0, 15, "--hipcc-pgo-use") == 0) {
+    mode_ = hostPgoUse;
+  } else {
+    return false;
+  }
+  if (arg.size() > 15)
+    dir_ = arg.substr(16);
+  return true;
+}
+
+bool HostPgo::isEnabled() const {
+  return mode_ != hostPgoNone;
+}
+
+// makes the profile directory absolute, the instrumented program writing
+// to it from its own working directory. Without a directory in the option
+// defaultDir is used. Returns false if there is none.
+bool HostPgo::setDir(const string& defaultDir) {
+  if (dir_.empty())
+    dir_ = defaultDir;
+  if (dir_.empty())
+    return false;
+  std::error_code ec;
+  dir_ = fs::absolute(dir_, ec).lexically_normal().string();
+  return !ec;
+}
+
+const string& HostPgo::getDir() const {
+  return dir_;
+}
+
+fs::path HostPgo::getRawDir() const {
+  return fs::path(dir_) / HIPCC_PGO_RAW_DIR;
+}
+
+fs::path HostPgo::getProfile() const {
+  return fs::path(dir_) / HIPCC_PGO_PROFILE;
+}
+
+// <dir>/sources/<hash of the source path>: the content hash of the source
+// when it was instrumented, and its path
+fs::path HostPgo::getSourceRecord(const string& source) const {
+  std::error_code ec;
+  string path = fs::absolute(source, ec).lexically_normal().string();
+  return fs::path(dir_) / HIPCC_PGO_SOURCES_DIR /
+         hipBinUtilPtr_->hashString(path).substr(0, 16);
+}
+
+bool HostPgo::isSource(const string& input) {
+  string ext = fs::path(input).extension().string();
+  return ext == ".c" || ext == ".cpp" || ext == ".cxx" || ext == ".cc" ||
+         ext == ".C" || ext == ".cu" || ext == ".cuh" || ext == ".hip";
+}
+
+// merges the raw profiles if one of them is newer than the merged profile.
+// The merged profile gets the time of the newest raw profile. Parallel
+// compiles merge under a lock, the first one doing the work.
+bool HostPgo::merge(const string& clangPath, int verbose) {
+  if (merged_)
+    return true;
+  std::error_code ec;
+  auto getNewestRaw = [&](vector<string>* raws) {
+    fs::file_time_type newest = fs::file_time_type::min();
+    for (fs::directory_iterator it(getRawDir(), ec), end; !ec && it != end;
+         it.increment(ec)) {
+      std::error_code timeEc;
+      if (it->path().extension() != ".profraw")
+        continue;
+      raws->push_back(it->path().string());
+      fs::file_time_type time = fs::last_write_time(it->path(), timeEc);
+      if (!timeEc && time > newest)
+        newest = time;
+    }
+    return newest;
+  };
+  auto isCurrent = [&](fs::file_time_type newest) {
+    std::error_code timeEc;
+    fs::file_time_type profileTime = fs::last_write_time(getProfile(),
+                                                         timeEc);
+    return !timeEc && profileTime >= newest;
+  };
+  vector<string> raws;
+  fs::file_time_type newest = getNewestRaw(&raws);
+  if (raws.empty() || isCurrent(newest)) {
+    merged_ = fs::exists(getProfile(), ec);
+    if (!merged_) {
+      cout << "Warning: no profile in " << dir_ << ", run the program built"
+           << " with --hipcc-pgo-gen first. Compiling without PGO." << endl;
+    }
+    return merged_;
+  }
+#if !defined(_WIN32) && !defined(_WIN64)
+  string lockPath = (fs::path(dir_) / ".lock").string();
+  int fd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd >= 0)
+    flock(fd, LOCK_EX);
+#endif
+  // another hipcc may have merged while this one waited for the lock
+  raws.clear();
+  newest = getNewestRaw(&raws);
+  bool success = isCurrent(newest);
+  if (!success) {
+    fs::path fileList = fs::path(dir_) / "profraw-files";
+    fs::path tmpProfile = getProfile().string() + ".tmp";
+    ofstream list(fileList.string());
+    for (auto& raw : raws)
+      list << raw << "\n";
+    list.close();
+    string cmd = "\"" + clangPath + "/llvm-profdata\" merge -o \"" +
+                 tmpProfile.string() + "\" -f \"" + fileList.string() + "\"";
+    if (verbose & 0x1) {
+      cout << "hipcc: merging " << raws.size() << " raw profiles: " << cmd
+           << endl;
+    }
+    SystemCmdOut sysOut = hipBinUtilPtr_->exec(cmd.c_str(), false);
+    if (sysOut.exitCode != 0) {
+      cout << sysOut.out;
+    } else {
+      fs::rename(tmpProfile, getProfile(), ec);
+      if (!ec)
+        fs::last_write_time(getProfile(), newest, ec);
+      success = !ec;
+    }
+    fs::remove(fileList, ec);
+    if (!success) {
+      fs::remove(tmpProfile, ec);
+      cout << "Warning: unable to merge the raw profiles of " << dir_
+           << ". Compiling without PGO." << endl;
+    }
+  }
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (fd >= 0) {
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+#endif
+  merged_ = success;
+  return success;
+}
+
+// whether the profile does not match the source: its content changed since
+// it was instrumented, or it was instrumented again after the training runs
+// the profile was merged from
+bool HostPgo::isStale(const string& source, string* reason) const {
+  fs::path record = getSourceRecord(source);
+  ifstream in(record.string());
+  string hash;
+  if (!(in >> hash)) {
+    *reason = "was not built with --hipcc-pgo-gen";
+    return false;
+  }
+  if (hash != hipBinUtilPtr_->hashFile(source)) {
+    *reason = "changed since it was built with --hipcc-pgo-gen";
+    return true;
+  }
+  std::error_code ec, profileEc;
+  fs::file_time_type recordTime = fs::last_write_time(record, ec);
+  fs::file_time_type profileTime = fs::last_write_time(getProfile(),
+                                                       profileEc);
+  if (!ec && !profileEc && recordTime > profileTime) {
+    *reason = "was built with --hipcc-pgo-gen again after the last"
+              " training run";
+    return true;
+  }
+  return false;
+}
+
+// the profile option of the host compile of inputs. The generate build
+// records the sources it instruments; the use build merges the raw
+// profiles and leaves out the profile if a source is stale.
+string HostPgo::getCompileFlag(const vector<string>& inputs,
+                               const string& clangPath, int verbose) {
+  std::error_code ec;
+  if (mode_ == hostPgoGenerate) {
+    fs::create_directories(getRawDir(), ec);
+    fs::create_directories(fs::path(dir_) / HIPCC_PGO_SOURCES_DIR, ec);
+    for (auto& input : inputs) {
+      string hash = isSource(input) ? hipBinUtilPtr_->hashFile(input) : "";
+      if (hash.empty())
+        continue;
+      ofstream record(getSourceRecord(input).string());
+      record << hash << " " << fs::absolute(input, ec).string() << "\n";
+    }
+    return "-fprofile-generate=\"" + getRawDir().string() + "\"";
+  }
+  if (mode_ != hostPgoUse || !merge(clangPath, verbose))
+    return "";
+  for (auto& input : inputs) {
+    string reason;
+    if (!isSource(input))
+      continue;
+    if (isStale(input, &reason)) {
+      cout << "Warning: " << input << " " << reason << ", compiling it"
+           << " without the profile of " << dir_ << endl;
+      return "";
+    }
+    if (!reason.empty() && (verbose & 0x1))
+      cout << "hipcc: " << input << " " << reason << endl;
+  }
+  return "-fprofile-use=\"" + getProfile().string() + "\"";
+}
+
+// the link of the generate build pulls in the profile runtime. With host
+// LTO the profile is also applied at link time.
+string HostPgo::getLinkFlags(bool lto, const string& clangPath,
+                             int verbose) {
+  if (mode_ == hostPgoGenerate)
+    return " -fprofile-generate=\"" + getRawDir().string() + "\"";
+  if (mode_ == hostPgoUse && lto && merge(clangPath, verbose))
+    return " -fprofile-use=\"" + getProfile().string() + "\"";
+  return "";
+}
+
+#endif  // SRC_HIPBIN_PGO_H_
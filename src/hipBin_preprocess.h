@@ -0,0 +1,307 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_PREPROCESS_H_
+#define SRC_HIPBIN_PREPROCESS_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+
+# define HIPCC_DEVICE_BUNDLE_PREFIX "hip-amdgcn-amd-amdhsa--"
+
+/**
+ * @brief Archs of a compile that share one preprocessed device input
+ */
+struct PreprocessClass {
+  vector<string> archs;
+  string path;
+};
+
+/**
+ * @brief Preprocess once mode of hipcc (--hipcc-preprocess-once).
+ *
+ * The host side and every class of equivalent device archs are preprocessed
+ * once. Two archs are equivalent when the predefined macros they differ in
+ * are not named by any file the preprocessor read. The results are combined
+ * with clang-offload-bundler into a single .hipi, from which the host and
+ * all device compiles run as -x hip-cpp-output without header search.
+ * Any failure makes the caller fall back to the normal compile.
+ */
+class PreprocessOnce {
+ public:
+  PreprocessOnce(const string& compiler, const string& compilerPath,
+                 int verbose);
+  ~PreprocessOnce();
+  bool prepare(const string& cmd, const string& source,
+               const vector<string>& archs, const string& object,
+               string& compileCmd);
+  void cleanup();
+  static string stripDepFlags(const string& cmd);
+  static string stripOutput(const string& cmd);
+  static string getDepFlags(const string& cmd, const string& object);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string compiler_, compilerPath_, dir_;
+  int verbose_;
+  bool run(const string& cmd) const;
+  map<string, string> getArchMacros(const string& arch) const;
+  vector<string> readDepFile(const string& path) const;
+  static bool filesReference(const vector<string>& files,
+                             const vector<string>& names);
+  static string stripArchs(const string& cmd);
+};
+
+PreprocessOnce::PreprocessOnce(const string& compiler,
+                               const string& compilerPath, int verbose)
+    : compiler_(compiler), compilerPath_(compilerPath), verbose_(verbose) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+PreprocessOnce::~PreprocessOnce() {
+  cleanup();
+}
+
+// removes the intermediate files
+void PreprocessOnce::cleanup() {
+  if (dir_.empty())
+    return;
+  std::error_code ec;
+  fs::remove_all(dir_, ec);
+  dir_.clear();
+}
+
+// runs a preparation step; its diagnostics are left to the fallback compile
+bool PreprocessOnce::run(const string& cmd) const {
+  string quietCmd = cmd;
+#if !defined(_WIN32) && !defined(_WIN64)
+  quietCmd += " 2>/dev/null";
+#endif
+  if (verbose_ & 0x1)
+    cout << "hipcc-preprocess-cmd: " << cmd << "\n";
+  SystemCmdOut sysOut = hipBinUtilPtr_->exec(quietCmd.c_str());
+  return sysOut.exitCode == 0;
+}
+
+string PreprocessOnce::stripArchs(const string& cmd) {
+  return regex_replace(cmd,
+      regex("\\s--(offload-arch|amdgpu-target)=[^\\s]+"), "");
+}
+
+string PreprocessOnce::stripDepFlags(const string& cmd) {
+  string out = regex_replace(cmd, regex("\\s-M(D|MD|P)(?=\\s|$)"), "");
+  return regex_replace(out, regex("\\s-M[FTQ](\\s+\"[^\"]*\"|\\s+[^\\s]+|"
+                                  "[^\\s]+)"), "");
+}
+
+string PreprocessOnce::stripOutput(const string& cmd) {
+  return regex_replace(cmd, regex("\\s-o(\\s+\"[^\"]*\"|\\s+[^\\s]+)"), "");
+}
+
+// With -MD the dependency file is written where the compile would write it
+// and names the object, also when the command is changed to preprocess
+string PreprocessOnce::getDepFlags(const string& cmd, const string& object) {
+  string depFlags;
+  if (regex_search(cmd, regex("\\s-M(D|MD)(\\s|$)"))) {
+    if (!regex_search(cmd, regex("\\s-MF")))
+      depFlags += " -MF \"" +
+                  fs::path(object).replace_extension(".d").string() + "\"";
+    if (!regex_search(cmd, regex("\\s-M[TQ]")))
+      depFlags += " -MT \"" + object + "\"";
+  }
+  return depFlags;
+}
+
+// predefined macros of the device compile for an arch. No header is read.
+map<string, string> PreprocessOnce::getArchMacros(const string& arch) const {
+  map<string, string> macros;
+  string cmd = compiler_ + " -x hip --cuda-device-only -nogpuinc -nogpulib"
+               " --offload-arch=" + arch + " -E -dM ";
+#if defined(_WIN32) || defined(_WIN64)
+  cmd += "NUL";
+#else
+  cmd += "/dev/null 2>/dev/null";
+#endif
+  SystemCmdOut sysOut = hipBinUtilPtr_->exec(cmd.c_str());
+  if (sysOut.exitCode != 0)
+    return macros;
+  stringstream lines(sysOut.out);
+  string line;
+  smatch m;
+  while (getline(lines, line)) {
+    if (regex_search(line, m, regex("^#define\\s+([^\\s(]+)\\s?(.*)$")))
+      macros[m[1].str()] = m[2].str();
+  }
+  return macros;
+}
+
+// returns the files listed in a make dependency file
+vector<string> PreprocessOnce::readDepFile(const string& path) const {
+  vector<string> files;
+  ifstream in(path);
+  if (!in.is_open())
+    return files;
+  stringstream buffer;
+  buffer << in.rdbuf();
+  string text = regex_replace(buffer.str(), regex("\\\\\\n"), " ");
+  size_t colon = text.find(": ");
+  if (colon != string::npos)
+    text = text.substr(colon + 2);
+  string file;
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text.at(i);
+    if (c == '\\' && i + 1 < text.size() && text.at(i + 1) == ' ') {
+      file += ' ';
+      i++;
+    } else if (isspace(static_cast<unsigned char>(c))) {
+      if (!file.empty())
+        files.push_back(file);
+      file.clear();
+    } else {
+      file += c;
+    }
+  }
+  if (!file.empty())
+    files.push_back(file);
+  return files;
+}
+
+// true if any of the files contains one of the names
+bool PreprocessOnce::filesReference(const vector<string>& files,
+                                    const vector<string>& names) {
+  if (names.empty())
+    return false;
+  for (auto& file : files) {
+    ifstream in(file, std::ios::binary);
+    if (!in.is_open())
+      return true;
+    stringstream buffer;
+    buffer << in.rdbuf();
+    const string& text = buffer.str();
+    for (auto& name : names) {
+      if (text.find(name) != string::npos)
+        return true;
+    }
+  }
+  return false;
+}
+
+// Prepares the shared preprocessed input of source, which appears in cmd as
+// '-x hip <source>'. On success compileCmd compiles it to object.
+bool PreprocessOnce::prepare(const string& cmd, const string& source,
+                             const vector<string>& archs,
+                             const string& object, string& compileCmd) {
+  string sourceArgs = " -x hip " + source;
+  if (archs.empty() || cmd.find(sourceArgs) == string::npos)
+    return false;
+  fs::path dirTemplate = hipBinUtilPtr_->getTempDir();
+  dirTemplate /= "hipcc-pp-XXXXXX";
+  dir_ = hipBinUtilPtr_->mktempDir(dirTemplate.string());
+  if (dir_.empty())
+    return false;
+  fs::path dir = dir_;
+
+  string triple = hipBinUtilPtr_->trim(hipBinUtilPtr_->exec(
+      (compiler_ + " -print-target-triple").c_str()).out);
+  if (triple.empty())
+    return false;
+
+  // host: keeps the dependency flags of the compile
+  string hostCmd = stripOutput(cmd) + getDepFlags(cmd, object);
+  string hostInput = (dir / "host.hipi").string();
+  if (!run(hostCmd + " --cuda-host-only -E -o \"" + hostInput + "\""))
+    return false;
+
+  // device: one preprocessed input per class of equivalent archs. The
+  // result of __has_builtin depends on the arch, so the archs are split
+  // whenever the source or any header it read tests for builtins.
+  string deviceBase = stripOutput(stripDepFlags(stripArchs(cmd)));
+  vector<PreprocessClass> classes;
+  vector<map<string, string>> classMacros;
+  vector<vector<string>> classFiles;
+  for (auto& arch : archs) {
+    map<string, string> macros = getArchMacros(arch);
+    if (macros.empty())
+      return false;
+    bool placed = false;
+    for (size_t i = 0; i < classes.size() && !placed; i++) {
+      vector<string> differing = {"__has_builtin",
+                                  "__has_target_builtin"};
+      for (auto& macro : macros) {
+        auto it = classMacros.at(i).find(macro.first);
+        if (it == classMacros.at(i).end() || it->second != macro.second)
+          differing.push_back(macro.first);
+      }
+      for (auto& macro : classMacros.at(i)) {
+        if (!macros.count(macro.first))
+          differing.push_back(macro.first);
+      }
+      if (!filesReference(classFiles.at(i), differing)) {
+        classes.at(i).archs.push_back(arch);
+        placed = true;
+      }
+    }
+    if (placed)
+      continue;
+    PreprocessClass ppClass;
+    ppClass.archs.push_back(arch);
+    string name = "device_" + std::to_string(classes.size());
+    ppClass.path = (dir / (name + ".hipi")).string();
+    string depFile = (dir / (name + ".d")).string();
+    if (!run(deviceBase + " --cuda-device-only --offload-arch=" + arch +
+             " -E -MD -MF \"" + depFile + "\" -o \"" + ppClass.path + "\""))
+      return false;
+    classes.push_back(ppClass);
+    classMacros.push_back(macros);
+    classFiles.push_back(readDepFile(depFile));
+  }
+
+  // bundle the host and per arch inputs the way clang -E does
+  string targets = "host-" + triple;
+  string inputs = " -input=\"" + hostInput + "\"";
+  for (auto& ppClass : classes) {
+    for (auto& arch : ppClass.archs) {
+      targets += "," HIPCC_DEVICE_BUNDLE_PREFIX + arch;
+      inputs += " -input=\"" + ppClass.path + "\"";
+    }
+  }
+  string bundle = (dir / (fs::path(object).stem().string() + ".hipi")).string();
+  string bundler = "\"" + compilerPath_ + "/clang-offload-bundler\"";
+  if (!run(bundler + " -type=hipi -targets=" + targets + inputs +
+           " -output=\"" + bundle + "\""))
+    return false;
+  if (verbose_ & 0x1) {
+    cout << "hipcc: preprocessed " << archs.size() << " arch(s) in "
+         << classes.size() << " device class(es)" << endl;
+  }
+
+  compileCmd = stripDepFlags(cmd);
+  size_t pos = compileCmd.find(sourceArgs);
+  compileCmd.replace(pos, sourceArgs.size(),
+                     " -x hip-cpp-output \"" + bundle + "\"");
+  if (stripOutput(compileCmd) == compileCmd)
+    compileCmd += " -o \"" + object + "\"";
+  return true;
+}
+
+#endif  // SRC_HIPBIN_PREPROCESS_H_
@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_PREWARM_H_
+#define SRC_HIPBIN_PREWARM_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+#include <set>
+#include <thread>
+#include <atomic>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#endif
+
+# define HIPCC_PREWARM_MIN_THREADS  4
+# define HIPCC_PREWARM_CHUNK        (1 << 20)
+
+/**
+ * @brief Page cache prewarm of the files a compile reads (hipcc --prewarm).
+ *
+ * The files are read completely, in parallel, so that they are in the page
+ * cache of the node afterwards; reading rather than only advising also
+ * works on network filesystems which ignore readahead hints.
+ */
+class Prewarm {
+ public:
+  void addFile(const string& path);
+  void addTree(const string& dir);
+  size_t addDependencies(const string& rule);
+  size_t getNumFiles() const;
+  const vector<string>& getFiles() const;
+  unsigned long long run(int numThreads);
+
+ private:
+  vector<string> files_;
+  std::set<string> seen_;
+  static unsigned long long readFile(const string& path);
+};
+
+// adds a regular file, symbolic links are resolved so that the target is read
+void Prewarm::addFile(const string& path) {
+  std::error_code ec;
+  fs::path canonicalFs = fs::canonical(path, ec);
+  if (ec || !fs::is_regular_file(canonicalFs, ec))
+    return;
+  if (seen_.insert(canonicalFs.string()).second)
+    files_.push_back(canonicalFs.string());
+}
+
+// adds every file below dir
+void Prewarm::addTree(const string& dir) {
+  std::error_code ec;
+  if (!fs::is_directory(dir, ec))
+    return;
+  for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    addFile(it->path().string());
+  }
+}
+
+// adds the files of a make rule as printed by clang -M, returns the number
+// of files named by the rule
+size_t Prewarm::addDependencies(const string& rule) {
+  size_t colon = rule.find(": ");
+  if (colon == string::npos)
+    return 0;
+  size_t numFiles = 0;
+  string file;
+  for (size_t i = colon + 2; i <= rule.size(); i++) {
+    char c = i < rule.size() ? rule[i] : ' ';
+    // an escaped space or '#' is part of the file name, a backslash at the
+    // end of a line continues the rule
+    if (c == '\\' && i + 1 < rule.size() && rule[i + 1] != '\n' &&
+        rule[i + 1] != '\r') {
+      file += rule[++i];
+      continue;
+    }
+    if (c == '\\' || isspace(static_cast<unsigned char>(c))) {
+      if (!file.empty()) {
+        addFile(file);
+        numFiles++;
+      }
+      file.clear();
+      continue;
+    }
+    file += c;
+  }
+  return numFiles;
+}
+
+size_t Prewarm::getNumFiles() const {
+  return files_.size();
+}
+
+const vector<string>& Prewarm::getFiles() const {
+  return files_;
+}
+
+// reads the file and returns the number of bytes read
+unsigned long long Prewarm::readFile(const string& path) {
+  unsigned long long bytes = 0;
+  vector<char> buffer(HIPCC_PREWARM_CHUNK);
+#if defined(_WIN32) || defined(_WIN64)
+  ifstream in(path, std::ios::binary);
+  while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+    bytes += in.gcount();
+#else
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  ssize_t size;
+  while ((size = read(fd, buffer.data(), buffer.size())) > 0)
+    bytes += size;
+  close(fd);
+#endif
+  return bytes;
+}
+
+// reads all files with numThreads threads, returns the number of bytes read
+unsigned long long Prewarm::run(int numThreads) {
+  std::atomic<size_t> next(0);
+  std::atomic<unsigned long long> bytes(0);
+  auto worker = [&]() {
+    size_t index;
+    while ((index = next++) < files_.size())
+      bytes += readFile(files_.at(index));
+  };
+  numThreads = std::max(1, std::min(numThreads,
+                                    static_cast<int>(files_.size())));
+  vector<std::thread> threads;
+  for (int i = 1; i < numThreads; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+  return bytes;
+}
+
+#endif  // SRC_HIPBIN_PREWARM_H_
@@ -0,0 +1,495 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_REMARKS_H_
+#define SRC_HIPBIN_REMARKS_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include "hipBin_sidefiles.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <functional>
+#include <tuple>
+#include <iomanip>
+
+# define HIPCC_REMARKS_DIR_OPTION   "--remarks-dir"
+# define HIPCC_REMARKS_YAML_EXT     ".opt.yaml"
+# define HIPCC_REMARKS_BITSTREAM_EXT ".opt.bitstream"
+# define HIPCC_REMARKS_INDEX_EXT    ".remarks.json"
+# define HIPCC_REMARKS_TOP          20
+
+// a remark of an optimization record
+struct OptRemark {
+  string type;      // Passed, Missed, Analysis, Failure, ...
+  string pass;
+  string name;
+  string function;
+  string file;
+  int line = 0;
+  int column = 0;
+  string message;
+};
+
+/**
+ * @brief Optimization records (hipcc --remarks-dir <dir>).
+ *
+ * The compile runs with -fsave-optimization-record for host and device.
+ * The records of each output are collected as CompileSideFiles after the
+ * compile and moved to <dir>/<stem>-<hash>.<arch>.opt.yaml, <hash>
+ * identifying the output, with an index <stem>-<hash>.remarks.json naming
+ * the output, the inputs and the compile directory. hipcc --remarks-summary
+ * aggregates the YAML records of a build: failed inlines, unroll and
+ * vectorization misses and the calls inlined as always-inline, which on the
+ * device is every call inlined by -amdgpu-early-inline-all.
+ * --remarks-kernel and --remarks-loc list the remarks of a function or a
+ * source location.
+ */
+class OptRemarks {
+ public:
+  OptRemarks(const string& dir, const string& output,
+             const vector<string>& inputs, int verbose);
+  static string parseDirOption(vector<string>* argv);
+  static string getFlags();
+  bool collect(const CompileSideFiles& sideFiles, size_t output,
+               bool keepRecords) const;
+  static bool load(const string& path,
+                   const std::function<void(const OptRemark&)>& onRemark);
+  static string getCategory(const OptRemark& remark);
+  static int summarize(const vector<string>& argv);
+
+ private:
+  string dir_, output_;
+  vector<string> inputs_;
+  int verbose_;
+  static string unquote(const string& value);
+};
+
+OptRemarks::OptRemarks(const string& dir, const string& output,
+                       const vector<string>& inputs, int verbose)
+    : dir_(dir), output_(output), inputs_(inputs), verbose_(verbose) {}
+
+// removes --remarks-dir <dir> and --remarks-dir=<dir> from argv and returns
+// the directory
+string OptRemarks::parseDirOption(vector<string>* argv) {
+  string dir;
+  string option = HIPCC_REMARKS_DIR_OPTION;
+  for (size_t i = 1; i < argv->size();) {
+    const string& arg = argv->at(i);
+    if (arg == option && i + 1 < argv->size()) {
+      dir = argv->at(i + 1);
+      argv->erase(argv->begin() + i, argv->begin() + i + 2);
+    } else if (arg.compare(0, option.size() + 1, option + "=") == 0) {
+      dir = arg.substr(option.size() + 1);
+      argv->erase(argv->begin() + i);
+    } else {
+      i++;
+    }
+  }
+  return dir;
+}
+
+// the options saving the optimization records of host and device
+string OptRemarks::getFlags() {
+  return " -fsave-optimization-record";
+}
+
+// moves the records of the output with the index output of the compile to
+// the remarks directory and writes the index. The records written next to
+// the output are copied if the user asked for them.
+bool OptRemarks::collect(const CompileSideFiles& sideFiles, size_t output,
+                         bool keepRecords) const {
+  HipBinUtil* hipBinUtilPtr = HipBinUtil::getInstance();
+  std::error_code ec;
+  fs::create_directories(dir_, ec);
+  if (!fs::is_directory(dir_, ec))
+    return false;
+  string outputPath = fs::absolute(output_, ec).lexically_normal().string();
+  string prefix = fs::path(output_).stem().string() + "-" +
+                  hipBinUtilPtr->hashString(outputPath).substr(0, 8);
+  // the records of an earlier compile of the output
+  for (fs::directory_iterator it(dir_, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    string name = it->path().filename().string();
+    if (name.compare(0, prefix.size() + 1, prefix + ".") == 0) {
+      std::error_code removeEc;
+      fs::remove(it->path(), removeEc);
+    }
+  }
+  JsonValue index = JsonValue::object();
+  index.set("schema", 1);
+  index.set("output", outputPath);
+  JsonValue inputs = JsonValue::array();
+  for (auto& input : inputs_)
+    inputs.push(fs::absolute(input, ec).lexically_normal().string());
+  index.set("inputs", inputs);
+  index.set("directory", fs::current_path(ec).string());
+  JsonValue records = JsonValue::array();
+  map<string, int> archCount;
+  vector<string> files = sideFiles.find(HIPCC_REMARKS_YAML_EXT, output);
+  for (auto& file : sideFiles.find(HIPCC_REMARKS_BITSTREAM_EXT, output))
+    files.push_back(file);
+  for (auto& file : files) {
+    string ext = fs::path(file).extension() == ".yaml" ?
+                 HIPCC_REMARKS_YAML_EXT : HIPCC_REMARKS_BITSTREAM_EXT;
+    string arch = CompileSideFiles::getArch(file);
+    int count = ++archCount[arch];
+    string name = prefix + "." + arch +
+                  (count > 1 ? "-" + std::to_string(count) : "") + ext;
+    fs::path target = fs::path(dir_) / name;
+    std::error_code moveEc;
+    if (keepRecords && !sideFiles.isPrivate(file)) {
+      fs::copy_file(file, target, fs::copy_options::overwrite_existing,
+                    moveEc);
+    } else {
+      fs::rename(file, target, moveEc);
+      if (moveEc) {
+        // another file system
+        moveEc.clear();
+        fs::copy_file(file, target, fs::copy_options::overwrite_existing,
+                      moveEc);
+        std::error_code removeEc;
+        if (!moveEc)
+          fs::remove(file, removeEc);
+      }
+    }
+    if (moveEc) {
+      cout << "Warning: unable to collect the optimization record " << file
+           << endl;
+      continue;
+    }
+    JsonValue record = JsonValue::object();
+    record.set("arch", arch);
+    record.set("file", name);
+    records.push(record);
+  }
+  index.set("records", records);
+  string indexPath = (fs::path(dir_) / (prefix + HIPCC_REMARKS_INDEX_EXT))
+                     .string();
+  if (verbose_ & 0x1) {
+    cout << "hipcc: " << records.items.size() << " optimization records"
+         << " collected into " << dir_ << endl;
+  }
+  ofstream out(indexPath);
+  if (!out.is_open())
+    return false;
+  out << index.dump(1) << "\n";
+  return static_cast<bool>(out);
+}
+
+// a YAML scalar without its quotes
+string OptRemarks::unquote(const string& value) {
+  if (value.size() < 2)
+    return value;
+  string result;
+  if (value.front() == '\'' && value.back() == '\'') {
+    for (size_t i = 1; i + 1 < value.size(); i++) {
+      result += value[i];
+      if (value[i] == '\'' && value[i + 1] == '\'')
+        i++;
+    }
+    return result;
+  }
+  if (value.front() == '"' && value.back() == '"') {
+    for (size_t i = 1; i + 1 < value.size(); i++) {
+      if (value[i] == '\\' && i + 2 < value.size()) {
+        char escaped = value[++i];
+        result += escaped == 'n' ? '\n' : escaped == 't' ? '\t' : escaped;
+      } else {
+        result += value[i];
+      }
+    }
+    return result;
+  }
+  return value;
+}
+
+// reads the remarks of a YAML optimization record, as written by LLVM:
+// one document per remark, its arguments forming the message
+bool OptRemarks::load(const string& path,
+                      const std::function<void(const OptRemark&)>& onRemark) {
+  HipBinUtil* hipBinUtilPtr = HipBinUtil::getInstance();
+  ifstream in(path);
+  if (!in.is_open())
+    return false;
+  static const regex debugLoc(
+      "File:\\s*('(?:[^']|'')*'|\"(?:[^\"\\\\]|\\\\.)*\"|[^,]*),\\s*"
+      "Line:\\s*([0-9]+),\\s*Column:\\s*([0-9]+)");
+  OptRemark remark;
+  bool inRemark = false;
+  auto finish = [&]() {
+    if (inRemark)
+      onRemark(remark);
+    remark = OptRemark();
+    inRemark = false;
+  };
+  string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.compare(0, 5, "--- !") == 0) {
+      finish();
+      inRemark = true;
+      remark.type = line.substr(5);
+      continue;
+    }
+    if (line == "...") {
+      finish();
+      continue;
+    }
+    if (!inRemark || line.empty())
+      continue;
+    bool isArg = line.compare(0, 4, "  - ") == 0;
+    if (line[0] == ' ' && !isArg)
+      continue;  // the DebugLoc of an argument
+    size_t start = isArg ? 4 : 0;
+    size_t colon = line.find(':', start);
+    if (colon == string::npos)
+      continue;
+    string key = line.substr(start, colon - start);
+    size_t valueStart = line.find_first_not_of(' ', colon + 1);
+    string value = valueStart == string::npos ? "" :
+                   line.substr(valueStart);
+    if (isArg) {
+      if (key == "Callee" || key == "Caller")
+        remark.message += hipBinUtilPtr->demangle(unquote(value));
+      else if (key != "DebugLoc")
+        remark.message += unquote(value);
+    } else if (key == "Pass") {
+      remark.pass = unquote(value);
+    } else if (key == "Name") {
+      remark.name = unquote(value);
+    } else if (key == "Function") {
+      remark.function = unquote(value);
+    } else if (key == "DebugLoc") {
+      smatch match;
+      if (regex_search(value, match, debugLoc)) {
+        remark.file = unquote(match.str(1));
+        remark.line = std::stoi(match.str(2));
+        remark.column = std::stoi(match.str(3));
+      }
+    }
+  }
+  finish();
+  return true;
+}
+
+// the summary category of a remark, empty if it is not summarized
+string OptRemarks::getCategory(const OptRemark& remark) {
+  bool missed = remark.type == "Missed" || remark.type == "Failure";
+  bool alwaysInline = remark.pass == "always-inline" ||
+                      remark.message.find("always inline") != string::npos;
+  if (missed && (remark.pass == "inline" || remark.pass == "always-inline"))
+    return "failed inline";
+  if (missed && remark.pass.compare(0, 11, "loop-unroll") == 0)
+    return "unroll miss";
+  if (missed && (remark.pass == "loop-vectorize" ||
+                 remark.pass == "slp-vectorizer"))
+    return "vectorize miss";
+  if (remark.type == "Passed" && alwaysInline &&
+      (remark.pass == "inline" || remark.pass == "always-inline"))
+    return "always-inline";
+  return "";
+}
+
+// hipcc --remarks-summary [--remarks-kernel=<glob>] [--remarks-loc=<glob>]
+//                         [--remarks-arch=<glob>] [--remarks-top=<N>]
+//                         [<remarks dir>...]
+int OptRemarks::summarize(const vector<string>& argv) {
+  HipBinUtil* hipBinUtilPtr = HipBinUtil::getInstance();
+  size_t top = HIPCC_REMARKS_TOP;
+  string kernelGlob, locGlob, archGlob = "*";
+  vector<string> paths;
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg.compare(0, 14, "--remarks-top=") == 0 &&
+        hipBinUtilPtr->stringRegexMatch(arg.substr(14), "[0-9]+")) {
+      top = std::stoul(arg.substr(14));
+    } else if (arg.compare(0, 17, "--remarks-kernel=") == 0) {
+      kernelGlob = arg.substr(17);
+    } else if (arg.compare(0, 14, "--remarks-loc=") == 0) {
+      locGlob = arg.substr(14);
+    } else if (arg.compare(0, 15, "--remarks-arch=") == 0) {
+      archGlob = arg.substr(15);
+    } else if (arg.compare(0, 2, "--") != 0) {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty())
+    paths.push_back(".");
+  bool query = !kernelGlob.empty() || !locGlob.empty();
+
+  std::error_code ec;
+  vector<fs::path> indexes;
+  for (auto& path : paths) {
+    if (!fs::is_directory(path, ec)) {
+      indexes.push_back(path);
+      continue;
+    }
+    for (fs::recursive_directory_iterator it(path, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      string name = it->path().filename().string();
+      string ext = HIPCC_REMARKS_INDEX_EXT;
+      if (name.size() > ext.size() &&
+          name.compare(name.size() - ext.size(), ext.size(), ext) == 0)
+        indexes.push_back(it->path());
+    }
+  }
+  std::sort(indexes.begin(), indexes.end());
+
+  const vector<string> categories = {"failed inline", "unroll miss",
+                                     "vectorize miss", "always-inline"};
+  // arch -> category -> remarks
+  map<string, map<string, size_t>> archCounts;
+  // arch -> (category, function, location, message) -> (remarks, TUs)
+  typedef std::tuple<string, string, string, string> Spot;
+  typedef std::pair<size_t, std::set<size_t>> SpotCount;
+  map<string, map<Spot, SpotCount>> archSpots;
+  vector<std::pair<string, string>> matches;  // arch, line
+  size_t numUnits = 0, numRecords = 0, numRemarks = 0, numBitstream = 0;
+  for (auto& indexPath : indexes) {
+    ifstream in(indexPath.string());
+    stringstream buffer;
+    buffer << in.rdbuf();
+    JsonValue index;
+    const JsonValue* records = nullptr;
+    if (!JsonValue::parse(buffer.str(), index) ||
+        !(records = index.find("records"))) {
+      cout << "Warning: " << indexPath.string()
+           << " is not an optimization record index" << endl;
+      continue;
+    }
+    size_t unit = numUnits++;
+    fs::path directory = index.getString("directory");
+    for (auto& record : records->items) {
+      string arch = record.getString("arch", "host");
+      if (!hipBinUtilPtr->globMatch(archGlob, arch))
+        continue;
+      fs::path recordPath = indexPath.parent_path() /
+                            record.getString("file");
+      if (recordPath.extension() != ".yaml") {
+        numBitstream++;
+        continue;
+      }
+      auto onRemark = [&](const OptRemark& remark) {
+        numRemarks++;
+        string category = getCategory(remark);
+        if (category.empty() && !(query && remark.type == "Analysis"))
+          return;
+        string function = hipBinUtilPtr->demangle(remark.function);
+        string file, location;
+        if (!remark.file.empty()) {
+          file = (directory / remark.file).lexically_normal().string();
+          location = file + ":" + std::to_string(remark.line) + ":" +
+                     std::to_string(remark.column);
+        }
+        if (!kernelGlob.empty() &&
+            !hipBinUtilPtr->globMatch(kernelGlob, remark.function) &&
+            !hipBinUtilPtr->globMatch(kernelGlob, function))
+          return;
+        if (!locGlob.empty()) {
+          string line = ":" + std::to_string(remark.line);
+          string name = fs::path(file).filename().string();
+          if (file.empty() || (!hipBinUtilPtr->globMatch(locGlob, file) &&
+              !hipBinUtilPtr->globMatch(locGlob, file + line) &&
+              !hipBinUtilPtr->globMatch(locGlob, name) &&
+              !hipBinUtilPtr->globMatch(locGlob, name + line)))
+            return;
+        }
+        if (query) {
+          matches.push_back({arch, location + "  " + function + "  [" +
+                             (category.empty() ? remark.type : category) +
+                             "] " + remark.pass + "/" + remark.name + ": " +
+                             remark.message});
+        }
+        if (category.empty())
+          return;
+        archCounts[arch][category]++;
+        if (category == "always-inline")
+          return;
+        auto& spot = archSpots[arch][Spot(category, function, location,
+                                          remark.message)];
+        spot.first++;
+        spot.second.insert(unit);
+      };
+      if (!load(recordPath.string(), onRemark)) {
+        cout << "Warning: unable to read " << recordPath.string() << endl;
+        continue;
+      }
+      numRecords++;
+    }
+  }
+  if (numUnits == 0) {
+    cout << "hipcc: no optimization records found" << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "hipcc: " << numUnits << " translation units, " << numRecords
+       << " optimization records, " << numRemarks << " remarks\n";
+  if (numBitstream > 0) {
+    cout << "hipcc: " << numBitstream << " bitstream records not summarized,"
+         << " use the YAML format\n";
+  }
+  const map<string, string> titles = {
+    {"failed inline", "failed inlines"},
+    {"unroll miss", "loop unroll misses"},
+    {"vectorize miss", "vectorization misses"},
+    {"always-inline", "always-inlined calls"}};
+  for (auto& arch : archCounts) {
+    cout << "\n" << arch.first << ":\n";
+    for (auto& category : categories) {
+      cout << "  " << std::left << std::setw(24) << titles.at(category)
+           << std::right << std::setw(8) << arch.second[category] << "\n";
+    }
+    if (query)
+      continue;
+    vector<std::pair<Spot, SpotCount>> sorted(archSpots[arch.first].begin(),
+                                              archSpots[arch.first].end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const std::pair<Spot, SpotCount>& a,
+                        const std::pair<Spot, SpotCount>& b) {
+      return a.second.first > b.second.first;
+    });
+    cout << "  Most frequent missed optimizations (remarks, translation"
+         << " units):\n";
+    for (size_t i = 0; i < sorted.size() && i < top; i++) {
+      const Spot& spot = sorted.at(i).first;
+      cout << "    " << std::setw(6) << sorted.at(i).second.first << " "
+           << std::setw(5) << sorted.at(i).second.second.size() << "  ["
+           << std::get<0>(spot) << "] " << std::get<1>(spot) << "  "
+           << std::get<2>(spot) << "\n          " << std::get<3>(spot)
+           << "\n";
+    }
+  }
+  if (query) {
+    std::stable_sort(matches.begin(), matches.end());
+    cout << "\n" << matches.size() << " matching remarks:\n";
+    for (auto& match : matches)
+      cout << "  " << match.first << "  " << match.second << "\n";
+  }
+  cout.flush();
+  return EXIT_SUCCESS;
+}
+
+#endif  // SRC_HIPBIN_REMARKS_H_
@@ -0,0 +1,326 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_SCAN_H_
+#define SRC_HIPBIN_SCAN_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+#include <cctype>
+
+// bump when the scan rules change, so that cached scan results are
+// invalidated
+# define HIPCC_SCANNER_VERSION      "2"
+
+/**
+ * @brief Result of a lexer level scan of a single source file.
+ * Nothing is preprocessed; conditional compilation is ignored, which makes
+ * every result a conservative superset.
+ */
+struct SourceInfo {
+  vector<string> quotedIncludes;   // #include "..."
+  vector<string> angledIncludes;   // #include <...>
+  map<string, string> defines;     // macros still defined at end of file
+  vector<string> internalNames;    // static and anonymous namespace names
+  bool deviceCode = false;         // device constructs, HIP macros used or
+                                   // an include that cannot be followed
+};
+
+/**
+ * @brief Tokenizer that skips comments, literals and preprocessor lines
+ */
+class SourceScanner {
+ public:
+  static bool scanFile(const string& path, SourceInfo& info);
+  static void scan(const string& text, SourceInfo& info);
+  static bool isDeviceToken(const string& identifier);
+
+ private:
+  static void handleDirective(const string& line, SourceInfo& info);
+  static void collectInternalNames(const vector<string>& tokens,
+                                   SourceInfo& info);
+  static bool isKeyword(const string& identifier);
+};
+
+// keywords that can precede the tokens ending a declarator
+bool SourceScanner::isKeyword(const string& identifier) {
+  static const vector<string> keywords = {
+    "alignas", "auto", "bool", "char", "class", "const", "constexpr",
+    "decltype", "double", "enum", "extern", "float", "inline", "int", "long",
+    "noexcept", "operator", "return", "short", "signed", "sizeof", "static",
+    "static_assert", "struct", "template", "typedef", "typename", "union",
+    "unsigned", "using", "void", "volatile", "__attribute__", "__declspec"
+  };
+  return std::find(keywords.begin(), keywords.end(), identifier) !=
+         keywords.end();
+}
+
+// identifiers that only make sense in code compiled for the device, or
+// that test for it
+bool SourceScanner::isDeviceToken(const string& identifier) {
+  static const vector<string> deviceTokens = {
+    "__global__", "__device__", "__shared__", "__constant__", "__managed__",
+    "__launch_bounds__", "__syncthreads", "hipLaunchKernelGGL",
+    "threadIdx", "blockIdx", "blockDim", "gridDim", "__HIP__", "__HIPCC__",
+    "__HIP_DEVICE_COMPILE__", "__CUDACC__", "__CUDA_ARCH__"
+  };
+  return std::find(deviceTokens.begin(), deviceTokens.end(), identifier) !=
+         deviceTokens.end();
+}
+
+// scans the file, returns false if it cannot be read
+bool SourceScanner::scanFile(const string& path, SourceInfo& info) {
+  ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+    return false;
+  stringstream buffer;
+  buffer << in.rdbuf();
+  scan(buffer.str(), info);
+  return true;
+}
+
+void SourceScanner::scan(const string& text, SourceInfo& info) {
+  vector<string> tokens;
+  size_t pos = 0, size = text.size();
+  bool lineStart = true;
+  while (pos < size) {
+    char c = text.at(pos);
+    if (c == '\n') {
+      lineStart = true;
+      pos++;
+      continue;
+    }
+    if (isspace(static_cast<unsigned char>(c))) {
+      pos++;
+      continue;
+    }
+    // comments
+    if (c == '/' && pos + 1 < size && text.at(pos + 1) == '/') {
+      while (pos < size && text.at(pos) != '\n')
+        pos++;
+      continue;
+    }
+    if (c == '/' && pos + 1 < size && text.at(pos + 1) == '*') {
+      size_t end = text.find("*/", pos + 2);
+      pos = end == string::npos ? size : end + 2;
+      continue;
+    }
+    // preprocessor directive, joined with its continuation lines
+    if (c == '#' && lineStart) {
+      string line;
+      while (pos < size && text.at(pos) != '\n') {
+        if (text.at(pos) == '\\' && pos + 1 < size &&
+            text.at(pos + 1) == '\n') {
+          pos += 2;
+          line += ' ';
+          continue;
+        }
+        if (text.compare(pos, 2, "/*") == 0) {
+          size_t end = text.find("*/", pos + 2);
+          pos = end == string::npos ? size : end + 2;
+          line += ' ';
+          continue;
+        }
+        if (text.compare(pos, 2, "//") == 0) {
+          while (pos < size && text.at(pos) != '\n')
+            pos++;
+          break;
+        }
+        line += text.at(pos++);
+      }
+      handleDirective(line, info);
+      continue;
+    }
+    lineStart = false;
+    // raw string literal R"delim( ... )delim"
+    if (c == 'R' && pos + 1 < size && text.at(pos + 1) == '"') {
+      size_t open = text.find('(', pos + 2);
+      if (open != string::npos) {
+        string delim = ")" + text.substr(pos + 2, open - pos - 2) + "\"";
+        size_t end = text.find(delim, open);
+        pos = end == string::npos ? size : end + delim.size();
+        tokens.push_back("\"\"");
+        continue;
+      }
+    }
+    // string and character literals
+    if (c == '"' || c == '\'') {
+      pos++;
+      while (pos < size && text.at(pos) != c && text.at(pos) != '\n') {
+        if (text.at(pos) == '\\')
+          pos++;
+        pos++;
+      }
+      pos++;
+      tokens.push_back(c == '"' ? "\"\"" : "''");
+      continue;
+    }
+    if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+      size_t start = pos;
+      while (pos < size && (isalnum(static_cast<unsigned char>(
+             text.at(pos))) || text.at(pos) == '_'))
+        pos++;
+      tokens.push_back(text.substr(start, pos - start));
+      if (isDeviceToken(tokens.back()))
+        info.deviceCode = true;
+      continue;
+    }
+    if (isdigit(static_cast<unsigned char>(c))) {
+      size_t start = pos;
+      while (pos < size && (isalnum(static_cast<unsigned char>(
+             text.at(pos))) || text.at(pos) == '.' || text.at(pos) == '\''))
+        pos++;
+      tokens.push_back(text.substr(start, pos - start));
+      continue;
+    }
+    // kernel launch
+    if (text.compare(pos, 3, "<<<") == 0)
+      info.deviceCode = true;
+    if (c == ':' && pos + 1 < size && text.at(pos + 1) == ':') {
+      tokens.push_back("::");
+      pos += 2;
+      continue;
+    }
+    tokens.push_back(string(1, c));
+    pos++;
+  }
+  collectInternalNames(tokens, info);
+}
+
+// records includes and the macros defined by the file. An include of
+// another form, e.g. a computed #include MACRO, may pull in a HIP header,
+// so the file counts as device code.
+void SourceScanner::handleDirective(const string& line, SourceInfo& info) {
+  smatch m;
+  if (regex_search(line, m, regex("^#\\s*include\\s*\"([^\"]+)\""))) {
+    info.quotedIncludes.push_back(m[1].str());
+  } else if (regex_search(line, m, regex("^#\\s*include\\s*<([^>]+)>"))) {
+    info.angledIncludes.push_back(m[1].str());
+  } else if (regex_search(line, regex("^#\\s*(include|import)"))) {
+    info.deviceCode = true;
+  } else if (regex_search(line, m,
+             regex("^#\\s*define\\s+([A-Za-z_][A-Za-z0-9_]*)(.*)$"))) {
+    string definition = m[2].str();
+    definition = regex_replace(definition, regex("\\s+"), " ");
+    info.defines[m[1].str()] = definition;
+  } else if (regex_search(line, m,
+             regex("^#\\s*undef\\s+([A-Za-z_][A-Za-z0-9_]*)"))) {
+    info.defines.erase(m[1].str());
+  }
+  // macros can hide device constructs and #if can test for the device
+  if (regex_search(line, regex("^#\\s*include")))
+    return;
+  regex identifier("[A-Za-z_][A-Za-z0-9_]*");
+  for (std::sregex_iterator it(line.begin(), line.end(), identifier), end;
+       it != end; ++it) {
+    if (isDeviceToken(it->str()))
+      info.deviceCode = true;
+  }
+}
+
+// Collects the names with internal linkage declared at namespace scope:
+// 'static' declarations and everything declared directly inside an
+// anonymous namespace. The name is the identifier before the first
+// '(', '=', ';', '[', '{' or ':' of the declaration.
+void SourceScanner::collectInternalNames(const vector<string>& tokens,
+                                         SourceInfo& info) {
+  // brace stack: 'n' named namespace, 'a' anonymous namespace, 'o' other
+  vector<char> scopes;
+  bool atNamespaceScope = true;
+  bool inAnonymous = false;
+  bool statementStart = true;
+  bool statementIsStatic = false;
+  bool nameTaken = false;
+  string prevIdentifier;
+  int parenDepth = 0;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    const string& tok = tokens.at(i);
+    if (tok == "namespace" && atNamespaceScope) {
+      size_t j = i + 1;
+      bool named = false;
+      while (j < tokens.size() && tokens.at(j) != "{" && tokens.at(j) != ";" &&
+             tokens.at(j) != "=") {
+        named = true;
+        j++;
+      }
+      if (j < tokens.size() && tokens.at(j) == "{") {
+        scopes.push_back(named ? 'n' : 'a');
+        inAnonymous = inAnonymous || !named;
+        i = j;
+        statementStart = true;
+        statementIsStatic = false;
+        nameTaken = false;
+        prevIdentifier.clear();
+        continue;
+      }
+    }
+    if (tok == "(" || tok == "[") {
+      parenDepth++;
+    } else if ((tok == ")" || tok == "]") && parenDepth > 0) {
+      parenDepth--;
+    }
+    bool isIdentifier = isalpha(static_cast<unsigned char>(tok.at(0))) ||
+                        tok.at(0) == '_';
+    if (atNamespaceScope && parenDepth <= 1) {
+      if (statementStart && tok == "static")
+        statementIsStatic = true;
+      statementStart = false;
+      if (!nameTaken && (statementIsStatic || inAnonymous) &&
+          (tok == "(" || tok == "=" || tok == ";" || tok == "[" ||
+           tok == "{" || tok == ":") && !prevIdentifier.empty()) {
+        if (!isKeyword(prevIdentifier))
+          info.internalNames.push_back(prevIdentifier);
+        nameTaken = true;
+      }
+      if (isIdentifier)
+        prevIdentifier = tok;
+      else if (tok != "::" && tok != "*" && tok != "&")
+        prevIdentifier.clear();
+    }
+    if (tok == "{") {
+      scopes.push_back('o');
+      atNamespaceScope = false;
+    } else if (tok == "}") {
+      if (!scopes.empty())
+        scopes.pop_back();
+      atNamespaceScope = std::find(scopes.begin(), scopes.end(), 'o') ==
+                         scopes.end();
+      inAnonymous = std::find(scopes.begin(), scopes.end(), 'a') !=
+                    scopes.end();
+      if (atNamespaceScope) {
+        statementStart = true;
+        statementIsStatic = false;
+        nameTaken = false;
+        prevIdentifier.clear();
+        parenDepth = 0;
+      }
+    } else if (tok == ";" && atNamespaceScope && parenDepth == 0) {
+      statementStart = true;
+      statementIsStatic = false;
+      nameTaken = false;
+      prevIdentifier.clear();
+    }
+  }
+}
+
+#endif  // SRC_HIPBIN_SCAN_H_
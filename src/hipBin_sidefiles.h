@@ -0,0 +1,226 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_SIDEFILES_H_
+#define SRC_HIPBIN_SIDEFILES_H_
+
+#include "hipBin_util.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+/**
+ * @brief Files clang writes alongside a compile, like the -ftime-trace
+ * traces and the optimization records.
+ *
+ * The compile runs with TMPDIR set to a private directory. Depending on its
+ * version, clang writes the file of a device compilation next to its
+ * temporary output or next to the object, named after the output. find()
+ * collects the files of one output: those of the private directory named
+ * after its input, and the exact names clang derives from the output, so
+ * that the files of concurrent compiles in the same directory are never
+ * picked up. With -c every input has its own output.
+ */
+class CompileSideFiles {
+ public:
+  CompileSideFiles(const vector<string>& outputs,
+                   const vector<string>& inputs,
+                   const vector<string>& archs, bool link);
+  ~CompileSideFiles();
+  bool prepare();
+  string getCommand(const string& cmd) const;
+  vector<string> find(const string& extension, size_t output) const;
+  const vector<string>& getOutputs() const;
+  vector<string> getInputs(size_t output) const;
+  bool isPrivate(const string& path) const;
+  void cleanup();
+  static string getArch(const string& file);
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string dir_;
+  vector<string> outputs_, inputs_, archs_;
+  bool link_;
+  fs::file_time_type start_;
+  bool isNew(const fs::path& file) const;
+  vector<string> findPrivate(const string& extension) const;
+  vector<string> getNames(const string& extension, size_t output) const;
+  size_t getOwner(const string& file) const;
+};
+
+// without link the compile writes output i from input i; a link writes
+// one output from all inputs and clang names its files after both
+CompileSideFiles::CompileSideFiles(const vector<string>& outputs,
+                                   const vector<string>& inputs,
+                                   const vector<string>& archs, bool link)
+    : outputs_(outputs), inputs_(inputs), archs_(archs), link_(link) {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+CompileSideFiles::~CompileSideFiles() {
+  cleanup();
+}
+
+// creates the directory for the temporary files of the compile
+bool CompileSideFiles::prepare() {
+  if (!dir_.empty())
+    return true;
+  fs::path dirTemplate = hipBinUtilPtr_->getTempDir();
+  dirTemplate /= "hipcc-side-XXXXXX";
+  dir_ = hipBinUtilPtr_->mktempDir(dirTemplate.string());
+  if (dir_.empty())
+    return false;
+  // files written from now on belong to this compile; file times are
+  // compared, so the marker is stamped by the file system
+  std::error_code ec;
+  fs::path marker = fs::path(dir_) / "start";
+  ofstream(marker.string()).close();
+  start_ = fs::last_write_time(marker, ec);
+  if (ec)
+    start_ = fs::file_time_type::min();
+  fs::remove(marker, ec);
+  return true;
+}
+
+// the compile command with its temporary files in the private directory
+string CompileSideFiles::getCommand(const string& cmd) const {
+#if defined(_WIN32) || defined(_WIN64)
+  return cmd;
+#else
+  return "TMPDIR=\"" + dir_ + "\" " + cmd;
+#endif
+}
+
+// whether the file was written to the private directory, which is removed
+// with the object
+bool CompileSideFiles::isPrivate(const string& path) const {
+  return !dir_.empty() && path.compare(0, dir_.size(), dir_) == 0;
+}
+
+void CompileSideFiles::cleanup() {
+  if (dir_.empty())
+    return;
+  std::error_code ec;
+  fs::remove_all(dir_, ec);
+  dir_.clear();
+}
+
+// the offload arch a file belongs to, from its name
+string CompileSideFiles::getArch(const string& file) {
+  smatch match;
+  string name = fs::path(file).filename().string();
+  if (regex_search(name, match, regex("gfx[0-9a-z]+")))
+    return match.str(0);
+  return "host";
+}
+
+const vector<string>& CompileSideFiles::getOutputs() const {
+  return outputs_;
+}
+
+// the inputs an output is built from
+vector<string> CompileSideFiles::getInputs(size_t output) const {
+  if (link_)
+    return inputs_;
+  if (output < inputs_.size())
+    return {inputs_.at(output)};
+  return {};
+}
+
+// whether the file exists and was written since prepare()
+bool CompileSideFiles::isNew(const fs::path& file) const {
+  std::error_code ec, timeEc;
+  return fs::is_regular_file(file, ec) &&
+         fs::last_write_time(file, timeEc) >= start_ && !timeEc;
+}
+
+// the files ending in extension in the private directory
+vector<string> CompileSideFiles::findPrivate(const string& extension) const {
+  vector<string> files;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator it(dir_, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    string name = it->path().filename().string();
+    if (name.size() > extension.size() &&
+        name.compare(name.size() - extension.size(), extension.size(),
+                     extension) == 0 && isNew(it->path()))
+      files.push_back(it->path().string());
+  }
+  return files;
+}
+
+// the names clang derives from an output: next to it <stem><extension>
+// and <stem>-hip-amdgcn-amd-amdhsa-<arch><extension>, with <stem> being
+// the output without its extension, or <stem>-<input stem> for a link
+vector<string> CompileSideFiles::getNames(const string& extension,
+                                          size_t output) const {
+  vector<string> names;
+  if (output >= outputs_.size() || outputs_.at(output).empty())
+    return names;
+  string stem = fs::path(outputs_.at(output)).replace_extension().string();
+  vector<string> stems = {stem};
+  if (link_) {
+    for (auto& input : inputs_)
+      stems.push_back(stem + "-" + fs::path(input).stem().string());
+  }
+  for (auto& name : stems) {
+    names.push_back(name + extension);
+    for (auto& arch : archs_)
+      names.push_back(name + "-hip-amdgcn-amd-amdhsa-" + arch + extension);
+  }
+  return names;
+}
+
+// the output a file of the private directory belongs to: clang names the
+// temporary files after the input, the longest matching input stem wins.
+// outputs_.size() if it matches none.
+size_t CompileSideFiles::getOwner(const string& file) const {
+  string name = fs::path(file).filename().string();
+  size_t owner = outputs_.size(), ownerLength = 0;
+  for (size_t i = 0; i < inputs_.size() && i < outputs_.size(); i++) {
+    string stem = fs::path(inputs_.at(i)).stem().string() + "-";
+    if (stem.size() > ownerLength && name.compare(0, stem.size(), stem) == 0) {
+      owner = i;
+      ownerLength = stem.size();
+    }
+  }
+  return owner;
+}
+
+// the files of one output ending in extension
+vector<string> CompileSideFiles::find(const string& extension,
+                                      size_t output) const {
+  vector<string> files;
+  for (auto& file : findPrivate(extension)) {
+    if (outputs_.size() == 1 || getOwner(file) == output)
+      files.push_back(file);
+  }
+  for (auto& path : getNames(extension, output)) {
+    if (path != outputs_.at(output) && isNew(path) &&
+        std::find(files.begin(), files.end(), path) == files.end())
+      files.push_back(path);
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+#endif  // SRC_HIPBIN_SIDEFILES_H_
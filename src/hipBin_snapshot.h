@@ -0,0 +1,233 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SRC_HIPBIN_SNAPSHOT_H_
+#define SRC_HIPBIN_SNAPSHOT_H_
+
+#include "hipBin_util.h"
+#include <map>
+#include <string>
+#include <cstring>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+# define HIPCC_SNAPSHOT_VERSION     "1"
+# define HIPCC_SNAPSHOT_VERSION_KEY "HIPCC_CONFIG_SNAPSHOT_VERSION"
+
+/**
+ * @brief Snapshot of the discovered configuration (hipconfig --freeze).
+ *
+ * A flat key=value text file holding the paths, versions and probe results
+ * the platforms derive at startup. Next to the values it records the
+ * environment variables and the modification times of the files the
+ * discovery depended on ("env:NAME=value", "stat:path=mtime"); a snapshot
+ * is only used while all of them are unchanged, so that loading it costs
+ * one mmap and a stat per watched file.
+ */
+class ConfigSnapshot {
+ public:
+  void set(const string& key, const string& value);
+  void watchEnv(const string& name);
+  void watchFile(const string& path);
+  bool write(const string& file) const;
+  bool load(const string& file);
+  bool get(const string& key, string& value) const;
+  bool isLoaded() const;
+  const string& getError() const;
+  void clear();
+
+ private:
+  map<string, string> values_;
+  bool loaded_ = false;
+  string error_;
+  void parse(const char* data, size_t size);
+  bool validate();
+  static string getStamp(const string& path);
+};
+
+void ConfigSnapshot::set(const string& key, const string& value) {
+  values_[key] = value;
+}
+
+// records the value of the environment variable, unset and empty are equal
+void ConfigSnapshot::watchEnv(const string& name) {
+  const char* value = HipBinUtil::getInstance()->getEnv(name.c_str());
+  values_["env:" + name] = value ? value : "";
+}
+
+// records the modification time of the file, or that it does not exist
+void ConfigSnapshot::watchFile(const string& path) {
+  values_["stat:" + path] = getStamp(path);
+}
+
+string ConfigSnapshot::getStamp(const string& path) {
+  std::error_code ec;
+  auto mtime = fs::last_write_time(path, ec);
+  if (ec)
+    return "-";
+  return std::to_string(mtime.time_since_epoch().count());
+}
+
+// writes the snapshot, through a temporary file so that a concurrent hipcc
+// never reads a partial one
+bool ConfigSnapshot::write(const string& file) const {
+  string tmpFile = file + ".tmp";
+  ofstream out(tmpFile, std::ios::trunc);
+  if (!out.is_open())
+    return false;
+  out << "# hipcc configuration snapshot written by hipconfig --freeze\n";
+  out << HIPCC_SNAPSHOT_VERSION_KEY << "=" << HIPCC_SNAPSHOT_VERSION << "\n";
+  for (auto& value : values_) {
+    if (value.first.find('\n') != string::npos ||
+        value.second.find('\n') != string::npos)
+      continue;
+    out << value.first << "=" << value.second << "\n";
+  }
+  out.close();
+  std::error_code ec;
+  if (out.fail()) {
+    fs::remove(tmpFile, ec);
+    return false;
+  }
+  fs::rename(tmpFile, file, ec);
+  if (ec) {
+    fs::remove(tmpFile, ec);
+    return false;
+  }
+  return true;
+}
+
+// splits the lines at the first '=', or at the last one for the watched
+// files as only paths can contain it there
+void ConfigSnapshot::parse(const char* data, size_t size) {
+  const char* end = data + size;
+  while (data < end) {
+    const char* eol = static_cast<const char*>(memchr(data, '\n', end - data));
+    if (!eol)
+      eol = end;
+    string line(data, eol - data);
+    data = eol + 1;
+    if (line.empty() || line[0] == '#')
+      continue;
+    size_t pos = line.compare(0, 5, "stat:") == 0 ? line.rfind('=')
+                                                  : line.find('=');
+    if (pos == string::npos)
+      continue;
+    values_[line.substr(0, pos)] = line.substr(pos + 1);
+  }
+}
+
+// checks the version, the environment and the watched files
+bool ConfigSnapshot::validate() {
+  auto version = values_.find(HIPCC_SNAPSHOT_VERSION_KEY);
+  if (version == values_.end() || version->second != HIPCC_SNAPSHOT_VERSION) {
+    error_ = "unsupported version";
+    return false;
+  }
+  for (auto& value : values_) {
+    const string& key = value.first;
+    if (key.compare(0, 4, "env:") == 0) {
+      const char* env = HipBinUtil::getInstance()->getEnv(key.c_str() + 4);
+      if (value.second != (env ? env : "")) {
+        error_ = key.substr(4) + " changed";
+        return false;
+      }
+    } else if (key.compare(0, 5, "stat:") == 0) {
+      if (value.second != getStamp(key.substr(5))) {
+        error_ = key.substr(5) + " changed";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// reads the snapshot; it is not used if it is stale
+bool ConfigSnapshot::load(const string& file) {
+  clear();
+#if defined(_WIN32) || defined(_WIN64)
+  ifstream in(file, std::ios::binary);
+  if (!in.is_open()) {
+    error_ = "cannot be read";
+    return false;
+  }
+  string text((std::istreambuf_iterator<char>(in)),
+              std::istreambuf_iterator<char>());
+  parse(text.data(), text.size());
+#else
+  int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+    if (fd >= 0)
+      close(fd);
+    error_ = "cannot be read";
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    error_ = "cannot be read";
+    return false;
+  }
+  parse(static_cast<const char*>(data), st.st_size);
+  munmap(data, st.st_size);
+#endif
+  if (!validate()) {
+    values_.clear();
+    return false;
+  }
+  loaded_ = true;
+  return true;
+}
+
+// returns the value of the key if the snapshot is loaded and holds it
+bool ConfigSnapshot::get(const string& key, string& value) const {
+  if (!loaded_)
+    return false;
+  auto it = values_.find(key);
+  if (it == values_.end())
+    return false;
+  value = it->second;
+  return true;
+}
+
+bool ConfigSnapshot::isLoaded() const {
+  return loaded_;
+}
+
+const string& ConfigSnapshot::getError() const {
+  return error_;
+}
+
+void ConfigSnapshot::clear() {
+  values_.clear();
+  loaded_ = false;
+  error_.clear();
+}
+
+#endif  // SRC_HIPBIN_SNAPSHOT_H_
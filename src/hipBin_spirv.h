@@ -25,6 +25,9 @@ THE SOFTWARE.
 
 #include "hipBin_base.h"
 #include "hipBin_util.h"
+#include "hipBin_manifest.h"
+#include "hipBin_unity.h"
+#include "hipBin_hostonly.h"
 #include <vector>
 #include <string>
 #include <unordered_set>
@@ -136,6 +139,10 @@ public:
   Argument MT;
   Argument MF;
   Argument perThreadDefaultStream;
+  Argument linkManifest;
+  Argument linkManifestTouch;
+  Argument detectHostOnly;
+  string outputFile;
   vector<string> defaultSources;
   vector<string> cSources;
   vector<string> cppSources;
@@ -204,6 +211,7 @@ public:
         prevArg = arg;
         continue; // don't pass it on
       } else if (prevArg == "-o") {
+        outputFile = arg;
         outputObject.present = true;
         outputObject.values.push_back("-o " + arg);
       } else if (arg == "-MT") {
@@ -226,6 +234,13 @@ public:
       } else if (arg == "-fgpu-default-stream=legacy") {
         // Ignore this option
         continue;
+      } else if (arg == "--hipcc-link-manifest") {
+        linkManifest.present = true;
+      } else if (arg == "--hipcc-link-manifest-touch") {
+        linkManifest.present = true;
+        linkManifestTouch.present = true;
+      } else if (arg == "--hipcc-detect-host-only") {
+        detectHostOnly.present = true;
       } else {
         // pass through all other arguments
         remainingArgs.push_back(arg);
@@ -362,6 +377,9 @@ public:
   virtual const string &getHipCFlags() const;
   virtual const string &getHipLdFlags() const;
   virtual void executeHipCCCmd(vector<string> argv);
+  virtual void addConfigSnapshot(ConfigSnapshot& snapshot);
+  bool readHipInfoSnapshot(HipInfo &result);
+  string getHipInfoSharePath() const;
 
   bool readHipInfo(const string hip_path_share, HipInfo &result) {
     fs::path path(hip_path_share + "/.hipInfo");
@@ -391,6 +409,7 @@ HipBinSpirv::HipBinSpirv() {
   platformInfo.runtime = RuntimeType::spirv;
   platformInfo.compiler = clang;
   platformInfo_ = platformInfo;
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
 
   return;
 }
@@ -487,6 +506,8 @@ void HipBinSpirv::printCompilerInfo() const {
 
 string HipBinSpirv::getCompilerVersion() {
   string out, complierVersion;
+  if (getConfigSnapshot().get("spirv.HIP_CLANG_VERSION", complierVersion))
+    return complierVersion;
   const string &hipClangPath = getCompilerPath();
   fs::path cmd = hipClangPath;
   /**
@@ -539,9 +560,15 @@ bool HipBinSpirv::detectPlatform() {
    */
 
   HipInfo hipInfo;
-  fs::path currentBinaryPath = fs::canonical("/proc/self/exe");
-  currentBinaryPath = currentBinaryPath.parent_path();
-  fs::path sharePathBuild = currentBinaryPath.string() + "/../share";
+  // the snapshot watches the .hipInfo files and the environment, the
+  // errors below would have stopped hipconfig --freeze
+  if (readHipInfoSnapshot(hipInfo)) {
+    detected = hipInfo.runtime == "spirv";
+    hipInfo_ = hipInfo;
+    constructCompilerPath();
+    return detected;
+  }
+  fs::path sharePathBuild = getHipInfoSharePath();
   fs::path sharePathInstall =
       var.hipPathEnv_.empty() ? "" : var.hipPathEnv_ + "/share";
   if (readHipInfo( // 1.
@@ -589,6 +616,54 @@ bool HipBinSpirv::detectPlatform() {
   return detected;
 }
 
+// the share directory next to the directory of this executable
+string HipBinSpirv::getHipInfoSharePath() const {
+  fs::path currentBinaryPath = fs::canonical("/proc/self/exe");
+  currentBinaryPath = currentBinaryPath.parent_path();
+  return currentBinaryPath.string() + "/../share";
+}
+
+// reads the .hipInfo recorded by hipconfig --freeze
+bool HipBinSpirv::readHipInfoSnapshot(HipInfo &result) {
+  const ConfigSnapshot &snapshot = getConfigSnapshot();
+  if (!snapshot.isLoaded())
+    return false;
+  snapshot.get("spirv." HIP_RUNTIME, result.runtime);
+  snapshot.get("spirv." HIP_OFFLOAD_COMPILE_OPTIONS, result.cxxflags);
+  snapshot.get("spirv." HIP_OFFLOAD_LINK_OPTIONS, result.ldflags);
+  snapshot.get("spirv." HIP_OFFLOAD_RDC_SUPPLEMENT_LINK_OPTIONS,
+               result.rdcSupplementLinkFlags);
+  snapshot.get("spirv." HIP_CLANG_PATH, result.clangpath);
+  snapshot.get("spirv." HIP_PATH, result.hipPath);
+  return true;
+}
+
+// records the parsed .hipInfo, the files it may come from and the compiler
+// version
+void HipBinSpirv::addConfigSnapshot(ConfigSnapshot &snapshot) {
+  HipBinBase::addConfigSnapshot(snapshot);
+  const EnvVariables &var = getEnvVariables();
+  snapshot.set("spirv." HIP_RUNTIME, hipInfo_.runtime);
+  snapshot.set("spirv." HIP_OFFLOAD_COMPILE_OPTIONS, hipInfo_.cxxflags);
+  snapshot.set("spirv." HIP_OFFLOAD_LINK_OPTIONS, hipInfo_.ldflags);
+  snapshot.set("spirv." HIP_OFFLOAD_RDC_SUPPLEMENT_LINK_OPTIONS,
+               hipInfo_.rdcSupplementLinkFlags);
+  snapshot.set("spirv." HIP_CLANG_PATH, hipInfo_.clangpath);
+  snapshot.set("spirv." HIP_PATH, hipInfo_.hipPath);
+  snapshot.watchEnv(HIP_PLATFORM);
+  snapshot.watchEnv(HIP_CLANG_PATH);
+  snapshot.watchFile(getHipInfoSharePath() + "/.hipInfo");
+  if (!var.hipPathEnv_.empty())
+    snapshot.watchFile(var.hipPathEnv_ + "/share/.hipInfo");
+  if (hipInfo_.runtime == "spirv" && !getCompilerPath().empty()) {
+    string compilerVersion = getCompilerVersion();
+    if (!compilerVersion.empty()) {
+      snapshot.set("spirv.HIP_CLANG_VERSION", compilerVersion);
+      snapshot.watchFile(getCompilerPath() + "/llvm-config");
+    }
+  }
+}
+
 string HipBinSpirv::getHipLibPath() const { return ""; }
 
 string HipBinSpirv::getHipCC() const {
@@ -705,6 +780,7 @@ void HipBinSpirv::executeHipCCCmd(vector<string> argv) {
 
   // filter out chipStar flags that could have been passed in from hipConfig
   argv = argsFilter(argv);
+  const vector<string> originalArgv = argv;
 
   // drop the first argument as it's the name of the binary
   argv.erase(argv.begin());
@@ -721,6 +797,16 @@ void HipBinSpirv::executeHipCCCmd(vector<string> argv) {
   if (!var.verboseEnv_.empty())
     opts.verbose = stoi(var.verboseEnv_);
 
+  // --unity[=N]: replace the HIP sources by generated unity sources
+  UnityBuild unityBuild;
+  bool unityRequested = false;
+  for (auto &arg : argv) {
+    unityRequested = unityBuild.parseOption(arg) || unityRequested;
+  }
+  if (unityRequested) {
+    argv = unityBuild.rewriteArgs(argv, true, opts.verbose);
+  }
+
   // trim whitespace, convert -x <lang> to -x<lang>
   argv = opts.preprocessArgs(argv);
 
@@ -730,6 +816,25 @@ void HipBinSpirv::executeHipCCCmd(vector<string> argv) {
   // parse sources handling -x<lang> cases
   processedArgs = opts.processSources(processedArgs);
 
+  // C++ sources without device code are compiled as plain C++
+  if (opts.detectHostOnly.present && !opts.dashX.present) {
+    HostOnlyDetector hostOnly;
+    hostOnly.setCacheDir(getCacheDir("host-only"));
+    hostOnly.addArgs(argv);
+    vector<string> hipSources;
+    for (auto &source : opts.sourcesHip.values) {
+      if (opts.argIsCppSource(source) && hostOnly.isHostOnly(source)) {
+        if (opts.verbose & 0x1)
+          cout << "hipcc: " << source << " has no device code" << endl;
+        opts.sourcesCpp.present = true;
+        opts.sourcesCpp.values.push_back(source);
+      } else {
+        hipSources.push_back(source);
+      }
+    }
+    opts.sourcesHip.values = hipSources;
+  }
+
   const OsType &os = getOSInfo();
   string hip_compile_cxx_as_hip;
   if (var.hipCompileCxxAsHipEnv_.empty()) {
@@ -878,12 +983,37 @@ void HipBinSpirv::executeHipCCCmd(vector<string> argv) {
   }
 
   if (opts.runCmd.present) {
+    // skip the link if the inputs and link flags match the link manifest
+    bool writeManifest =
+        opts.linkManifest.present && !opts.compileOnly.present;
+    LinkManifest manifest(opts.outputFile);
+    if (writeManifest) {
+      manifest.addEntry("compiler", getHipCC());
+      manifest.addEntry("hipldflags", HIPLDFLAGS);
+      manifest.addEntry("hipcxxflags", HIPCXXFLAGS);
+      manifest.addInputsFromArgs(originalArgv);
+      if (manifest.isUpToDate()) {
+        if (opts.verbose & 0x1) {
+          cout << "hipcc: link inputs unchanged, skipping link" << endl;
+        }
+        if (opts.linkManifestTouch.present) {
+          hipBinUtilPtr_->touchFile(
+              opts.outputFile.empty() ? "a.out" : opts.outputFile);
+          manifest.write();
+        }
+        exit(EXIT_SUCCESS);
+      }
+    }
     SystemCmdOut sysOut;
     sysOut = hipBinUtilPtr_->exec(CMD.c_str(), true);
     string cmdOut = sysOut.out;
     int CMD_EXIT_CODE = sysOut.exitCode;
+    unityBuild.cleanup();
     if (CMD_EXIT_CODE != 0) {
       cout << "failed to execute:" << CMD << std::endl;
+    } else if (writeManifest && !manifest.write()) {
+      cout << "Warning: unable to write link manifest " << manifest.getPath()
+           << endl;
     }
     exit(CMD_EXIT_CODE);
   } // end of runCmd section
@@ -0,0 +1,369 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_STATS_H_
+#define SRC_HIPBIN_STATS_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#endif
+
+# define HIPCC_STATS_WINDOW_HOURS   24
+# define HIPCC_STATS_TOP            10
+
+// one hipcc invocation (or batch job) as recorded in HIPCC_STATS_DB
+struct StatsRecord {
+  string mode;             // compile, link, compile+link or preprocess;
+                           // empty if no command ran
+  vector<string> inputs;   // absolute paths
+  vector<string> outputs;  // absolute paths
+  vector<string> archs;    // offload archs
+  string cache;            // link manifest outcome: hit, miss or empty
+  double wallMs = 0;
+  double userMs = 0;       // CPU time of the compiler processes
+  double sysMs = 0;
+  long maxRssKb = 0;       // peak RSS of the largest compiler process
+  int exitCode = 0;
+  long long time = 0;      // seconds since the epoch, set by append
+};
+
+/**
+ * @brief Compile statistics database (HIPCC_STATS_DB).
+ *
+ * An append-only JSON Lines file with one record per hipcc invocation.
+ * Every record is written with a single write under an exclusive flock, so
+ * the parallel invocations of a build can share one database. The CPU time
+ * and peak RSS come from the wait4 resource usage of the compiler commands.
+ * hipcc --stats-report aggregates the records of the last window (24 hours
+ * of records by default) into the slowest and the most memory hungry
+ * translation units, the time per offload arch and the regressions against
+ * the window before.
+ */
+class StatsDb {
+ public:
+  explicit StatsDb(const string& path);
+  bool append(StatsRecord record) const;
+  int report(const vector<string>& argv) const;
+  static void addUsage(StatsRecord& record, const SystemCmdOut& sysOut);
+  static void addProcessUsage(StatsRecord& record);
+
+ private:
+  string path_;
+  bool load(vector<StatsRecord>& records) const;
+  static JsonValue toJson(const StatsRecord& record);
+  static StatsRecord fromJson(const JsonValue& value);
+  static string getKey(const StatsRecord& record);
+};
+
+StatsDb::StatsDb(const string& path) : path_(path) {}
+
+JsonValue StatsDb::toJson(const StatsRecord& record) {
+  JsonValue value = JsonValue::object();
+  auto toArray = [](const vector<string>& strings) {
+    JsonValue array = JsonValue::array();
+    for (auto& str : strings)
+      array.push(str);
+    return array;
+  };
+  value.set("time", record.time);
+  value.set("mode", record.mode);
+  value.set("inputs", toArray(record.inputs));
+  value.set("outputs", toArray(record.outputs));
+  value.set("archs", toArray(record.archs));
+  value.set("cache", record.cache);
+  value.set("wall_ms", static_cast<long long>(record.wallMs));
+  value.set("user_ms", static_cast<long long>(record.userMs));
+  value.set("sys_ms", static_cast<long long>(record.sysMs));
+  value.set("max_rss_kb", record.maxRssKb);
+  value.set("exit_code", record.exitCode);
+  return value;
+}
+
+StatsRecord StatsDb::fromJson(const JsonValue& value) {
+  StatsRecord record;
+  auto fromArray = [&value](const string& key) {
+    vector<string> strings;
+    const JsonValue* array = value.find(key);
+    if (array) {
+      for (auto& item : array->items) {
+        if (item.isString())
+          strings.push_back(item.stringValue);
+      }
+    }
+    return strings;
+  };
+  record.time = static_cast<long long>(value.getNumber("time"));
+  record.mode = value.getString("mode");
+  record.inputs = fromArray("inputs");
+  record.outputs = fromArray("outputs");
+  record.archs = fromArray("archs");
+  record.cache = value.getString("cache");
+  record.wallMs = value.getNumber("wall_ms");
+  record.userMs = value.getNumber("user_ms");
+  record.sysMs = value.getNumber("sys_ms");
+  record.maxRssKb = static_cast<long>(value.getNumber("max_rss_kb"));
+  record.exitCode = static_cast<int>(value.getNumber("exit_code"));
+  return record;
+}
+
+// adds the resource usage of a command run by HipBinUtil::exec
+void StatsDb::addUsage(StatsRecord& record, const SystemCmdOut& sysOut) {
+  record.userMs += sysOut.userMs;
+  record.sysMs += sysOut.sysMs;
+  record.maxRssKb = std::max(record.maxRssKb, sysOut.maxRssKb);
+}
+
+// adds the resource usage of this process and its waited for children,
+// which covers an in-process clang as well as the executed commands
+void StatsDb::addProcessUsage(StatsRecord& record) {
+#if !defined(_WIN32) && !defined(_WIN64)
+  for (int who : {RUSAGE_SELF, RUSAGE_CHILDREN}) {
+    struct rusage usage = {};
+    if (getrusage(who, &usage) != 0)
+      continue;
+    SystemCmdOut sysOut;
+    sysOut.userMs = usage.ru_utime.tv_sec * 1000.0 +
+                    usage.ru_utime.tv_usec / 1000.0;
+    sysOut.sysMs = usage.ru_stime.tv_sec * 1000.0 +
+                   usage.ru_stime.tv_usec / 1000.0;
+    sysOut.maxRssKb = usage.ru_maxrss;
+    addUsage(record, sysOut);
+  }
+#endif
+}
+
+// appends the record as one line; returns false if the file can't be written
+bool StatsDb::append(StatsRecord record) const {
+  record.time = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+  string line = toJson(record).dump() + "\n";
+#if defined(_WIN32) || defined(_WIN64)
+  ofstream out(path_, std::ios::app | std::ios::binary);
+  if (!out.is_open())
+    return false;
+  out << line;
+  return static_cast<bool>(out);
+#else
+  int fd = open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                0644);
+  if (fd < 0)
+    return false;
+  bool written = false;
+  if (flock(fd, LOCK_EX) == 0) {
+    written = write(fd, line.data(), line.size()) ==
+              static_cast<ssize_t>(line.size());
+    flock(fd, LOCK_UN);
+  }
+  close(fd);
+  return written;
+#endif
+}
+
+// reads all records, skipping lines that are not valid records
+bool StatsDb::load(vector<StatsRecord>& records) const {
+  ifstream in(path_);
+  if (!in.is_open())
+    return false;
+  string line;
+  while (std::getline(in, line)) {
+    JsonValue value;
+    if (JsonValue::parse(line, value) && value.isObject())
+      records.push_back(fromJson(value));
+  }
+  return true;
+}
+
+// a translation unit is identified by its first input, a link by its output
+string StatsDb::getKey(const StatsRecord& record) {
+  if (record.mode == "link" && !record.outputs.empty())
+    return record.outputs.at(0);
+  if (!record.inputs.empty())
+    return record.inputs.at(0);
+  return record.outputs.empty() ? "" : record.outputs.at(0);
+}
+
+// hipcc --stats-report[=<db>] [--stats-window=<hours>] [--stats-top=<N>]
+int StatsDb::report(const vector<string>& argv) const {
+  string path = path_;
+  double windowHours = HIPCC_STATS_WINDOW_HOURS;
+  size_t top = HIPCC_STATS_TOP;
+  HipBinUtil* hipBinUtilPtr = HipBinUtil::getInstance();
+  for (auto& arg : argv) {
+    if (arg.compare(0, 15, "--stats-report=") == 0) {
+      path = arg.substr(15);
+    } else if (arg.compare(0, 15, "--stats-window=") == 0 &&
+               hipBinUtilPtr->stringRegexMatch(arg.substr(15),
+                                               "[0-9]+(\\.[0-9]+)?")) {
+      windowHours = std::stod(arg.substr(15));
+    } else if (arg.compare(0, 12, "--stats-top=") == 0 &&
+               hipBinUtilPtr->stringRegexMatch(arg.substr(12), "[0-9]+")) {
+      top = std::stoul(arg.substr(12));
+    }
+  }
+  if (path.empty()) {
+    cout << "hipcc: --stats-report needs HIPCC_STATS_DB or "
+            "--stats-report=<file>" << endl;
+    return EXIT_FAILURE;
+  }
+  vector<StatsRecord> records;
+  if (!StatsDb(path).load(records)) {
+    cout << "hipcc: unable to read " << path << endl;
+    return EXIT_FAILURE;
+  }
+  if (records.empty()) {
+    cout << "hipcc: no records in " << path << endl;
+    return EXIT_SUCCESS;
+  }
+
+  // the window ends with the last record, so an old database still reports
+  long long end = 0;
+  for (auto& record : records)
+    end = std::max(end, record.time);
+  long long window = static_cast<long long>(windowHours * 3600);
+  struct Total {
+    int runs = 0;
+    double wallMs = 0, cpuMs = 0;
+    long maxRssKb = 0;
+  };
+  map<string, Total> current, previous;
+  map<string, double> archMs;
+  int numCurrent = 0, numFailed = 0, numCacheHits = 0;
+  for (auto& record : records) {
+    bool inCurrent = record.time > end - window;
+    bool inPrevious = !inCurrent && record.time > end - 2 * window;
+    if (!inCurrent && !inPrevious)
+      continue;
+    if (inCurrent) {
+      numCurrent++;
+      numFailed += record.exitCode != 0;
+      numCacheHits += record.cache == "hit";
+    }
+    // failed runs and skipped links don't tell how long a build takes
+    if (record.exitCode != 0 || record.cache == "hit")
+      continue;
+    Total& total = (inCurrent ? current : previous)[getKey(record)];
+    total.runs++;
+    total.wallMs += record.wallMs;
+    total.cpuMs += record.userMs + record.sysMs;
+    total.maxRssKb = std::max(total.maxRssKb, record.maxRssKb);
+    if (inCurrent) {
+      // the wall time of an invocation is split evenly between its archs
+      if (record.archs.empty())
+        archMs["(none)"] += record.wallMs;
+      for (auto& arch : record.archs)
+        archMs[arch] += record.wallMs / record.archs.size();
+    }
+  }
+
+  auto seconds = [](double ms) {
+    stringstream str;
+    str << std::fixed << std::setprecision(2) << ms / 1000 << " s";
+    return str.str();
+  };
+  auto mean = [](const Total& total) {
+    return total.wallMs / total.runs;
+  };
+  std::time_t endTime = static_cast<std::time_t>(end);
+  char endStr[32] = "";
+  std::strftime(endStr, sizeof endStr, "%Y-%m-%d %H:%M",
+                std::localtime(&endTime));
+  cout << "hipcc: " << numCurrent << " invocations in the " << windowHours
+       << " hours up to " << endStr << " (" << numFailed << " failed, "
+       << numCacheHits << " links skipped)\n";
+
+  vector<std::pair<string, Total>> units(current.begin(), current.end());
+  std::sort(units.begin(), units.end(), [&](const std::pair<string, Total>& a,
+                                            const std::pair<string, Total>& b) {
+    return mean(a.second) > mean(b.second);
+  });
+  cout << "\nSlowest translation units (mean wall time, CPU time, runs):\n";
+  for (size_t i = 0; i < units.size() && i < top; i++) {
+    const Total& total = units.at(i).second;
+    cout << "  " << std::setw(10) << seconds(mean(total)) << std::setw(11)
+         << seconds(total.cpuMs / total.runs) << std::setw(5) << total.runs
+         << "  " << units.at(i).first << "\n";
+  }
+
+  std::sort(units.begin(), units.end(), [](const std::pair<string, Total>& a,
+                                           const std::pair<string, Total>& b) {
+    return a.second.maxRssKb > b.second.maxRssKb;
+  });
+  cout << "\nMost memory hungry translation units (peak RSS):\n";
+  for (size_t i = 0; i < units.size() && i < top; i++) {
+    cout << "  " << std::setw(7) << units.at(i).second.maxRssKb / 1024
+         << " MB  " << units.at(i).first << "\n";
+  }
+
+  vector<std::pair<string, double>> archs(archMs.begin(), archMs.end());
+  std::sort(archs.begin(), archs.end(),
+            [](const std::pair<string, double>& a,
+               const std::pair<string, double>& b) {
+    return a.second > b.second;
+  });
+  cout << "\nWall time per offload arch:\n";
+  for (auto& arch : archs) {
+    cout << "  " << std::setw(10) << seconds(arch.second) << "  "
+         << arch.first << "\n";
+  }
+
+  // a regression is a mean wall time at least 10% and 100 ms above the one
+  // of the previous window
+  vector<std::pair<string, double>> regressions;
+  for (auto& unit : current) {
+    auto before = previous.find(unit.first);
+    if (before == previous.end())
+      continue;
+    double now = mean(unit.second), then = mean(before->second);
+    if (now - then >= 100 && now >= then * 1.1)
+      regressions.push_back({unit.first, now - then});
+  }
+  std::sort(regressions.begin(), regressions.end(),
+            [](const std::pair<string, double>& a,
+               const std::pair<string, double>& b) {
+    return a.second > b.second;
+  });
+  cout << "\nRegressions against the previous " << windowHours << " hours:\n";
+  if (regressions.empty())
+    cout << "  none\n";
+  for (size_t i = 0; i < regressions.size() && i < top; i++) {
+    const string& key = regressions.at(i).first;
+    double then = mean(previous.at(key));
+    cout << "  +" << seconds(regressions.at(i).second) << " ("
+         << static_cast<int>(regressions.at(i).second * 100 / then) << "%, "
+         << seconds(then) << " -> " << seconds(mean(current.at(key)))
+         << ")  " << key << "\n";
+  }
+  cout.flush();
+  return EXIT_SUCCESS;
+}
+
+#endif  // SRC_HIPBIN_STATS_H_
@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_TIERED_H_
+#define SRC_HIPBIN_TIERED_H_
+
+#include "hipBin_util.h"
+#include "hipBin_batch.h"
+#include <vector>
+#include <string>
+
+# define HIPCC_TIERED_FAST_OPT      " -O1"
+# define HIPCC_TIERED_REPLACE       "--hipcc-tiered-replace="
+
+/**
+ * @brief Tiered compilation (hipcc --tiered).
+ *
+ * A -c compile without an -O option is first done at -O1 for host and
+ * device, without the -O3 and the early inlining hipcc adds by default.
+ * Once it succeeded, hipcc is started again in the background, niced and
+ * without the dependency file options, with --hipcc-tiered-replace=<hash of
+ * the fast object>. That run compiles the default optimized object to a
+ * temporary file and renames it over the object, unless the object was
+ * changed in the meantime (e.g. by a later build).
+ */
+class TieredCompile {
+ public:
+  TieredCompile();
+  bool parseOption(const string& arg);
+  bool isRequested() const;
+  bool isReplace() const;
+  const string& getObject() const;
+  vector<string> rewriteArgs(const vector<string>& argv);
+  static bool makeFastCommand(string& cmd, const string& optFlags);
+  static size_t findOutput(const vector<string>& argv, string* output);
+  bool startFullCompile(const vector<string>& argv, const string& object,
+                        int verbose) const;
+  bool finishFullCompile(int exitCode, int verbose) const;
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  bool requested_ = false;
+  string replaceHash_;       // hash of the fast object to replace
+  string object_, tmpObject_;
+};
+
+TieredCompile::TieredCompile() {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+// handles --tiered and --hipcc-tiered-replace=<hash>
+bool TieredCompile::parseOption(const string& arg) {
+  if (arg == "--tiered") {
+    requested_ = true;
+  } else if (arg.compare(0, 23, HIPCC_TIERED_REPLACE) == 0) {
+    replaceHash_ = arg.substr(23);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool TieredCompile::isRequested() const {
+  return requested_ && replaceHash_.empty();
+}
+
+bool TieredCompile::isReplace() const {
+  return !replaceHash_.empty();
+}
+
+// the object the full compile replaces
+const string& TieredCompile::getObject() const {
+  return object_;
+}
+
+// the index of the last -o <file> or -o<file> option and its file; 0 if
+// there is none
+size_t TieredCompile::findOutput(const vector<string>& argv, string* output) {
+  size_t index = 0;
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg == "-o" && i + 1 < argv.size()) {
+      index = i;
+      *output = argv.at(++i);
+    } else if (arg.size() > 2 && arg.compare(0, 2, "-o") == 0 &&
+               arg.compare(0, 4, "-obj") != 0) {
+      index = i;
+      *output = arg.substr(2);
+    }
+  }
+  return index;
+}
+
+// the full compile writes a temporary object next to the one of -o
+vector<string> TieredCompile::rewriteArgs(const vector<string>& argv) {
+  vector<string> args = argv;
+  size_t index = findOutput(args, &object_);
+  if (index == 0)
+    return args;
+  tmpObject_ = object_ + ".tiered-" + replaceHash_.substr(0, 16);
+  if (args.at(index) == "-o")
+    args.at(index + 1) = tmpObject_;
+  else
+    args.at(index) = "-o" + tmpObject_;
+  return args;
+}
+
+// replaces the optimization flags of the default compile by -O1
+bool TieredCompile::makeFastCommand(string& cmd, const string& optFlags) {
+  size_t pos = cmd.find(optFlags);
+  if (optFlags.empty() || pos == string::npos)
+    return false;
+  cmd.replace(pos, optFlags.size(), HIPCC_TIERED_FAST_OPT);
+  return true;
+}
+
+// starts the background hipcc building the optimized object, the one of
+// -o <file> or -o<file>, else object
+bool TieredCompile::startFullCompile(const vector<string>& argv,
+                                     const string& object,
+                                     int verbose) const {
+#if defined(_WIN32) || defined(_WIN64)
+  return false;
+#else
+  string output = object;
+  size_t outputIndex = findOutput(argv, &output);
+  string hash = hipBinUtilPtr_->hashFile(output);
+  if (hash.empty())
+    return false;
+  string cmd = "nice -n 10 " + BatchCompile::quote(argv.at(0));
+  // the fast compile already wrote the dependency files
+  const vector<string> depFlags = {"-MF", "-MT", "-MQ"};
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg == "--tiered" || arg == "-MD" || arg == "-MMD" || arg == "-MP")
+      continue;
+    // the output is passed once, as a separate -o below
+    if (outputIndex != 0 && i == outputIndex) {
+      if (arg == "-o")
+        i++;
+      continue;
+    }
+    if (std::find(depFlags.begin(), depFlags.end(), arg) != depFlags.end()) {
+      i++;
+      continue;
+    }
+    if (arg.size() > 3 && std::find(depFlags.begin(), depFlags.end(),
+                                    arg.substr(0, 3)) != depFlags.end())
+      continue;
+    cmd += " " + BatchCompile::quote(arg);
+  }
+  cmd += " -o " + BatchCompile::quote(output);
+  cmd += " " + BatchCompile::quote(HIPCC_TIERED_REPLACE + hash);
+  if (verbose & 0x1)
+    cout << "hipcc-tiered-cmd: " << cmd << endl;
+  return hipBinUtilPtr_->exec((cmd + " >/dev/null 2>&1 &").c_str()).exitCode
+         == 0;
+#endif
+}
+
+// renames the optimized object over the fast one if that is unchanged
+bool TieredCompile::finishFullCompile(int exitCode, int verbose) const {
+  std::error_code ec;
+  if (tmpObject_.empty())
+    return false;
+  if (exitCode != 0) {
+    fs::remove(tmpObject_, ec);
+    return false;
+  }
+  if (hipBinUtilPtr_->hashFile(object_) != replaceHash_) {
+    if (verbose & 0x1)
+      cout << "hipcc: " << object_ << " changed, not replaced" << endl;
+    fs::remove(tmpObject_, ec);
+    return false;
+  }
+  fs::rename(tmpObject_, object_, ec);
+  if (ec)
+    fs::remove(tmpObject_, ec);
+  return !ec;
+}
+
+#endif  // SRC_HIPBIN_TIERED_H_
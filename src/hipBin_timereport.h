@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_TIMEREPORT_H_
+#define SRC_HIPBIN_TIMEREPORT_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include "hipBin_timetrace.h"
+#include "hipBin_sidefiles.h"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <iomanip>
+
+# define HIPCC_TIME_REPORT_EXT      ".time-report.json"
+# define HIPCC_TIME_REPORT_ENTRIES  100
+# define HIPCC_TIME_REPORT_TOP      10
+
+/**
+ * @brief Per translation unit -ftime-trace report (hipcc --time-report).
+ *
+ * The compile runs with -ftime-trace; the traces of each output are
+ * collected as CompileSideFiles after the compile and merged into
+ * <output>.time-report.json, with the time of the heaviest
+ * headers, template instantiations and backend passes per arch.
+ * hipcc --time-report-summary aggregates these reports across a build
+ * directory.
+ */
+class TimeReport {
+ public:
+  TimeReport(const string& output, const vector<string>& inputs,
+             int verbose);
+  static string getFlags();
+  bool write(const CompileSideFiles& sideFiles, size_t output,
+             double wallMs, bool keepTraces);
+  static int summarize(const vector<string>& argv);
+
+ private:
+  string output_;
+  vector<string> inputs_;
+  int verbose_;
+  static JsonValue summarizeTrace(const TimeTrace& trace);
+};
+
+TimeReport::TimeReport(const string& output, const vector<string>& inputs,
+                       int verbose)
+    : output_(output), inputs_(inputs), verbose_(verbose) {}
+
+// the options tracing the compile
+string TimeReport::getFlags() {
+  return " -ftime-trace";
+}
+
+// the phase totals and the heaviest headers, template instantiations and
+// backend passes of a trace
+JsonValue TimeReport::summarizeTrace(const TimeTrace& trace) {
+  double total = 0, frontend = 0, backend = 0;
+  map<string, double> headers, instantiations, passes;
+  for (auto& event : trace.getEvents()) {
+    const string& name = event.name;
+    if (name.compare(0, 6, "Total ") == 0)
+      continue;
+    double ms = event.duration / 1000;
+    if (name == "ExecuteCompiler") {
+      total += ms;
+    } else if (name == "Frontend") {
+      frontend += ms;
+    } else if (name == "Backend") {
+      backend += ms;
+    } else if (name == "Source") {
+      headers[event.detail] += ms;
+    } else if (name == "InstantiateFunction" || name == "InstantiateClass") {
+      instantiations[event.detail] += ms;
+    } else if (name == "RunPass") {
+      passes[event.detail] += ms;
+    } else if (name.size() > 4 &&
+               name.compare(name.size() - 4, 4, "Pass") == 0) {
+      passes[name] += ms;
+    }
+  }
+  auto toArray = [](const map<string, double>& times) {
+    vector<std::pair<string, double>> sorted(times.begin(), times.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const std::pair<string, double>& a,
+                 const std::pair<string, double>& b) {
+      return a.second > b.second;
+    });
+    JsonValue array = JsonValue::array();
+    for (size_t i = 0; i < sorted.size() && i < HIPCC_TIME_REPORT_ENTRIES;
+         i++) {
+      JsonValue entry = JsonValue::object();
+      entry.set("name", sorted.at(i).first);
+      entry.set("ms", std::round(sorted.at(i).second * 10) / 10);
+      array.push(entry);
+    }
+    return array;
+  };
+  JsonValue summary = JsonValue::object();
+  summary.set("total_ms", std::round(total));
+  summary.set("frontend_ms", std::round(frontend));
+  summary.set("backend_ms", std::round(backend));
+  summary.set("headers", toArray(headers));
+  summary.set("instantiations", toArray(instantiations));
+  summary.set("passes", toArray(passes));
+  return summary;
+}
+
+// merges the traces of the output with the index output of the compile
+// into <output>.time-report.json. The traces written next to the output
+// are removed unless the user asked for them.
+bool TimeReport::write(const CompileSideFiles& sideFiles, size_t output,
+                       double wallMs, bool keepTraces) {
+  std::error_code ec;
+  JsonValue report = JsonValue::object();
+  report.set("schema", 1);
+  report.set("output", fs::absolute(output_, ec).string());
+  JsonValue inputs = JsonValue::array();
+  for (auto& input : inputs_)
+    inputs.push(fs::absolute(input, ec).string());
+  report.set("inputs", inputs);
+  report.set("wall_ms", std::round(wallMs));
+  JsonValue compilations = JsonValue::array();
+  for (auto& traceFile : sideFiles.find(".json", output)) {
+    TimeTrace trace;
+    if (!trace.load(traceFile))
+      continue;
+    JsonValue compilation = summarizeTrace(trace);
+    compilation.members.insert(compilation.members.begin(),
+                               {"arch",
+                                CompileSideFiles::getArch(traceFile)});
+    compilations.push(compilation);
+    if (!keepTraces && !sideFiles.isPrivate(traceFile))
+      fs::remove(traceFile, ec);
+  }
+  report.set("compilations", compilations);
+  string reportPath = output_ + HIPCC_TIME_REPORT_EXT;
+  if (verbose_ & 0x1) {
+    cout << "hipcc: " << compilations.items.size() << " time traces merged"
+         << " into " << reportPath << endl;
+  }
+  ofstream out(reportPath);
+  if (!out.is_open())
+    return false;
+  out << report.dump(1) << "\n";
+  return static_cast<bool>(out);
+}
+
+// hipcc --time-report-summary [--time-report-top=<N>] [<report|dir>...]
+int TimeReport::summarize(const vector<string>& argv) {
+  size_t top = HIPCC_TIME_REPORT_TOP;
+  vector<string> paths;
+  HipBinUtil* hipBinUtilPtr = HipBinUtil::getInstance();
+  for (size_t i = 1; i < argv.size(); i++) {
+    const string& arg = argv.at(i);
+    if (arg.compare(0, 18, "--time-report-top=") == 0 &&
+        hipBinUtilPtr->stringRegexMatch(arg.substr(18), "[0-9]+")) {
+      top = std::stoul(arg.substr(18));
+    } else if (arg.compare(0, 2, "--") != 0) {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty())
+    paths.push_back(".");
+
+  // arch -> category -> name -> (ms, translation units)
+  typedef map<string, std::pair<double, int>> Times;
+  map<string, map<string, Times>> archTimes;
+  map<string, double> archTotals;
+  const vector<string> categories = {"headers", "instantiations", "passes"};
+  int numReports = 0, numCompilations = 0;
+  std::error_code ec;
+  vector<string> reports;
+  for (auto& path : paths) {
+    if (!fs::is_directory(path, ec)) {
+      reports.push_back(path);
+      continue;
+    }
+    for (fs::recursive_directory_iterator it(path, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      string name = it->path().filename().string();
+      string ext = HIPCC_TIME_REPORT_EXT;
+      if (name.size() > ext.size() &&
+          name.compare(name.size() - ext.size(), ext.size(), ext) == 0)
+        reports.push_back(it->path().string());
+    }
+  }
+  for (auto& reportPath : reports) {
+    ifstream in(reportPath);
+    stringstream buffer;
+    buffer << in.rdbuf();
+    JsonValue report;
+    const JsonValue* compilations = nullptr;
+    if (!JsonValue::parse(buffer.str(), report) ||
+        !(compilations = report.find("compilations"))) {
+      cout << "Warning: " << reportPath << " is not a time report" << endl;
+      continue;
+    }
+    numReports++;
+    for (auto& compilation : compilations->items) {
+      numCompilations++;
+      string arch = compilation.getString("arch", "host");
+      archTotals[arch] += compilation.getNumber("total_ms");
+      for (auto& category : categories) {
+        const JsonValue* entries = compilation.find(category);
+        if (!entries)
+          continue;
+        Times& times = archTimes[arch][category];
+        for (auto& entry : entries->items) {
+          auto& time = times[entry.getString("name")];
+          time.first += entry.getNumber("ms");
+          time.second++;
+        }
+      }
+    }
+  }
+  if (numReports == 0) {
+    cout << "hipcc: no time reports found" << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "hipcc: " << numReports << " time reports, " << numCompilations
+       << " compilations\n";
+  const map<string, string> titles = {
+    {"headers", "Heaviest headers"},
+    {"instantiations", "Heaviest template instantiations"},
+    {"passes", "Heaviest backend passes"}};
+  for (auto& arch : archTimes) {
+    cout << "\n" << arch.first << ": " << std::fixed << std::setprecision(3)
+         << archTotals[arch.first] / 1000 << " s compiling\n";
+    for (auto& category : categories) {
+      vector<std::pair<string, std::pair<double, int>>> sorted(
+          arch.second[category].begin(), arch.second[category].end());
+      std::sort(sorted.begin(), sorted.end(),
+                [](const std::pair<string, std::pair<double, int>>& a,
+                   const std::pair<string, std::pair<double, int>>& b) {
+        return a.second.first > b.second.first;
+      });
+      cout << "  " << titles.at(category) << " (total, translation units):\n";
+      for (size_t i = 0; i < sorted.size() && i < top; i++) {
+        cout << "    " << std::setw(8) << sorted.at(i).second.first / 1000
+             << " s " << std::setw(5) << sorted.at(i).second.second << "  "
+             << sorted.at(i).first << "\n";
+      }
+    }
+  }
+  cout.flush();
+  return EXIT_SUCCESS;
+}
+
+#endif  // SRC_HIPBIN_TIMEREPORT_H_
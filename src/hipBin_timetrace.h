@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_TIMETRACE_H_
+#define SRC_HIPBIN_TIMETRACE_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include <vector>
+#include <string>
+
+/**
+ * @brief A complete ("ph":"X") event of a clang/lld -ftime-trace file
+ */
+struct TraceEvent {
+  string name;
+  string detail;
+  long long tid = 0;
+  double begin = 0;     // microseconds
+  double duration = 0;  // microseconds
+};
+
+/**
+ * @brief Reader for the Chrome trace event files written by --time-trace.
+ */
+class TimeTrace {
+ public:
+  bool load(const string& path);
+  const vector<TraceEvent>& getEvents() const;
+  map<long long, double> getDurationByThread(const vector<string>& names) const;
+
+ private:
+  vector<TraceEvent> events_;
+};
+
+// reads the complete events of a trace file
+bool TimeTrace::load(const string& path) {
+  ifstream in(path);
+  if (!in.is_open())
+    return false;
+  stringstream buffer;
+  buffer << in.rdbuf();
+  JsonValue root;
+  if (!JsonValue::parse(buffer.str(), root))
+    return false;
+  const JsonValue* traceEvents = root.find("traceEvents");
+  if (!traceEvents || !traceEvents->isArray())
+    return false;
+  for (auto& event : traceEvents->items) {
+    if (event.getString("ph") != "X")
+      continue;
+    TraceEvent traceEvent;
+    traceEvent.name = event.getString("name");
+    traceEvent.tid = static_cast<long long>(event.getNumber("tid"));
+    traceEvent.begin = event.getNumber("ts");
+    traceEvent.duration = event.getNumber("dur");
+    if (const JsonValue* args = event.find("args"))
+      traceEvent.detail = args->getString("detail");
+    events_.push_back(traceEvent);
+  }
+  return true;
+}
+
+const vector<TraceEvent>& TimeTrace::getEvents() const {
+  return events_;
+}
+
+// sums up the duration of the named events per thread
+map<long long, double> TimeTrace::getDurationByThread(
+    const vector<string>& names) const {
+  map<long long, double> durations;
+  for (auto& event : events_) {
+    if (std::find(names.begin(), names.end(), event.name) != names.end())
+      durations[event.tid] += event.duration;
+  }
+  return durations;
+}
+
+#endif  // SRC_HIPBIN_TIMETRACE_H_
@@ -0,0 +1,292 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_UNITY_H_
+#define SRC_HIPBIN_UNITY_H_
+
+#include "hipBin_util.h"
+#include "hipBin_scan.h"
+#include <vector>
+#include <string>
+#include <climits>
+
+# define HIPCC_UNITY_DEFAULT_SIZE   8
+
+/**
+ * @brief A generated unity translation unit and the sources it includes
+ */
+struct UnityGroup {
+  vector<string> sources;
+  vector<SourceInfo> infos;
+  string path;
+};
+
+/**
+ * @brief Unity build support for hipcc --unity[=N].
+ *
+ * Groups the HIP sources of an invocation into generated translation units
+ * of about N sources each. Every generated unit #includes its sources, so
+ * diagnostics and debug info keep pointing at the original file and line.
+ * Sources defining the same internal name (static or anonymous namespace)
+ * or the same macro differently are never put into the same group.
+ * Only invocations that link are grouped: a -c compile would produce
+ * an object per unity source instead of the per-source objects the build
+ * expects, so checkArgs() rejects it along with the other options that
+ * make the grouping ambiguous.
+ */
+class UnityBuild {
+ public:
+  UnityBuild();
+  ~UnityBuild();
+  bool parseOption(const string& arg);
+  bool isEnabled() const;
+  bool checkArgs(const vector<string>& argv) const;
+  vector<string> rewriteArgs(const vector<string>& argv,
+                             bool compileCxxAsHip, int verbose);
+  void cleanup();
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  int groupSize_ = 0;
+  string unityDir_;
+  vector<UnityGroup> groups_;
+  bool isUnitySource(const string& arg, bool compileCxxAsHip) const;
+  bool collides(const UnityGroup& group, const SourceInfo& info,
+                string& name) const;
+  bool writeGroup(UnityGroup& group);
+};
+
+UnityBuild::UnityBuild() {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+UnityBuild::~UnityBuild() {
+  cleanup();
+}
+
+// handles --unity and --unity=N
+bool UnityBuild::parseOption(const string& arg) {
+  if (arg == "--unity") {
+    groupSize_ = HIPCC_UNITY_DEFAULT_SIZE;
+  } else if (hipBinUtilPtr_->stringRegexMatch(arg, "--unity=[0-9]+")) {
+    // strtol saturates on overlong sizes, which mean a single group
+    groupSize_ = static_cast<int>(std::min(
+        strtol(arg.c_str() + 8, nullptr, 10), static_cast<long>(INT_MAX)));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool UnityBuild::isEnabled() const {
+  return groupSize_ > 1;
+}
+
+// sources compiled as HIP by extension, matching the -x hip selection of
+// the hipcc argument loop
+bool UnityBuild::isUnitySource(const string& arg,
+                               bool compileCxxAsHip) const {
+  if (hipBinUtilPtr_->stringRegexMatch(arg, ".*\\.hip$"))
+    return true;
+  if (!compileCxxAsHip)
+    return false;
+  return hipBinUtilPtr_->stringRegexMatch(arg, ".*\\.(cu|cpp|cxx|cc|C)$");
+}
+
+// returns true if info defines a name that is already internal to the
+// group or redefines one of its macros
+bool UnityBuild::collides(const UnityGroup& group, const SourceInfo& info,
+                          string& name) const {
+  for (auto& member : group.infos) {
+    for (auto& internalName : info.internalNames) {
+      if (std::find(member.internalNames.begin(), member.internalNames.end(),
+                    internalName) != member.internalNames.end()) {
+        name = internalName;
+        return true;
+      }
+    }
+    for (auto& define : info.defines) {
+      auto it = member.defines.find(define.first);
+      if (it != member.defines.end() && it->second != define.second) {
+        name = define.first;
+        return true;
+      }
+    }
+    // a macro leaking into a later source could change its meaning
+    for (auto& define : member.defines) {
+      for (auto& internalName : info.internalNames) {
+        if (define.first == internalName) {
+          name = internalName;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// writes the unity translation unit of the group. The name is derived from
+// the group contents so that the per-group object is stable across builds.
+bool UnityBuild::writeGroup(UnityGroup& group) {
+  string contents = "// Generated by hipcc --unity, do not edit.\n";
+  for (auto& source : group.sources) {
+    string path = fs::absolute(source).string();
+    path = regex_replace(path, regex("([\\\\\"])"), "\\$1");
+    contents += "#include \"" + path + "\"\n";
+  }
+  if (unityDir_.empty()) {
+    fs::path dirTemplate = hipBinUtilPtr_->getTempDir();
+    dirTemplate /= "hipcc-unity-XXXXXX";
+    unityDir_ = hipBinUtilPtr_->mktempDir(dirTemplate.string());
+    if (unityDir_.empty())
+      return false;
+  }
+  fs::path unityFile = unityDir_;
+  unityFile /= "unity_" + hipBinUtilPtr_->hashString(contents).substr(0, 12) +
+               ".hip";
+  ofstream out(unityFile.string());
+  if (!out.is_open())
+    return false;
+  out << contents;
+  out.close();
+  group.path = unityFile.string();
+  return true;
+}
+
+// an explicit language or a single output makes the grouping ambiguous, and
+// compiles without a link have per-source outputs. Prints an error and
+// returns false if argv holds such an option.
+bool UnityBuild::checkArgs(const vector<string>& argv) const {
+  for (auto& arg : argv) {
+    if (arg.compare(0, 2, "-x") == 0 || arg == "-E" || arg == "-M" ||
+        arg == "-MM" || arg == "-c" || arg == "-S" || arg == "--genco" ||
+        hipBinUtilPtr_->substringPresent(arg, "-fopenmp-targets=")) {
+      cout << "hipcc: --unity cannot be combined with " << arg << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Replaces the HIP sources in argv by the generated unity sources. Sources
+// which cannot be scanned are left untouched. The options --unity and
+// --unity=N are removed. argv must have passed checkArgs().
+vector<string> UnityBuild::rewriteArgs(const vector<string>& argv,
+                                       bool compileCxxAsHip, int verbose) {
+  vector<string> args;
+  vector<string> sources;
+  string prevArg;
+  for (auto& arg : argv) {
+    if (arg == "--unity" || arg.compare(0, 8, "--unity=") == 0)
+      continue;
+    args.push_back(arg);
+    if (prevArg != "-o" && !arg.empty() && arg.at(0) != '-' &&
+        isUnitySource(arg, compileCxxAsHip))
+      sources.push_back(arg);
+    prevArg = arg;
+  }
+  if (!isEnabled())
+    return args;
+  if (sources.size() < 2)
+    return args;
+
+  // first fit: a source goes into the first open group it does not
+  // collide with
+  for (auto& source : sources) {
+    SourceInfo info;
+    if (!SourceScanner::scanFile(source, info))
+      continue;
+    bool placed = false;
+    for (auto& group : groups_) {
+      string name;
+      if (static_cast<int>(group.sources.size()) >= groupSize_)
+        continue;
+      if (collides(group, info, name)) {
+        if (verbose & 0x1) {
+          cout << "hipcc: " << source << " not grouped with "
+               << group.sources.front() << ", both define " << name << endl;
+        }
+        continue;
+      }
+      group.sources.push_back(source);
+      group.infos.push_back(info);
+      placed = true;
+      break;
+    }
+    if (!placed) {
+      UnityGroup group;
+      group.sources.push_back(source);
+      group.infos.push_back(info);
+      groups_.push_back(group);
+    }
+  }
+
+  map<string, string> replacement;   // first source -> unity source
+  vector<string> grouped;
+  for (auto& group : groups_) {
+    // a single source is compiled as is
+    if (group.sources.size() < 2)
+      continue;
+    if (!writeGroup(group)) {
+      cout << "Warning: unable to write unity source, --unity is ignored."
+           << endl;
+      cleanup();
+      return args;
+    }
+    replacement[group.sources.front()] = group.path;
+    grouped.insert(grouped.end(), group.sources.begin(), group.sources.end());
+    if (verbose & 0x1) {
+      cout << "hipcc: unity source " << group.path << ":";
+      for (auto& source : group.sources)
+        cout << " " << source;
+      cout << endl;
+    }
+  }
+
+  vector<string> rewritten;
+  prevArg.clear();
+  for (auto& arg : args) {
+    bool isSource = prevArg != "-o" && !arg.empty() && arg.at(0) != '-';
+    prevArg = arg;
+    if (isSource && replacement.count(arg)) {
+      rewritten.push_back(replacement[arg]);
+      replacement.erase(arg);
+      continue;
+    }
+    if (isSource && std::find(grouped.begin(), grouped.end(), arg) !=
+        grouped.end())
+      continue;
+    rewritten.push_back(arg);
+  }
+  return rewritten;
+}
+
+// removes the generated unity sources
+void UnityBuild::cleanup() {
+  if (unityDir_.empty())
+    return;
+  std::error_code ec;
+  fs::remove_all(unityDir_, ec);
+  unityDir_.clear();
+}
+
+#endif  // SRC_HIPBIN_UNITY_H_
@@ -99,6 +99,8 @@ namespace fs = std::filesystem;
 #include <regex>
 #include <algorithm>
 #include <vector>
+#include <cstdint>
+#include <iomanip>
 
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -118,6 +120,13 @@ namespace fs = std::filesystem;
 #endif
 #else
 #include <unistd.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <cxxabi.h>
+extern char** environ;
 #endif
 
 using std::cout;
@@ -138,6 +147,10 @@ using std::stringstream;
 struct SystemCmdOut {
   string out;
   int exitCode = 0;
+  // resources of the command and its children (POSIX only)
+  double userMs = 0;
+  double sysMs = 0;
+  long maxRssKb = 0;
 };
 
 
@@ -160,17 +173,30 @@ class HipBinUtil {
   string getTempDir();
   void deleteTempFiles();
   string mktempFile(string name);
+  string mktempDir(string name) const;
   string trim(string str) const;
   string readConfigMap(map<string, string> hipVersionMap,
                        string keyName, string defaultValue) const;
   map<string, string> parseConfigFile(fs::path configPath) const;
   bool substringPresent(string fullString, string subString) const;
   bool stringRegexMatch(string fullString, string pattern) const;
+  bool globMatch(const string& glob, const string& str) const;
+  string demangle(const string& name) const;
   bool checkCmd(const vector<string>& commands, const string& argument);
+  string hashString(const string& data) const;
+  string hashFile(const string& path) const;
+  bool touchFile(const string& path) const;
+  void setEnvironment(const vector<string>* env);
+  const char* getEnv(const char* name) const;
+  unsigned getEnvironmentId() const;
 
  private:
   HipBinUtil() {}
   vector<string> tmpFiles_;
+  map<string, string> env_;   // set by setEnvironment
+  vector<string> envEntries_;  // env_ as NAME=value entries
+  bool envSet_ = false;
+  unsigned envId_ = 0;        // counts the calls of setEnvironment
   static HipBinUtil *instance;
 };
 
@@ -180,6 +206,41 @@ HipBinUtil *HipBinUtil::instance = 0;
 HipBinUtil::~HipBinUtil() {
   // deleted right after use so not necessary
   // deleteTempFiles();
+  if (instance == this)
+    instance = nullptr;
+}
+
+// replaces the process environment for getEnv and the commands run by exec
+// by env ("NAME=value" entries), as used by the libhipcc planning API;
+// nullptr restores it
+void HipBinUtil::setEnvironment(const vector<string>* env) {
+  env_.clear();
+  envEntries_.clear();
+  envSet_ = env != nullptr;
+  envId_++;
+  if (!env)
+    return;
+  for (auto& entry : *env) {
+    size_t pos = entry.find('=');
+    if (pos != string::npos)
+      env_[entry.substr(0, pos)] = entry.substr(pos + 1);
+  }
+  for (auto& value : env_)
+    envEntries_.push_back(value.first + "=" + value.second);
+}
+
+// identifies the environment set by setEnvironment, for what is derived
+// from it once per environment
+unsigned HipBinUtil::getEnvironmentId() const {
+  return envId_;
+}
+
+// returns the value of an environment variable or nullptr if it is unset
+const char* HipBinUtil::getEnv(const char* name) const {
+  if (!envSet_)
+    return std::getenv(name);
+  auto it = env_.find(name);
+  return it == env_.end() ? nullptr : it->second.c_str();
 }
 
 // create temp file with the template name
@@ -193,6 +254,22 @@ string HipBinUtil::mktempFile(string name) {
   return name;
 }
 
+// creates a unique directory from a name ending in XXXXXX, returns an empty
+// string on failure. The caller removes the directory.
+string HipBinUtil::mktempDir(string name) const {
+#if defined(_WIN32) || defined(_WIN64)
+  _mktemp(&name[0]);
+  std::error_code ec;
+  fs::create_directories(name, ec);
+  if (ec)
+    return "";
+#else
+  if (mkdtemp(&name[0]) == nullptr)
+    return "";
+#endif
+  return name;
+}
+
 // gets the path of the executable name
 string HipBinUtil::getSelfPath() const {
   int MAX_PATH_CHAR = 1024;
@@ -323,22 +400,67 @@ SystemCmdOut HipBinUtil::exec(const char* cmd,
     string result = "";
     #if defined(_WIN32) || defined(_WIN64)
       FILE* pipe = _popen(cmd, "r");
-    #else
-      FILE* pipe = popen(cmd, "r");
-    #endif
-    if (!pipe) throw std::runtime_error("popen() failed!");
-    try {
-      while (fgets(buffer, sizeof buffer, pipe) != NULL) {
-        result += buffer;
+      if (!pipe) throw std::runtime_error("popen() failed!");
+      try {
+        while (fgets(buffer, sizeof buffer, pipe) != NULL) {
+          result += buffer;
+        }
+      } catch (...) {
+        cout << "Error while executing the command: " << cmd << endl;
       }
-    } catch (...) {
-      cout << "Error while executing the command: " << cmd << endl;
-    }
-    #if defined(_WIN32) || defined(_WIN64)
       sysOut.exitCode = _pclose(pipe);
     #else
-      int closeStatus = pclose(pipe);
-      sysOut.exitCode =  WEXITSTATUS(closeStatus);
+      // sh -c cmd with its stdout on a pipe, waited for by wait4 to get the
+      // resource usage of the command. Both ends are close-on-exec, so
+      // that the commands other threads spawn meanwhile do not inherit
+      // them and hold the pipe open; the child gets its stdout by dup2.
+      int fds[2];
+      if (pipe2(fds, O_CLOEXEC) != 0)
+        throw std::runtime_error("pipe2() failed!");
+      posix_spawn_file_actions_t actions;
+      posix_spawn_file_actions_init(&actions);
+      posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+      posix_spawn_file_actions_addclose(&actions, fds[0]);
+      posix_spawn_file_actions_addclose(&actions, fds[1]);
+      const char* shArgv[] = {"sh", "-c", cmd, nullptr};
+      // the environment set by setEnvironment, else that of the process
+      vector<const char*> envp;
+      for (auto& entry : envEntries_)
+        envp.push_back(entry.c_str());
+      envp.push_back(nullptr);
+      pid_t pid;
+      int spawnError = posix_spawn(&pid, "/bin/sh", &actions, nullptr,
+                                   const_cast<char* const*>(shArgv),
+                                   envSet_ ? const_cast<char* const*>(
+                                                 envp.data()) : environ);
+      posix_spawn_file_actions_destroy(&actions);
+      close(fds[1]);
+      if (spawnError != 0) {
+        close(fds[0]);
+        throw std::runtime_error("posix_spawn() failed!");
+      }
+      ssize_t count;
+      while ((count = read(fds[0], buffer, sizeof buffer)) != 0) {
+        if (count < 0) {
+          if (errno == EINTR)
+            continue;
+          cout << "Error while executing the command: " << cmd << endl;
+          break;
+        }
+        result.append(buffer, count);
+      }
+      close(fds[0]);
+      int status = 0;
+      struct rusage usage = {};
+      while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+      // a command killed by a signal fails like it would in the shell
+      sysOut.exitCode = WIFSIGNALED(status) ? 128 + WTERMSIG(status) :
+                        WEXITSTATUS(status);
+      sysOut.userMs = usage.ru_utime.tv_sec * 1000.0 +
+                      usage.ru_utime.tv_usec / 1000.0;
+      sysOut.sysMs = usage.ru_stime.tv_sec * 1000.0 +
+                     usage.ru_stime.tv_usec / 1000.0;
+      sysOut.maxRssKb = usage.ru_maxrss;
     #endif
     if (printConsole == true) {
       cout << result << endl;
@@ -376,5 +498,87 @@ bool HipBinUtil::checkCmd(const vector<string>& commands,
 }
 
 
+// FNV-1a 64 bit hash of the data, returned as 16 hex digits
+static uint64_t fnv1a64(const char* data, size_t size,
+                        uint64_t hash = 0xcbf29ce484222325ULL) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static string hashToHex(uint64_t hash) {
+  stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+// returns the content hash of the string
+string HipBinUtil::hashString(const string& data) const {
+  return hashToHex(fnv1a64(data.data(), data.size()));
+}
+
+// matches a glob with * and ?
+bool HipBinUtil::globMatch(const string& glob, const string& str) const {
+  size_t g = 0, s = 0, starG = string::npos, starS = 0;
+  while (s < str.size()) {
+    if (g < glob.size() && (glob[g] == '?' || glob[g] == str[s])) {
+      g++;
+      s++;
+    } else if (g < glob.size() && glob[g] == '*') {
+      starG = g++;
+      starS = s;
+    } else if (starG != string::npos) {
+      g = starG + 1;
+      s = ++starS;
+    } else {
+      return false;
+    }
+  }
+  while (g < glob.size() && glob[g] == '*')
+    g++;
+  return g == glob.size();
+}
+
+// returns the demangled C++ name, or the name if it is not mangled
+string HipBinUtil::demangle(const string& name) const {
+#if !defined(_WIN32) && !defined(_WIN64)
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr,
+                                        &status);
+  if (demangled) {
+    string result = demangled;
+    free(demangled);
+    return result;
+  }
+#endif
+  return name;
+}
+
+// returns the content hash of the file, empty if it cannot be read
+string HipBinUtil::hashFile(const string& path) const {
+  ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+    return "";
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  char buffer[65536];
+  while (in) {
+    in.read(buffer, sizeof buffer);
+    hash = fnv1a64(buffer, static_cast<size_t>(in.gcount()), hash);
+  }
+  return hashToHex(hash);
+}
+
+// updates the modification time of the file to now
+bool HipBinUtil::touchFile(const string& path) const {
+  try {
+    fs::last_write_time(path, fs::file_time_type::clock::now());
+  }
+  catch(...) {
+    return false;
+  }
+  return true;
+}
 
 #endif  // SRC_HIPBIN_UTIL_H_
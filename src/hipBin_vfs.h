@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_HIPBIN_VFS_H_
+#define SRC_HIPBIN_VFS_H_
+
+#include "hipBin_util.h"
+#include "hipBin_json.h"
+#include <vector>
+#include <string>
+
+# define HIPCC_VFS_ROOT             "/hipcc-vfs"
+# define HIPCC_VFS_MAX_DEPTH        16
+
+/**
+ * @brief Clang -ivfsoverlay of the hipcc include directories.
+ *
+ * Every header below the include directories is listed as a file of a
+ * virtual directory under /hipcc-vfs, and the -isystem flags point to the
+ * virtual directories instead. Clang answers lookups in them from the
+ * overlay, so the headers that are not there cost a failed lookup of a
+ * local path instead of one per directory on the (network) filesystem.
+ * Diagnostics and dependency files keep the real paths.
+ * The overlay is cached per toolchain and include directories. Only the
+ * top-level directories are stat'ed for the key; headers added deeper in
+ * the trees need a rebuild of the overlay.
+ */
+class VfsOverlay {
+ public:
+  VfsOverlay();
+  bool create(const vector<string>& dirs, const string& cacheDir,
+              const string& toolchainKey, bool rebuild);
+  bool isEnabled() const;
+  string getVirtualDir(const string& dir) const;
+  const string& getPath() const;
+
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  string path_;
+  map<string, string> virtualDirs_;
+  JsonValue listDirectory(const fs::path& dir, int depth) const;
+};
+
+VfsOverlay::VfsOverlay() {
+  hipBinUtilPtr_ = HipBinUtil::getInstance();
+}
+
+bool VfsOverlay::isEnabled() const {
+  return !path_.empty();
+}
+
+const string& VfsOverlay::getPath() const {
+  return path_;
+}
+
+// returns the virtual directory of an include directory, or an empty string
+// if it is not part of the overlay
+string VfsOverlay::getVirtualDir(const string& dir) const {
+  auto it = virtualDirs_.find(dir);
+  return it == virtualDirs_.end() ? "" : it->second;
+}
+
+// lists the headers below dir as overlay entries, sorted by name
+JsonValue VfsOverlay::listDirectory(const fs::path& dir, int depth) const {
+  JsonValue contents = JsonValue::array();
+  vector<fs::path> entries;
+  std::error_code ec;
+  for (fs::directory_iterator it(dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    entries.push_back(it->path());
+  }
+  std::sort(entries.begin(), entries.end());
+  for (auto& entry : entries) {
+    JsonValue node = JsonValue::object();
+    node.set("name", entry.filename().string());
+    if (fs::is_directory(entry, ec)) {
+      if (depth >= HIPCC_VFS_MAX_DEPTH)
+        continue;
+      node.set("type", "directory");
+      node.set("contents", listDirectory(entry, depth + 1));
+    } else if (fs::is_regular_file(entry, ec)) {
+      node.set("type", "file");
+      node.set("external-contents", entry.string());
+    } else {
+      continue;
+    }
+    contents.push(node);
+  }
+  return contents;
+}
+
+// Creates (or reuses) the overlay of the existing directories in dirs.
+// The cache key covers the toolchain and the paths and modification times
+// of the directories, so that a compile does not walk the trees; a
+// reinstall changes the toolchain. rebuild walks the trees again.
+bool VfsOverlay::create(const vector<string>& dirs, const string& cacheDir,
+                        const string& toolchainKey, bool rebuild) {
+#if defined(_WIN32) || defined(_WIN64)
+  return false;
+#else
+  string key = toolchainKey;
+  vector<string> existingDirs;
+  for (auto& dir : dirs) {
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec))
+      continue;
+    existingDirs.push_back(dir);
+    auto mtime = fs::last_write_time(dir, ec);
+    key += "\n" + dir + "\n" +
+           (ec ? "" : std::to_string(mtime.time_since_epoch().count()));
+  }
+  if (existingDirs.empty())
+    return false;
+  string hash = hipBinUtilPtr_->hashString(key);
+  fs::path overlayPath = cacheDir;
+  overlayPath /= "overlay-" + hash + ".yaml";
+  map<string, string> virtualDirs;
+  for (size_t i = 0; i < existingDirs.size(); i++) {
+    virtualDirs[existingDirs.at(i)] = string(HIPCC_VFS_ROOT) + "/" + hash +
+                                      "/" + std::to_string(i);
+  }
+
+  std::error_code ec;
+  if (rebuild || !fs::exists(overlayPath, ec)) {
+    // JSON is a subset of the YAML clang reads
+    JsonValue overlay = JsonValue::object();
+    overlay.set("version", 0);
+    overlay.set("case-sensitive", true);
+    JsonValue roots = JsonValue::array();
+    for (auto& dir : existingDirs) {
+      JsonValue root = JsonValue::object();
+      root.set("name", virtualDirs[dir]);
+      root.set("type", "directory");
+      root.set("contents", listDirectory(dir, 0));
+      roots.push(root);
+    }
+    overlay.set("roots", roots);
+    string tmpPath = overlayPath.string() + ".tmp";
+    ofstream out(tmpPath);
+    if (!out.is_open())
+      return false;
+    out << overlay.dump() << "\n";
+    out.close();
+    fs::rename(tmpPath, overlayPath, ec);
+    if (ec)
+      return false;
+  }
+  virtualDirs_ = virtualDirs;
+  path_ = overlayPath.string();
+  return true;
+#endif
+}
+
+#endif  // SRC_HIPBIN_VFS_H_
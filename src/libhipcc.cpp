@@ -0,0 +1,438 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "libhipcc.h"
+#include "hipBin_util.h"
+#include "hipBin_amd.h"
+#include "hipBin_nvidia.h"
+#include "hipBin_spirv.h"
+#include <vector>
+#include <string>
+#include <mutex>
+
+class HipBinUtil;
+class HipBinBase;
+class HipBinAmd;
+class HipBinNvidia;
+class HipBinSpirv;
+class HipBin;
+
+
+class HipBin {
+ private:
+  HipBinUtil* hipBinUtilPtr_;
+  vector<HipBinBase*> hipBinBasePtrs_;
+  vector<PlatformInfo> platformVec_;
+  HipBinBase* hipBinNVPtr_;
+  HipBinBase* hipBinAMDPtr_;
+  HipBinBase* hipBinSPIRVPtr_;
+
+ public:
+  HipBin();
+  ~HipBin();
+  vector<HipBinBase*>& getHipBinPtrs();
+  vector<PlatformInfo>& getPlaformInfo();
+  void executeHipBin(string filename, int argc, char* argv[]);
+  void executeHipConfig(int argc, char* argv[]);
+  void executeHipCC(int argc, char* argv[]);
+  void executeHipCCWorker(int argc, char* argv[]);
+  bool freezeConfig(const string& file);
+  bool queryConfig(int argc, char* argv[]);
+  int planHipCC(const vector<string>& argv, BatchJob& job);
+};
+
+
+// Implementation ================================================
+//===========================================================================
+
+HipBin::HipBin() {
+  hipBinUtilPtr_ = hipBinUtilPtr_->getInstance();
+  hipBinNVPtr_ = new HipBinNvidia();
+  hipBinAMDPtr_ = new HipBinAmd();
+  hipBinSPIRVPtr_ = new HipBinSpirv();
+  bool platformDetected = false;
+
+  // Default to SPIR-V for our fork
+  if (hipBinSPIRVPtr_->detectPlatform()) {
+    // populates the struct with Intel/SPIR-V info
+    const PlatformInfo &platformInfo = hipBinSPIRVPtr_->getPlatformInfo();
+    platformVec_.push_back(platformInfo);
+    hipBinBasePtrs_.push_back(hipBinSPIRVPtr_);
+    platformDetected = true;
+  }
+
+  if (hipBinAMDPtr_->detectPlatform()) {
+    // populates the struct with AMD info
+    const PlatformInfo& platformInfo = hipBinAMDPtr_->getPlatformInfo();
+    platformVec_.push_back(platformInfo);
+    hipBinBasePtrs_.push_back(hipBinAMDPtr_);
+    platformDetected = true;
+  } 
+  
+  // if (hipBinNVPtr_->detectPlatform()) {
+  //   // populates the struct with Nvidia info
+  //   const PlatformInfo& platformInfo = hipBinNVPtr_->getPlatformInfo();
+  //   platformVec_.push_back(platformInfo);
+  //   hipBinBasePtrs_.push_back(hipBinNVPtr_);
+  //   platformDetected = true;
+  // } 
+  
+  // if no device is detected, then it is defaulted to AMD
+  if (!platformDetected) {
+    cout << "Device not supported - Defaulting to AMD" << endl;
+    // populates the struct with AMD info
+    const PlatformInfo& platformInfo = hipBinAMDPtr_->getPlatformInfo();
+    platformVec_.push_back(platformInfo);
+    hipBinBasePtrs_.push_back(hipBinAMDPtr_);
+  }
+}
+
+HipBin::~HipBin() {
+  delete hipBinNVPtr_;
+  delete hipBinAMDPtr_;
+  delete hipBinSPIRVPtr_;
+  // clearing the vector so no one accesses the pointers
+  hipBinBasePtrs_.clear();
+  // clearing the platform vector as the pointers are deleted
+  platformVec_.clear();
+  delete hipBinUtilPtr_;
+}
+
+vector<PlatformInfo>& HipBin::getPlaformInfo() {
+  return platformVec_;  // Return the populated platform info.
+}
+
+
+vector<HipBinBase*>& HipBin::getHipBinPtrs() {
+  return hipBinBasePtrs_;  // Return the populated device pointers.
+}
+
+
+void HipBin::executeHipBin(string filename, int argc, char* argv[]) {
+  if (hipBinUtilPtr_->substringPresent(filename, "hipconfig")) {
+    executeHipConfig(argc, argv);
+  } else if (hipBinUtilPtr_->substringPresent(filename, "hipcc-worker")) {
+    executeHipCCWorker(argc, argv);
+  } else if (hipBinUtilPtr_->substringPresent(filename, "hipcc")) {
+    executeHipCC(argc, argv);
+  } else {
+    // A bit strange?
+    cout << "Command " << filename
+    << " not supported. Name the exe as hipconfig"
+    << ", hipcc or hipcc-worker and then try again ..." << endl;
+    exit(-1);
+  }
+}
+
+
+void HipBin::executeHipCC(int argc, char* argv[]) {
+  vector<HipBinBase*>& platformPtrs = getHipBinPtrs();
+  vector<string> argvcc;
+  for (int i = 0; i < argc; i++) {
+    argvcc.push_back(argv[i]);
+  }
+  // 0th index points to the first platform detected.
+  // In the near future this vector will contain mulitple devices
+  platformPtrs.at(0)->executeHipCCCmd(argvcc);
+}
+
+
+// the distributed compile worker runs on the AMD platform
+void HipBin::executeHipCCWorker(int argc, char* argv[]) {
+  vector<string> argvcc;
+  for (int i = 0; i < argc; i++) {
+    argvcc.push_back(argv[i]);
+  }
+  HipBinAmd* hipBinAmdPtr = dynamic_cast<HipBinAmd*>(hipBinAMDPtr_);
+  exit(hipBinAmdPtr->runCompileWorker(argvcc));
+}
+
+
+// plans the commands of a hipcc invocation into job without running them
+int HipBin::planHipCC(const vector<string>& argv, BatchJob& job) {
+  HipBinAmd* hipBinAmdPtr = dynamic_cast<HipBinAmd*>(getHipBinPtrs().at(0));
+  if (!hipBinAmdPtr) {
+    cout << "libhipcc: planning requires the AMD platform" << endl;
+    return EXIT_FAILURE;
+  }
+  return hipBinAmdPtr->runHipCCCmd(argv, &job);
+}
+
+// writes the snapshot of what the platforms discovered, for
+// HIPCC_CONFIG_SNAPSHOT
+bool HipBin::freezeConfig(const string& file) {
+  ConfigSnapshot snapshot;
+  hipBinSPIRVPtr_->addConfigSnapshot(snapshot);
+  hipBinAMDPtr_->addConfigSnapshot(snapshot);
+  return snapshot.write(file);
+}
+
+
+// hipconfig --json and --query a,b,c: the fields of all platforms as one
+// JSON document, {"schema": 1, "platforms": [{field: value, ...}, ...]}.
+// Returns false if neither option is given.
+bool HipBin::queryConfig(int argc, char* argv[]) {
+  bool json = false;
+  vector<string> fields;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i], list;
+    if (arg == "--json" || arg == "-json") {
+      json = true;
+      continue;
+    } else if (arg == "--query" || arg == "-query") {
+      if (i + 1 >= argc) {
+        cout << "hipconfig: --query requires a list of fields" << endl;
+        exit(-1);
+      }
+      list = argv[++i];
+    } else if (arg.compare(0, 8, "--query=") == 0) {
+      list = arg.substr(8);
+    } else {
+      continue;
+    }
+    json = true;
+    for (auto& field : hipBinUtilPtr_->splitStr(list, ',')) {
+      if (field.empty())
+        continue;
+      const vector<string>& known = HipBinBase::getQueryFields();
+      if (std::find(known.begin(), known.end(), field) == known.end()) {
+        cout << "hipconfig: unknown field " << field << endl;
+        exit(-1);
+      }
+      fields.push_back(field);
+    }
+  }
+  if (!json)
+    return false;
+  if (fields.empty())
+    fields = HipBinBase::getQueryFields();
+  JsonValue result = JsonValue::object();
+  result.set("schema", 1);
+  JsonValue& platforms = result.set("platforms", JsonValue::array());
+  for (auto platformPtr : getHipBinPtrs())
+    platforms.push(platformPtr->queryConfig(fields));
+  cout << result.dump(2) << endl;
+  return true;
+}
+
+
+void HipBin::executeHipConfig(int argc, char* argv[]) {
+  if (queryConfig(argc, argv))
+    return;
+  vector<HipBinBase*>& platformPtrs = getHipBinPtrs();
+  for (unsigned int j = 0; j < platformPtrs.size(); j++) {
+    if (argc == 1) {
+      platformPtrs.at(j)->printFull();
+    }
+    for (int i = 1; i < argc; ++i) {
+      HipBinCommand cmd;
+      cmd = platformPtrs.at(j)->gethipconfigCmd(argv[i]);
+      switch (cmd) {
+      case help: platformPtrs.at(j)->printUsage();
+        break;
+      case path: cout << platformPtrs.at(j)->getHipPath();
+        break;
+      // ROCm is not related to either Nvidia or SPIR-V so it should be moved to hipBin_amd.h?
+      case roccmpath: cout << platformPtrs.at(j)->getRoccmPath();
+        break;
+      case cpp_config: cout << platformPtrs.at(j)->getCppConfig();
+        break;
+      case compiler: cout << CompilerTypeStr((
+                             platformPtrs.at(j)->getPlatformInfo()).compiler);
+        break;
+      case platform: cout << PlatformTypeStr((
+                             platformPtrs.at(j)->getPlatformInfo()).platform);
+        break;
+      case runtime: cout << RuntimeTypeStr((
+                            platformPtrs.at(j)->getPlatformInfo()).runtime);
+        break;
+      case hipclangpath: cout << platformPtrs.at(j)->getCompilerPath();
+        break;
+      case full: platformPtrs.at(j)->printFull();
+        break;
+      case version: cout << platformPtrs.at(j)->getHipVersion();
+        break;
+      case check: platformPtrs.at(j)->checkHipconfig();
+        break;
+      case newline:
+        cout << endl;
+        break;
+      case freeze:
+        if (i + 1 >= argc) {
+          cout << "hipconfig: --freeze requires a file name" << endl;
+          exit(-1);
+        }
+        i++;
+        // the snapshot covers all platforms, written once
+        if (j == 0 && !freezeConfig(argv[i])) {
+          cout << "hipconfig: cannot write " << argv[i] << endl;
+          exit(-1);
+        }
+        break;
+      case emit_cmake:
+        if (i + 1 >= argc) {
+          cout << "hipconfig: --emit-cmake requires a file name" << endl;
+          exit(-1);
+        }
+        i++;
+        // written for the first platform detected, the one hipcc uses
+        if (j == 0 && !platformPtrs.at(j)->writeCMakeFile(argv[i])) {
+          cout << "hipconfig: cannot write " << argv[i] << endl;
+          exit(-1);
+        }
+        break;
+      default:
+        platformPtrs.at(j)->printUsage();
+        break;
+      }
+    }
+  }
+}
+
+//===========================================================================
+//===========================================================================
+
+// the environment of a plan is installed in the HipBinUtil instance and the
+// output of hipcc is captured from cout, so plans are made one at a time
+static std::mutex planMutex;
+
+// installs the environment of a plan and captures cout into messages for
+// its lifetime, so that both are restored if planning throws
+class PlanScope {
+ public:
+  PlanScope(const vector<string>* env, std::ostream& messages)
+      : coutBuf_(cout.rdbuf(messages.rdbuf())) {
+    HipBinUtil::getInstance()->setEnvironment(env);
+  }
+  ~PlanScope() {
+    cout.flush();
+    cout.rdbuf(coutBuf_);
+    HipBinUtil::getInstance()->setEnvironment(nullptr);
+  }
+
+ private:
+  std::streambuf* coutBuf_;
+};
+
+static hipcc::Plan makePlan(const vector<string>& argv,
+                            const vector<string>* env) {
+  std::lock_guard<std::mutex> lock(planMutex);
+  hipcc::Plan plan;
+  std::ostringstream messages;
+  BatchJob job;
+  {
+    PlanScope scope(env, messages);
+    HipBin hipBin;
+    plan.status = hipBin.planHipCC(argv, job);
+  }
+  plan.messages = messages.str();
+  if (plan.status != EXIT_SUCCESS)
+    return plan;
+  hipcc::Job planned;
+  if (job.spawn) {
+    planned.argv = argv;
+  } else if (!job.cmd.empty()) {
+    planned.argv = BatchCompile::splitCommand(job.cmd);
+    planned.inputs = job.inputs;
+    planned.outputs = job.outputs;
+  } else {
+    return plan;
+  }
+  planned.temporaries = job.temporaries;
+  plan.jobs.push_back(planned);
+  return plan;
+}
+
+hipcc::Plan hipcc::plan(const vector<string>& argv) {
+  return makePlan(argv, nullptr);
+}
+
+hipcc::Plan hipcc::plan(const vector<string>& argv, const vector<string>& env) {
+  return makePlan(argv, &env);
+}
+
+// the C view of a plan keeps NULL terminated lists of the job strings
+struct hipcc_plan {
+  hipcc::Plan plan;
+  vector<vector<vector<const char*>>> lists;  // [job][hipcc_job_list]
+};
+
+int hipcc_main(int argc, char** argv) {
+  fs::path filename(argv[0]);
+  filename = filename.filename();
+
+  HipBin hipBin;
+  hipBin.executeHipBin(filename.string(), argc, argv);
+  return 0;
+}
+
+hipcc_plan* hipcc_plan_create(int argc, const char* const* argv,
+                              const char* const* envp) {
+  vector<string> args(argv, argv + argc), env;
+  for (const char* const* entry = envp; entry && *entry; entry++)
+    env.push_back(*entry);
+  hipcc_plan* result = new hipcc_plan;
+  result->plan = envp ? hipcc::plan(args, env) : hipcc::plan(args);
+  for (auto& job : result->plan.jobs) {
+    vector<vector<const char*>> lists;
+    for (auto* strings : {&job.argv, &job.inputs, &job.outputs,
+                          &job.temporaries}) {
+      vector<const char*> list;
+      for (auto& str : *strings)
+        list.push_back(str.c_str());
+      list.push_back(nullptr);
+      lists.push_back(list);
+    }
+    result->lists.push_back(lists);
+  }
+  return result;
+}
+
+int hipcc_plan_status(const hipcc_plan* plan) {
+  return plan->plan.status;
+}
+
+const char* hipcc_plan_messages(const hipcc_plan* plan) {
+  return plan->plan.messages.c_str();
+}
+
+size_t hipcc_plan_num_jobs(const hipcc_plan* plan) {
+  return plan->plan.jobs.size();
+}
+
+const char* const* hipcc_plan_job_list(const hipcc_plan* plan, size_t job,
+                                       hipcc_job_list list, size_t* count) {
+  if (job >= plan->lists.size() || list < HIPCC_JOB_ARGV ||
+      list > HIPCC_JOB_TEMPORARIES) {
+    if (count)
+      *count = 0;
+    return nullptr;
+  }
+  const vector<const char*>& strings = plan->lists.at(job).at(list);
+  if (count)
+    *count = strings.size() - 1;
+  return strings.data();
+}
+
+void hipcc_plan_destroy(hipcc_plan* plan) {
+  delete plan;
+}
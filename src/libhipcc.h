@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SRC_LIBHIPCC_H_
+#define SRC_LIBHIPCC_H_
+
+/**
+ * libhipcc: the hipcc/hipconfig driver as a library.
+ *
+ * hipcc_main runs hipcc, hipconfig or hipcc-worker (picked by the name in
+ * argv[0]) exactly like the executables, which are front ends of it.
+ *
+ * The planning API builds the commands of a hipcc invocation without
+ * executing anything: the result is the exit status hipcc would report
+ * for the arguments, the messages hipcc printed while planning, and the
+ * jobs with their argv, inputs, outputs and temporaries. Planning
+ * runs the platform detection and toolchain probes (the clang version, the
+ * GPU targets) like hipcc. Invocations that keep state around the compile
+ * (--unity, --hipcc-preprocess-once, --hipcc-link-manifest,
+ * --hipcc-device-link-jobs, --hipcc-distribute) are planned as one job
+ * running hipcc itself. Queries such as --version produce no job, their
+ * answer is in the messages. Plans are made one at a time; the AMD
+ * platform is required. As for hipcc, HIP_PATH defaults to the parent of
+ * the directory of the executable, so callers outside a HIP installation
+ * set it in the environment of the plan. Configuration errors the platform
+ * detection treats as fatal still end the process.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+
+namespace hipcc {
+
+struct Job {
+  std::vector<std::string> argv;
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+  // files planning wrote for the job, such as the rewritten linker
+  // response file and the objects extracted from archives; the caller
+  // removes them once the job ran
+  std::vector<std::string> temporaries;
+};
+
+struct Plan {
+  int status = 0;        // exit status hipcc would report, 0 on success
+  std::string messages;  // what hipcc printed while planning
+  std::vector<Job> jobs;
+};
+
+// plans argv (argv[0] being hipcc) in the environment of the process
+Plan plan(const std::vector<std::string>& argv);
+// plans argv in the environment env of "NAME=value" entries
+Plan plan(const std::vector<std::string>& argv,
+          const std::vector<std::string>& env);
+
+}  // namespace hipcc
+
+extern "C" {
+#endif
+
+typedef struct hipcc_plan hipcc_plan;
+
+typedef enum hipcc_job_list {
+  HIPCC_JOB_ARGV = 0,
+  HIPCC_JOB_INPUTS,
+  HIPCC_JOB_OUTPUTS,
+  HIPCC_JOB_TEMPORARIES
+} hipcc_job_list;
+
+// runs hipcc, hipconfig or hipcc-worker as named by argv[0]
+int hipcc_main(int argc, char** argv);
+
+// plans argv in the environment envp (NULL terminated "NAME=value"
+// entries), or in the environment of the process if envp is NULL
+hipcc_plan* hipcc_plan_create(int argc, const char* const* argv,
+                              const char* const* envp);
+int hipcc_plan_status(const hipcc_plan* plan);
+const char* hipcc_plan_messages(const hipcc_plan* plan);
+size_t hipcc_plan_num_jobs(const hipcc_plan* plan);
+// returns a NULL terminated list of the job and its size in count (if not
+// NULL); valid until the plan is destroyed
+const char* const* hipcc_plan_job_list(const hipcc_plan* plan, size_t job,
+                                       hipcc_job_list list, size_t* count);
+void hipcc_plan_destroy(hipcc_plan* plan);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // SRC_LIBHIPCC_H_